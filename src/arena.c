@@ -0,0 +1,92 @@
+#include "arena.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+#define ARENA_ALIGNMENT sizeof(void *)
+
+ARENA *arena_alloc()
+{
+	return calloc(1, sizeof(ARENA));
+}
+
+static void arena_free_chunks(ARENA_CHUNK * chunk)
+{
+	while (chunk)
+	{
+		ARENA_CHUNK *next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+}
+
+void arena_free(ARENA * arena)
+{
+	arena_free_chunks(arena->chunks);
+	free(arena);
+}
+
+void arena_reset(ARENA * arena)
+{
+	if (!arena->chunks)
+		return;
+
+	arena_free_chunks(arena->chunks->next);
+	arena->chunks->next = NULL;
+	arena->chunks->used = 0;
+}
+
+static char *arena_reserve(ARENA * arena, size_t size, size_t alignment)
+{
+	ARENA_CHUNK *chunk = arena->chunks;
+	if (chunk)
+	{
+		size_t offset = (chunk->used + alignment - 1) & ~(alignment - 1);
+		if (offset + size <= chunk->size)
+		{
+			chunk->used = offset + size;
+			return chunk->data + offset;
+		}
+	}
+
+	// oversized allocations get a chunk of their own
+	size_t chunk_size = size > ARENA_CHUNK_SIZE / 4 ? size : ARENA_CHUNK_SIZE;
+	ARENA_CHUNK *fresh = malloc(sizeof(ARENA_CHUNK) + chunk_size);
+	fresh->size = chunk_size;
+	fresh->used = size;
+
+	if (chunk && chunk_size != ARENA_CHUNK_SIZE)
+	{
+		// keep bump allocating from the current chunk
+		fresh->next = chunk->next;
+		chunk->next = fresh;
+	} else
+	{
+		fresh->next = chunk;
+		arena->chunks = fresh;
+	}
+
+	return fresh->data;
+}
+
+void *arena_malloc(ARENA * arena, size_t size)
+{
+	return arena_reserve(arena, size, ARENA_ALIGNMENT);
+}
+
+char *arena_strdup(ARENA * arena, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	char *result = arena_reserve(arena, len, 1);
+	memcpy(result, str, len);
+	return result;
+}
+
+size_t arena_size(ARENA * arena)
+{
+	size_t size = sizeof(ARENA);
+	for (ARENA_CHUNK * chunk = arena->chunks; chunk; chunk = chunk->next)
+		size += sizeof(ARENA_CHUNK) + chunk->size;
+	return size;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <stddef.h>
+
+typedef struct ARENA_CHUNK_S {
+	struct ARENA_CHUNK_S *next;
+	size_t size;
+	size_t used;
+	char data[];
+} ARENA_CHUNK;
+
+/**
+ * Bump allocator: allocations are carved out of large chunks and can only
+ * be released all at once.
+ **/
+typedef struct ARENA_S {
+	ARENA_CHUNK *chunks;	// the chunk allocated from comes first
+} ARENA;
+
+ARENA *arena_alloc();
+
+void arena_free(ARENA * arena);
+
+/**
+ * Releases everything allocated from the arena, keeping one chunk for reuse.
+ **/
+void arena_reset(ARENA * arena);
+
+/**
+ * Returns size bytes aligned for any pointer or integer type.
+ **/
+void *arena_malloc(ARENA * arena, size_t size);
+
+char *arena_strdup(ARENA * arena, const char *str);
+
+/**
+ * Returns the number of bytes reserved by the arena.
+ **/
+size_t arena_size(ARENA * arena);
@@ -0,0 +1,374 @@
+#include "async.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+ASYNC *async_init(LDAP * ld)
+{
+	ASYNC *as = calloc(1, sizeof(ASYNC));
+	as->ld = ld;
+	return as;
+}
+
+void async_free(ASYNC * as)
+{
+	while (as->requests)
+		async_abandon(as, as->requests);
+
+	free(as);
+}
+
+static char **string_array_dup(char **strings)
+{
+	if (!strings)
+		return NULL;
+
+	unsigned len;
+	for (len = 0; strings[len]; len++)
+		;
+
+	char **result = calloc(len + 1, sizeof(char *));
+	for (unsigned i = 0; i < len; i++)
+		result[i] = strdup(strings[i]);
+	return result;
+}
+
+static void string_array_free(char **strings)
+{
+	for (unsigned i = 0; strings && strings[i]; i++)
+		free(strings[i]);
+	free(strings);
+}
+
+static void async_request_free(ASYNC_REQUEST * req)
+{
+	free(req->base);
+	free(req->filter);
+	string_array_free(req->attrs);
+	ber_memfree(req->cookie.bv_val);
+	free(req);
+}
+
+static ASYNC_REQUEST *async_request_alloc(ASYNC_DONE_CALLBACK on_done, void *ctx)
+{
+	ASYNC_REQUEST *req = calloc(1, sizeof(ASYNC_REQUEST));
+	req->on_done = on_done;
+	req->ctx = ctx;
+	return req;
+}
+
+static void async_enqueue(ASYNC * as, ASYNC_REQUEST * req, ASYNC_REQUEST ** reqp)
+{
+	req->next = as->requests;
+	as->requests = req;
+	if (reqp)
+		*reqp = req;
+}
+
+static void async_complete(ASYNC * as, ASYNC_REQUEST * req, int result)
+{
+	for (ASYNC_REQUEST ** cur = &as->requests; *cur; cur = &(*cur)->next)
+	{
+		if (*cur == req)
+		{
+			*cur = req->next;
+			break;
+		}
+	}
+
+	if (req->done)
+		*req->done = true;
+	if (req->result)
+		*req->result = result;
+	if (req->on_done)
+		req->on_done(as->ld, result, req->ctx);
+
+	async_request_free(req);
+}
+
+static int async_send_search(ASYNC * as, ASYNC_REQUEST * req, LDAPControl ** server_controls)
+{
+	LDAPControl *page_control = NULL;
+	LDAPControl *controls[] = { NULL, NULL };
+	if (req->page_size > 0)
+	{
+		int rc = ldap_create_page_control(as->ld, req->page_size, &req->cookie, 0,
+						  &page_control);
+		if (rc != LDAP_SUCCESS)
+			return rc;
+		controls[0] = page_control;
+		server_controls = controls;
+	}
+
+	int rc = ldap_search_ext(as->ld, req->base, req->scope, req->filter, req->attrs, 0,
+				 server_controls, NULL, NULL, LDAP_NO_LIMIT, &req->msgid);
+	if (page_control)
+		ldap_control_free(page_control);
+
+	return rc;
+}
+
+static ASYNC_REQUEST *async_search_alloc(const char *base, int scope, const char *filter,
+					 char **attrs, ASYNC_ENTRY_CALLBACK on_entry,
+					 ASYNC_DONE_CALLBACK on_done, void *ctx)
+{
+	ASYNC_REQUEST *req = async_request_alloc(on_done, ctx);
+	req->is_search = true;
+	req->base = strdup(base);
+	req->scope = scope;
+	req->filter = strdup(filter);
+	req->attrs = string_array_dup(attrs);
+	req->on_entry = on_entry;
+	return req;
+}
+
+int async_search(ASYNC * as, const char *base, int scope, const char *filter, char **attrs,
+		 int page_size, ASYNC_ENTRY_CALLBACK on_entry, ASYNC_DONE_CALLBACK on_done,
+		 void *ctx, ASYNC_REQUEST ** reqp)
+{
+	ASYNC_REQUEST *req = async_search_alloc(base, scope, filter, attrs, on_entry, on_done, ctx);
+	req->page_size = page_size;
+
+	int rc = async_send_search(as, req, NULL);
+	if (rc != LDAP_SUCCESS)
+	{
+		async_request_free(req);
+		return rc;
+	}
+
+	async_enqueue(as, req, reqp);
+	return LDAP_SUCCESS;
+}
+
+int async_search_ext(ASYNC * as, const char *base, int scope, const char *filter,
+		     char **attrs, LDAPControl ** controls, ASYNC_ENTRY_CALLBACK on_entry,
+		     ASYNC_RESULT_CALLBACK on_result, ASYNC_DONE_CALLBACK on_done, void *ctx,
+		     ASYNC_REQUEST ** reqp)
+{
+	ASYNC_REQUEST *req = async_search_alloc(base, scope, filter, attrs, on_entry, on_done, ctx);
+	req->on_result = on_result;
+
+	int rc = async_send_search(as, req, controls);
+	if (rc != LDAP_SUCCESS)
+	{
+		async_request_free(req);
+		return rc;
+	}
+
+	async_enqueue(as, req, reqp);
+	return LDAP_SUCCESS;
+}
+
+int async_search_persistent(ASYNC * as, const char *base, int scope, const char *filter,
+			    char **attrs, LDAPControl ** controls,
+			    ASYNC_ENTRY_CALLBACK on_entry, ASYNC_DONE_CALLBACK on_done,
+			    void *ctx, ASYNC_REQUEST ** reqp)
+{
+	ASYNC_REQUEST *req = async_search_alloc(base, scope, filter, attrs, on_entry, on_done, ctx);
+	req->persistent = true;
+
+	int rc = async_send_search(as, req, controls);
+	if (rc != LDAP_SUCCESS)
+	{
+		async_request_free(req);
+		return rc;
+	}
+
+	async_enqueue(as, req, reqp);
+	return LDAP_SUCCESS;
+}
+
+int async_delete(ASYNC * as, const char *dn, LDAPControl ** controls,
+		 ASYNC_DONE_CALLBACK on_done, void *ctx, ASYNC_REQUEST ** reqp)
+{
+	ASYNC_REQUEST *req = async_request_alloc(on_done, ctx);
+
+	int rc = ldap_delete_ext(as->ld, dn, controls, NULL, &req->msgid);
+	if (rc != LDAP_SUCCESS)
+	{
+		async_request_free(req);
+		return rc;
+	}
+
+	async_enqueue(as, req, reqp);
+	return LDAP_SUCCESS;
+}
+
+int async_add(ASYNC * as, const char *dn, LDAPMod ** mods, ASYNC_DONE_CALLBACK on_done,
+	      void *ctx, ASYNC_REQUEST ** reqp)
+{
+	ASYNC_REQUEST *req = async_request_alloc(on_done, ctx);
+
+	int rc = ldap_add_ext(as->ld, dn, mods, NULL, NULL, &req->msgid);
+	if (rc != LDAP_SUCCESS)
+	{
+		async_request_free(req);
+		return rc;
+	}
+
+	async_enqueue(as, req, reqp);
+	return LDAP_SUCCESS;
+}
+
+void async_abandon(ASYNC * as, ASYNC_REQUEST * req)
+{
+	ldap_abandon_ext(as->ld, req->msgid, NULL, NULL);
+	async_complete(as, req, LDAP_USER_CANCELLED);
+}
+
+void async_watch(ASYNC_REQUEST * req, bool *done, int *result)
+{
+	req->done = done;
+	req->result = result;
+}
+
+static ASYNC_REQUEST *async_find(ASYNC * as, int msgid)
+{
+	for (ASYNC_REQUEST * req = as->requests; req; req = req->next)
+	{
+		if (req->msgid == msgid)
+			return req;
+	}
+	return NULL;
+}
+
+/**
+ * Handles the final message of an operation. Searches with more pages
+ * continue with the cookie of the response control.
+ **/
+static void async_handle_result(ASYNC * as, ASYNC_REQUEST * req, LDAPMessage * msg)
+{
+	int result;
+	LDAPControl **response_controls = NULL;
+	int rc = ldap_parse_result(as->ld, msg, &result, NULL, NULL, NULL, &response_controls, 1);
+	if (rc == LDAP_SUCCESS)
+		rc = result;
+
+	ber_memfree(req->cookie.bv_val);
+	req->cookie.bv_val = NULL;
+	req->cookie.bv_len = 0;
+
+	LDAPControl *response =
+	    ldap_control_find(LDAP_CONTROL_PAGEDRESULTS, response_controls, NULL);
+	if (rc == LDAP_SUCCESS && req->is_search && response)
+	{
+		ber_int_t estimate;
+		ldap_parse_pageresponse_control(as->ld, response, &estimate, &req->cookie);
+	}
+	if (req->on_result)
+		req->on_result(as->ld, response_controls, req->ctx);
+	ldap_controls_free(response_controls);
+	response_controls = NULL;
+
+	if (req->cookie.bv_len > 0)
+	{
+		rc = async_send_search(as, req, NULL);
+		if (rc == LDAP_SUCCESS)
+			return;
+	}
+
+	async_complete(as, req, rc);
+}
+
+static void async_dispatch(ASYNC * as, LDAPMessage * msg)
+{
+	ASYNC_REQUEST *req = async_find(as, ldap_msgid(msg));
+	if (!req)
+	{
+		// late answer to an abandoned request
+		ldap_msgfree(msg);
+		return;
+	}
+
+	switch (ldap_msgtype(msg))
+	{
+	case LDAP_RES_SEARCH_ENTRY:
+		if (req->on_entry)
+			req->on_entry(as->ld, msg, req->ctx);
+		ldap_msgfree(msg);
+		break;
+
+	case LDAP_RES_INTERMEDIATE:
+		if (req->persistent && req->on_entry)
+			req->on_entry(as->ld, msg, req->ctx);
+		ldap_msgfree(msg);
+		break;
+
+	case LDAP_RES_SEARCH_REFERENCE:
+		ldap_msgfree(msg);
+		break;
+
+	default:
+		async_handle_result(as, req, msg);
+		break;
+	}
+}
+
+int async_process(ASYNC * as, int timeout_ms)
+{
+	int processed = 0;
+	struct timeval timeout = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+	struct timeval *timeoutp = timeout_ms < 0 ? NULL : &timeout;
+
+	LDAPMessage *msg;
+	while (as->requests)
+	{
+		int type = ldap_result(as->ld, LDAP_RES_ANY, LDAP_MSG_ONE, timeoutp, &msg);
+		if (type == 0)
+			break;
+
+		if (type < 0)
+		{
+			// connection failed, nothing outstanding will ever complete
+			int rc = LDAP_SERVER_DOWN;
+			ldap_get_option(as->ld, LDAP_OPT_RESULT_CODE, &rc);
+			while (as->requests)
+				async_complete(as, as->requests, rc);
+			break;
+		}
+
+		async_dispatch(as, msg);
+		processed++;
+
+		// only drain what is already there
+		timeout.tv_sec = timeout.tv_usec = 0;
+		timeoutp = &timeout;
+	}
+
+	return processed;
+}
+
+int async_wait(ASYNC * as, ASYNC_REQUEST * req)
+{
+	bool done = false;
+	int result = LDAP_SUCCESS;
+	async_watch(req, &done, &result);
+
+	while (!done)
+		async_process(as, -1);
+
+	return result;
+}
+
+bool async_busy(ASYNC * as)
+{
+	for (ASYNC_REQUEST * req = as->requests; req; req = req->next)
+	{
+		if (!req->persistent)
+			return true;
+	}
+	return false;
+}
+
+bool async_pending(ASYNC * as)
+{
+	return as->requests != NULL;
+}
+
+int async_fd(ASYNC * as)
+{
+	int fd = -1;
+	if (ldap_get_option(as->ld, LDAP_OPT_DESC, &fd) != LDAP_OPT_SUCCESS)
+		return -1;
+	return fd;
+}
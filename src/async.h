@@ -0,0 +1,122 @@
+#pragma once
+#include <stdbool.h>
+#include <ldap.h>
+
+typedef void (*ASYNC_ENTRY_CALLBACK) (LDAP * ld, LDAPMessage * entry, void *ctx);
+typedef void (*ASYNC_DONE_CALLBACK) (LDAP * ld, int result, void *ctx);
+typedef void (*ASYNC_RESULT_CALLBACK) (LDAP * ld, LDAPControl ** controls, void *ctx);
+
+typedef struct ASYNC_REQUEST_S {
+	int msgid;
+	bool is_search;
+	bool persistent;	// stays open on the server, see async_search_persistent()
+	char *base;
+	int scope;
+	char *filter;
+	char **attrs;
+	int page_size;
+	struct berval cookie;
+	ASYNC_ENTRY_CALLBACK on_entry;
+	ASYNC_DONE_CALLBACK on_done;
+	ASYNC_RESULT_CALLBACK on_result;
+	void *ctx;
+	bool *done;
+	int *result;
+	struct ASYNC_REQUEST_S *next;
+} ASYNC_REQUEST;
+
+typedef struct ASYNC_S {
+	LDAP *ld;
+	ASYNC_REQUEST *requests;
+} ASYNC;
+
+ASYNC *async_init(LDAP * ld);
+
+/**
+ * Abandons all outstanding requests and frees the engine.
+ * The connection itself is left open.
+ **/
+void async_free(ASYNC * as);
+
+/**
+ * Starts a search, paged with the simple paged results control unless
+ * page_size is 0. on_entry is called for every entry as it arrives,
+ * on_done exactly once when the last page is complete, failed or was
+ * abandoned (result LDAP_USER_CANCELLED).
+ * Returns the LDAP error code of sending the first page.
+ **/
+int async_search(ASYNC * as, const char *base, int scope, const char *filter, char **attrs,
+		 int page_size, ASYNC_ENTRY_CALLBACK on_entry, ASYNC_DONE_CALLBACK on_done,
+		 void *ctx, ASYNC_REQUEST ** reqp);
+
+/**
+ * Starts an unpaged search with the given server controls. on_result
+ * receives the controls of the final result, before on_done.
+ **/
+int async_search_ext(ASYNC * as, const char *base, int scope, const char *filter,
+		     char **attrs, LDAPControl ** controls, ASYNC_ENTRY_CALLBACK on_entry,
+		     ASYNC_RESULT_CALLBACK on_result, ASYNC_DONE_CALLBACK on_done, void *ctx,
+		     ASYNC_REQUEST ** reqp);
+
+/**
+ * Starts a search that stays open on the server to report changes, like
+ * a content synchronization in refreshAndPersist mode. on_entry receives
+ * the intermediate responses as well as the entries. Such searches do not
+ * count as busy.
+ **/
+int async_search_persistent(ASYNC * as, const char *base, int scope, const char *filter,
+			    char **attrs, LDAPControl ** controls,
+			    ASYNC_ENTRY_CALLBACK on_entry, ASYNC_DONE_CALLBACK on_done,
+			    void *ctx, ASYNC_REQUEST ** reqp);
+
+/**
+ * Deletes dn, with the given server controls (may be NULL).
+ **/
+int async_delete(ASYNC * as, const char *dn, LDAPControl ** controls,
+		 ASYNC_DONE_CALLBACK on_done, void *ctx, ASYNC_REQUEST ** reqp);
+
+/**
+ * Adds the entry dn with the attributes in mods, which are encoded before
+ * async_add() returns and may be freed then.
+ **/
+int async_add(ASYNC * as, const char *dn, LDAPMod ** mods, ASYNC_DONE_CALLBACK on_done,
+	      void *ctx, ASYNC_REQUEST ** reqp);
+
+/**
+ * Abandons req on the server and completes it with LDAP_USER_CANCELLED.
+ * Must not be called from a callback of req itself.
+ **/
+void async_abandon(ASYNC * as, ASYNC_REQUEST * req);
+
+/**
+ * Sets done to true and result to the result code once req completes.
+ **/
+void async_watch(ASYNC_REQUEST * req, bool *done, int *result);
+
+/**
+ * Waits up to timeout_ms (-1 blocks) for the first message, then
+ * dispatches it and whatever else is already queued without waiting
+ * again. Returns at once if no request is outstanding. Returns the number
+ * of messages dispatched.
+ **/
+int async_process(ASYNC * as, int timeout_ms);
+
+/**
+ * Blocks until req completes and returns its result code.
+ **/
+int async_wait(ASYNC * as, ASYNC_REQUEST * req);
+
+/**
+ * Returns true while requests other than persistent searches are pending.
+ **/
+bool async_busy(ASYNC * as);
+
+/**
+ * Returns true while any request is pending, persistent searches included.
+ **/
+bool async_pending(ASYNC * as);
+
+/**
+ * Returns the socket of the connection, to be polled for readability, or -1.
+ **/
+int async_fd(ASYNC * as);
@@ -0,0 +1,158 @@
+#include "base64.h"
+
+#include <stdint.h>
+
+static const char alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// the two characters for every 12 bit group, so each lookup yields half of a quantum
+#define B64_ROW(c) \
+	c "A" c "B" c "C" c "D" c "E" c "F" c "G" c "H" c "I" c "J" c "K" c "L" c "M" c "N" \
+	c "O" c "P" c "Q" c "R" c "S" c "T" c "U" c "V" c "W" c "X" c "Y" c "Z" c "a" c "b" \
+	c "c" c "d" c "e" c "f" c "g" c "h" c "i" c "j" c "k" c "l" c "m" c "n" c "o" c "p" \
+	c "q" c "r" c "s" c "t" c "u" c "v" c "w" c "x" c "y" c "z" c "0" c "1" c "2" c "3" \
+	c "4" c "5" c "6" c "7" c "8" c "9" c "+" c "/"
+
+static const char pairs[] =
+	B64_ROW("A") B64_ROW("B") B64_ROW("C") B64_ROW("D") B64_ROW("E") B64_ROW("F")
+	B64_ROW("G") B64_ROW("H") B64_ROW("I") B64_ROW("J") B64_ROW("K") B64_ROW("L")
+	B64_ROW("M") B64_ROW("N") B64_ROW("O") B64_ROW("P") B64_ROW("Q") B64_ROW("R")
+	B64_ROW("S") B64_ROW("T") B64_ROW("U") B64_ROW("V") B64_ROW("W") B64_ROW("X")
+	B64_ROW("Y") B64_ROW("Z") B64_ROW("a") B64_ROW("b") B64_ROW("c") B64_ROW("d")
+	B64_ROW("e") B64_ROW("f") B64_ROW("g") B64_ROW("h") B64_ROW("i") B64_ROW("j")
+	B64_ROW("k") B64_ROW("l") B64_ROW("m") B64_ROW("n") B64_ROW("o") B64_ROW("p")
+	B64_ROW("q") B64_ROW("r") B64_ROW("s") B64_ROW("t") B64_ROW("u") B64_ROW("v")
+	B64_ROW("w") B64_ROW("x") B64_ROW("y") B64_ROW("z") B64_ROW("0") B64_ROW("1")
+	B64_ROW("2") B64_ROW("3") B64_ROW("4") B64_ROW("5") B64_ROW("6") B64_ROW("7")
+	B64_ROW("8") B64_ROW("9") B64_ROW("+") B64_ROW("/");
+
+size_t base64_encoded_size(size_t len)
+{
+	return (len + 2) / 3 * 4;
+}
+
+size_t base64_encode(const unsigned char *data, size_t len, char *out)
+{
+	char *start = out;
+
+	// 6 input bytes per step, as one 48 bit big endian word; the characters
+	// are copied one by one rather than with memcpy(), which unoptimized
+	// builds like the default one turn into calls
+	while (len >= 6)
+	{
+		uint64_t word = (uint64_t) data[0] << 40 | (uint64_t) data[1] << 32
+		    | (uint64_t) data[2] << 24 | (uint64_t) data[3] << 16
+		    | (uint64_t) data[4] << 8 | (uint64_t) data[5];
+		const char *a = pairs + 2 * (word >> 36), *b = pairs + 2 * ((word >> 24) & 0xfff);
+		const char *c = pairs + 2 * ((word >> 12) & 0xfff), *d = pairs + 2 * (word & 0xfff);
+
+		out[0] = a[0];
+		out[1] = a[1];
+		out[2] = b[0];
+		out[3] = b[1];
+		out[4] = c[0];
+		out[5] = c[1];
+		out[6] = d[0];
+		out[7] = d[1];
+
+		data += 6;
+		len -= 6;
+		out += 8;
+	}
+
+	if (len >= 3)
+	{
+		const char *a = pairs + 2 * (data[0] << 4 | data[1] >> 4);
+		const char *b = pairs + 2 * ((data[1] & 0xf) << 8 | data[2]);
+		out[0] = a[0];
+		out[1] = a[1];
+		out[2] = b[0];
+		out[3] = b[1];
+
+		data += 3;
+		len -= 3;
+		out += 4;
+	}
+
+	if (len > 0)
+	{
+		unsigned group = data[0] << 16 | (len > 1 ? data[1] << 8 : 0);
+		out[0] = alphabet[group >> 18];
+		out[1] = alphabet[(group >> 12) & 0x3f];
+		out[2] = len > 1 ? alphabet[(group >> 6) & 0x3f] : '=';
+		out[3] = '=';
+		out += 4;
+	}
+
+	return out - start;
+}
+
+// the value of every base64 character, -1 for all others
+static const signed char values[256] = {
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+	52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+	-1, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14,
+	15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+	-1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+	41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+size_t base64_decoded_size(size_t len)
+{
+	return (len + 3) / 4 * 3;
+}
+
+size_t base64_decode(const char *in, size_t len, unsigned char *out)
+{
+	const unsigned char *s = (const unsigned char *)in;
+	unsigned char *start = out;
+
+	if (len % 4 == 0)
+	{
+		for (unsigned i = 0; i < 2 && len > 0 && s[len - 1] == '='; i++)
+			len--;
+	}
+
+	while (len >= 4)
+	{
+		int a = values[s[0]], b = values[s[1]], c = values[s[2]], d = values[s[3]];
+		// any invalid character makes the or negative
+		if ((a | b | c | d) < 0)
+			return (size_t) - 1;
+
+		uint32_t group = a << 18 | b << 12 | c << 6 | d;
+		out[0] = group >> 16;
+		out[1] = group >> 8;
+		out[2] = group;
+		s += 4;
+		len -= 4;
+		out += 3;
+	}
+
+	if (len == 1)
+		return (size_t) - 1;
+	if (len > 0)
+	{
+		int a = values[s[0]], b = values[s[1]], c = len > 2 ? values[s[2]] : 0;
+		if ((a | b | c) < 0)
+			return (size_t) - 1;
+
+		uint32_t group = a << 18 | b << 12 | c << 6;
+
+		*out++ = group >> 16;
+		if (len > 2)
+			*out++ = group >> 8;
+	}
+
+	return out - start;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <stddef.h>
+
+/**
+ * Returns the length of the base64 encoding of len bytes.
+ **/
+size_t base64_encoded_size(size_t len);
+
+/**
+ * Encodes len bytes of data (RFC 4648, with padding) into out, which must
+ * hold base64_encoded_size(len) characters. out is not NUL terminated.
+ * Returns the number of characters written.
+ **/
+size_t base64_encode(const unsigned char *data, size_t len, char *out);
+
+/**
+ * Returns the most bytes len base64 characters decode to.
+ **/
+size_t base64_decoded_size(size_t len);
+
+/**
+ * Decodes len base64 characters (RFC 4648, padding optional) into out,
+ * which must hold base64_decoded_size(len) bytes. Returns the number of
+ * bytes written, (size_t) -1 if in is not valid base64.
+ **/
+size_t base64_decode(const char *in, size_t len, unsigned char *out);
@@ -0,0 +1,28 @@
+#include "connection.h"
+
+int connection_open(const CONNECTION_PARAMS * params, LDAP ** ldp)
+{
+	LDAP *ld = NULL;
+	int rc = ldap_initialize(&ld, params->uri);
+	if (rc != LDAP_SUCCESS)
+		return rc;
+
+	int version = LDAP_VERSION3;
+	if (ldap_set_option(ld, LDAP_OPT_PROTOCOL_VERSION, &version) != LDAP_OPT_SUCCESS
+	    || ldap_set_option(ld, LDAP_OPT_DEREF, &params->deref) != LDAP_OPT_SUCCESS)
+	{
+		ldap_unbind_ext(ld, NULL, NULL);
+		return LDAP_LOCAL_ERROR;
+	}
+
+	struct berval passwd = params->passwd;
+	rc = ldap_sasl_bind_s(ld, params->bind_dn, LDAP_SASL_SIMPLE, &passwd, NULL, NULL, NULL);
+	if (rc != LDAP_SUCCESS)
+	{
+		ldap_unbind_ext(ld, NULL, NULL);
+		return rc;
+	}
+
+	*ldp = ld;
+	return LDAP_SUCCESS;
+}
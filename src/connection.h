@@ -0,0 +1,18 @@
+#pragma once
+#include <ldap.h>
+
+/**
+ * Everything needed to open another connection like the one from main().
+ **/
+typedef struct CONNECTION_PARAMS_S {
+	char *uri;
+	char *bind_dn;
+	struct berval passwd;
+	int deref;
+} CONNECTION_PARAMS;
+
+/**
+ * Opens an LDAPv3 connection and binds with params. On success *ldp holds
+ * the connection, otherwise the LDAP error code is returned.
+ **/
+int connection_open(const CONNECTION_PARAMS * params, LDAP ** ldp);
@@ -0,0 +1,312 @@
+#include "deleter.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static char *root_dse_attributes[] = { "supportedControl", NULL };
+static char *no_attributes[] = { LDAP_NO_ATTRS, NULL };
+
+typedef struct DELETE_OP_S {
+	DELETER *deleter;
+	char *dn;
+	WORKER_REQUEST *req;
+	struct DELETE_OP_S *prev, *next;
+} DELETE_OP;
+
+/**
+ * The DNs listed at one depth below the base, deleted in listing order.
+ **/
+typedef struct DELETE_LEVEL_S {
+	char **dns;		// NULL once handed to a delete
+	unsigned count, capacity;
+} DELETE_LEVEL;
+
+struct DELETER_S {
+	WORKER *worker;
+	char *dn;
+	unsigned window;
+	int page_size;
+	DELETER_DELETED_CALLBACK on_deleted;
+	void *ctx;
+
+	DELETER_PHASE phase;
+	bool tree_delete;	// the root DSE lists the control
+	WORKER_REQUEST *req;	// of the probe, the tree delete or the listing
+	unsigned base_depth;
+	DELETE_LEVEL *levels;
+	unsigned num_levels;
+	unsigned level, next;	// the level being deleted and its next DN
+	DELETE_OP *running;
+	unsigned num_running;
+	unsigned long found, deleted;
+	struct timespec start;
+	int result;
+	char *failed_dn;
+};
+
+/**
+ * Counts the RDNs of dn by its unescaped commas.
+ **/
+static unsigned dn_depth(const char *dn)
+{
+	unsigned depth = *dn ? 1 : 0;
+	for (const char *c = dn; *c; c++)
+	{
+		if (*c == '\\' && c[1])
+			c++;
+		else if (*c == ',')
+			depth++;
+	}
+	return depth;
+}
+
+static void deleter_fail(DELETER * d, int result, const char *dn)
+{
+	if (d->result != LDAP_SUCCESS)
+		return;
+	d->result = result;
+	d->failed_dn = strdup(dn);
+}
+
+static void deleter_pump(DELETER * d);
+
+static void delete_done(int result, void *ctx)
+{
+	DELETE_OP *op = ctx;
+	DELETER *d = op->deleter;
+
+	if (op->prev)
+		op->prev->next = op->next;
+	else
+		d->running = op->next;
+	if (op->next)
+		op->next->prev = op->prev;
+	d->num_running--;
+
+	// gone already, e.g. deleted by someone else meanwhile
+	if (result == LDAP_SUCCESS || result == LDAP_NO_SUCH_OBJECT)
+	{
+		d->deleted++;
+		if (d->on_deleted)
+			d->on_deleted(op->dn, d->ctx);
+	} else if (result != LDAP_USER_CANCELLED)
+		deleter_fail(d, result, op->dn);
+
+	free(op->dn);
+	free(op);
+	if (result != LDAP_USER_CANCELLED)
+		deleter_pump(d);
+}
+
+/**
+ * Keeps window deletes in flight. A level is started only once the one
+ * below it is gone completely, so no entry is deleted before its children.
+ * After an error the running deletes are waited for, no new ones start.
+ **/
+static void deleter_pump(DELETER * d)
+{
+	while (d->result == LDAP_SUCCESS && d->num_running < d->window)
+	{
+		DELETE_LEVEL *level = &d->levels[d->level];
+		if (d->next == level->count)
+		{
+			if (d->num_running > 0 || d->level == 0)
+				break;
+			d->level--;
+			d->next = 0;
+			continue;
+		}
+
+		DELETE_OP *op = calloc(1, sizeof(DELETE_OP));
+		op->deleter = d;
+		op->dn = level->dns[d->next];
+		level->dns[d->next++] = NULL;
+
+		op->next = d->running;
+		if (d->running)
+			d->running->prev = op;
+		d->running = op;
+		d->num_running++;
+
+		worker_delete(d->worker, op->dn, NULL, delete_done, op, &op->req);
+	}
+
+	if (d->num_running == 0)
+		d->phase = DELETER_FINISHED;
+}
+
+static void list_entry(WORKER_ENTRY * e, void *ctx)
+{
+	DELETER *d = ctx;
+	if (!e->entry)
+		return;
+
+	unsigned depth = dn_depth(e->entry->dn);
+	depth = depth > d->base_depth ? depth - d->base_depth : 0;
+	if (depth >= d->num_levels)
+	{
+		d->levels = realloc(d->levels, (depth + 1) * sizeof(DELETE_LEVEL));
+		memset(d->levels + d->num_levels, 0,
+		       (depth + 1 - d->num_levels) * sizeof(DELETE_LEVEL));
+		d->num_levels = depth + 1;
+	}
+
+	DELETE_LEVEL *level = &d->levels[depth];
+	if (level->count == level->capacity)
+	{
+		level->capacity = level->capacity ? 2 * level->capacity : 64;
+		level->dns = realloc(level->dns, level->capacity * sizeof(char *));
+	}
+	level->dns[level->count++] = strdup(e->entry->dn);
+	d->found++;
+}
+
+static void list_done(int result, void *ctx)
+{
+	DELETER *d = ctx;
+	d->req = NULL;
+	if (result == LDAP_USER_CANCELLED)
+		return;
+
+	if (result == LDAP_SUCCESS && d->found == 0)
+		result = LDAP_NO_SUCH_OBJECT;
+	if (result != LDAP_SUCCESS)
+	{
+		deleter_fail(d, result, d->dn);
+		d->phase = DELETER_FINISHED;
+		return;
+	}
+
+	d->phase = DELETER_DELETING;
+	clock_gettime(CLOCK_MONOTONIC, &d->start);
+	d->level = d->num_levels - 1;
+	d->next = 0;
+	deleter_pump(d);
+}
+
+static void deleter_list(DELETER * d)
+{
+	d->phase = DELETER_LISTING;
+	worker_search(d->worker, d->dn, LDAP_SCOPE_SUB, "(objectClass=*)", no_attributes,
+		      d->page_size, list_entry, list_done, d, &d->req);
+}
+
+static void tree_delete_done(int result, void *ctx)
+{
+	DELETER *d = ctx;
+	d->req = NULL;
+	if (result == LDAP_USER_CANCELLED)
+		return;
+
+	// advertised, but not for us or not for this subtree
+	if (result == LDAP_UNAVAILABLE_CRITICAL_EXTENSION || result == LDAP_UNWILLING_TO_PERFORM)
+	{
+		deleter_list(d);
+		return;
+	}
+
+	if (result == LDAP_SUCCESS)
+	{
+		d->deleted++;
+		if (d->on_deleted)
+			d->on_deleted(d->dn, d->ctx);
+	} else
+		deleter_fail(d, result, d->dn);
+	d->phase = DELETER_FINISHED;
+}
+
+static void probe_entry(WORKER_ENTRY * e, void *ctx)
+{
+	DELETER *d = ctx;
+	ENTRY_ATTRIBUTE *attr = e->entry ? entry_get_attribute(e->entry, "supportedControl") : NULL;
+	for (unsigned i = 0; attr && i < attr->num_values; i++)
+		if (strcmp(attr->values[i].data, LDAP_CONTROL_X_TREE_DELETE) == 0)
+			d->tree_delete = true;
+}
+
+static void probe_done(int result, void *ctx)
+{
+	DELETER *d = ctx;
+	d->req = NULL;
+	if (result == LDAP_USER_CANCELLED)
+		return;
+
+	// a root DSE we may not read just means deleting entry by entry
+	if (!d->tree_delete)
+	{
+		deleter_list(d);
+		return;
+	}
+
+	LDAPControl control = { LDAP_CONTROL_X_TREE_DELETE, {0, NULL}, 1 };
+	LDAPControl *controls[] = { &control, NULL };
+	d->phase = DELETER_TREE_DELETE;
+	clock_gettime(CLOCK_MONOTONIC, &d->start);
+	worker_delete(d->worker, d->dn, controls, tree_delete_done, d, &d->req);
+}
+
+DELETER *deleter_start(WORKER * w, const char *dn, unsigned window, int page_size,
+		       DELETER_DELETED_CALLBACK on_deleted, void *ctx)
+{
+	DELETER *d = calloc(1, sizeof(DELETER));
+	d->worker = w;
+	d->dn = strdup(dn);
+	d->window = window > 0 ? window : 1;
+	d->page_size = page_size;
+	d->on_deleted = on_deleted;
+	d->ctx = ctx;
+	d->base_depth = dn_depth(dn);
+	d->result = LDAP_SUCCESS;
+
+	d->phase = DELETER_PROBING;
+	worker_search(w, "", LDAP_SCOPE_BASE, "(objectClass=*)", root_dse_attributes, 0,
+		      probe_entry, probe_done, d, &d->req);
+	return d;
+}
+
+void deleter_free(DELETER * d)
+{
+	if (d->req)
+		worker_abandon(d->worker, d->req);
+	while (d->running)
+		worker_abandon(d->worker, d->running->req);
+
+	for (unsigned i = 0; i < d->num_levels; i++)
+	{
+		for (unsigned j = 0; j < d->levels[i].count; j++)
+			free(d->levels[i].dns[j]);
+		free(d->levels[i].dns);
+	}
+	free(d->levels);
+	free(d->failed_dn);
+	free(d->dn);
+	free(d);
+}
+
+void deleter_progress(DELETER * d, DELETER_PROGRESS * progress)
+{
+	progress->phase = d->phase;
+	progress->found = d->found;
+	progress->deleted = d->deleted;
+	progress->seconds = 0;
+	if (d->phase == DELETER_TREE_DELETE || d->phase == DELETER_DELETING)
+	{
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		progress->seconds = (now.tv_sec - d->start.tv_sec)
+		    + (now.tv_nsec - d->start.tv_nsec) / 1e9;
+	}
+}
+
+bool deleter_finished(DELETER * d)
+{
+	return d->phase == DELETER_FINISHED;
+}
+
+int deleter_result(DELETER * d, const char **failed_dn)
+{
+	if (failed_dn)
+		*failed_dn = d->failed_dn;
+	return d->result;
+}
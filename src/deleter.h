@@ -0,0 +1,52 @@
+#pragma once
+#include <stdbool.h>
+#include "worker.h"
+
+/**
+ * Deletes a subtree through the worker connection. Servers advertising the
+ * Tree Delete control in the root DSE remove it in one operation. Others
+ * get the DNs of the subtree listed without attributes and deleted deepest
+ * level first, with up to a fixed number of deletes in flight.
+ **/
+
+typedef struct DELETER_S DELETER;
+
+typedef enum {
+	DELETER_PROBING,	// reading the supported controls of the root DSE
+	DELETER_TREE_DELETE,	// one delete with the Tree Delete control
+	DELETER_LISTING,
+	DELETER_DELETING,
+	DELETER_FINISHED
+} DELETER_PHASE;
+
+typedef struct DELETER_PROGRESS_S {
+	DELETER_PHASE phase;
+	unsigned long found;	// entries listed
+	unsigned long deleted;
+	double seconds;		// since the deletes began
+} DELETER_PROGRESS;
+
+/**
+ * Called for every entry deleted; with the Tree Delete control only for
+ * the base of the subtree.
+ **/
+typedef void (*DELETER_DELETED_CALLBACK) (const char *dn, void *ctx);
+
+DELETER *deleter_start(WORKER * w, const char *dn, unsigned window, int page_size,
+		       DELETER_DELETED_CALLBACK on_deleted, void *ctx);
+
+/**
+ * Abandons the running operations and frees the deleter. Entries already
+ * deleted stay deleted.
+ **/
+void deleter_free(DELETER * d);
+
+void deleter_progress(DELETER * d, DELETER_PROGRESS * progress);
+
+bool deleter_finished(DELETER * d);
+
+/**
+ * Returns the first error once finished, LDAP_SUCCESS if there was none,
+ * and the DN it occurred on.
+ **/
+int deleter_result(DELETER * d, const char **failed_dn);
@@ -0,0 +1,74 @@
+#include "entry.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+ENTRY *entry_alloc(const char *dn)
+{
+	ENTRY *e = calloc(1, sizeof(ENTRY));
+	e->dn = strdup(dn);
+	e->size = sizeof(ENTRY) + strlen(dn) + 1;
+	return e;
+}
+
+void entry_free(ENTRY * e)
+{
+	for (unsigned i = 0; i < e->num_attributes; i++)
+	{
+		ENTRY_ATTRIBUTE *a = &e->attributes[i];
+		for (unsigned j = 0; j < a->num_values; j++)
+			free(a->values[j].data);
+		free(a->values);
+		free(a->name);
+	}
+	free(e->attributes);
+	free(e->dn);
+	free(e);
+}
+
+void entry_add_attribute(ENTRY * e, const char *name)
+{
+	e->attributes = realloc(e->attributes, (e->num_attributes + 1) * sizeof(ENTRY_ATTRIBUTE));
+	ENTRY_ATTRIBUTE *a = &e->attributes[e->num_attributes++];
+	a->name = strdup(name);
+	a->num_values = 0;
+	a->values = NULL;
+	e->size += sizeof(ENTRY_ATTRIBUTE) + strlen(name) + 1;
+}
+
+void entry_add_value(ENTRY * e, const char *data, size_t len)
+{
+	ENTRY_ATTRIBUTE *a = &e->attributes[e->num_attributes - 1];
+	a->values = realloc(a->values, (a->num_values + 1) * sizeof(ENTRY_VALUE));
+	ENTRY_VALUE *v = &a->values[a->num_values++];
+	v->data = malloc(len + 1);
+	memcpy(v->data, data, len);
+	v->data[len] = 0;
+	v->len = len;
+	e->size += sizeof(ENTRY_VALUE) + len + 1;
+}
+
+ENTRY_ATTRIBUTE *entry_get_attribute(ENTRY * e, const char *name)
+{
+	for (unsigned i = 0; i < e->num_attributes; i++)
+	{
+		if (strcasecmp(e->attributes[i].name, name) == 0)
+			return &e->attributes[i];
+	}
+	return NULL;
+}
+
+void entry_subordinates(ENTRY * e, bool *is_leaf, unsigned *num_subordinates)
+{
+	ENTRY_ATTRIBUTE *attr;
+
+	if ((attr = entry_get_attribute(e, "numSubordinates")))
+	{
+		const char *value = attr->num_values > 0 ? attr->values[0].data : NULL;
+		*num_subordinates = value ? strtoul(value, NULL, 10) : 0;
+		*is_leaf = value && *num_subordinates == 0;
+	}
+
+	if ((attr = entry_get_attribute(e, "hasSubordinates")))
+		*is_leaf = attr->num_values > 0 && strcasecmp(attr->values[0].data, "FALSE") == 0;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct ENTRY_VALUE_S {
+	char *data;		// NUL terminated, may contain further NULs
+	size_t len;
+} ENTRY_VALUE;
+
+typedef struct ENTRY_ATTRIBUTE_S {
+	char *name;
+	unsigned num_values;
+	ENTRY_VALUE *values;
+} ENTRY_ATTRIBUTE;
+
+/**
+ * A directory entry decoded into plain memory, independent of the
+ * LDAPMessage it came from.
+ **/
+typedef struct ENTRY_S {
+	char *dn;
+	unsigned num_attributes;
+	ENTRY_ATTRIBUTE *attributes;
+	size_t size;		// approximate number of bytes held
+} ENTRY;
+
+ENTRY *entry_alloc(const char *dn);
+
+void entry_free(ENTRY * e);
+
+void entry_add_attribute(ENTRY * e, const char *name);
+
+/**
+ * Appends a value to the attribute added last.
+ **/
+void entry_add_value(ENTRY * e, const char *data, size_t len);
+
+/**
+ * Returns the attribute called name (compared case-insensitively), NULL
+ * if e has none.
+ **/
+ENTRY_ATTRIBUTE *entry_get_attribute(ENTRY * e, const char *name);
+
+/**
+ * Takes leaf status and child count from the hasSubordinates and
+ * numSubordinates attributes, leaving them alone for attributes e lacks.
+ **/
+void entry_subordinates(ENTRY * e, bool *is_leaf, unsigned *num_subordinates);
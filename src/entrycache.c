@@ -0,0 +1,209 @@
+#include "entrycache.h"
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define ENTRY_CACHE_INITIAL_BUCKETS 256
+
+static unsigned dn_hash(const char *dn)
+{
+	unsigned hash = 5381;
+	for (const char *c = dn; *c; c++)
+		hash = hash * 33 + tolower((unsigned char)*c);
+	return hash;
+}
+
+ENTRY_CACHE *entry_cache_init(size_t max_size, unsigned ttl)
+{
+	ENTRY_CACHE *c = calloc(1, sizeof(ENTRY_CACHE));
+	c->max_size = max_size;
+	c->ttl = ttl;
+	c->num_buckets = ENTRY_CACHE_INITIAL_BUCKETS;
+	c->buckets = calloc(c->num_buckets, sizeof(ENTRY_CACHE_ITEM *));
+	return c;
+}
+
+void entry_cache_free(ENTRY_CACHE * c)
+{
+	entry_cache_clear(c);
+	free(c->buckets);
+	free(c);
+}
+
+static ENTRY_CACHE_ITEM **entry_cache_slot(ENTRY_CACHE * c, const char *dn)
+{
+	ENTRY_CACHE_ITEM **slot = &c->buckets[dn_hash(dn) & (c->num_buckets - 1)];
+	while (*slot && strcasecmp((*slot)->key, dn) != 0)
+		slot = &(*slot)->hash_next;
+	return slot;
+}
+
+static void lru_unlink(ENTRY_CACHE * c, ENTRY_CACHE_ITEM * item)
+{
+	if (item->lru_prev)
+		item->lru_prev->lru_next = item->lru_next;
+	else
+		c->lru_head = item->lru_next;
+
+	if (item->lru_next)
+		item->lru_next->lru_prev = item->lru_prev;
+	else
+		c->lru_tail = item->lru_prev;
+
+	item->lru_prev = item->lru_next = NULL;
+}
+
+static void lru_push_front(ENTRY_CACHE * c, ENTRY_CACHE_ITEM * item)
+{
+	item->lru_prev = NULL;
+	item->lru_next = c->lru_head;
+	if (c->lru_head)
+		c->lru_head->lru_prev = item;
+	c->lru_head = item;
+	if (!c->lru_tail)
+		c->lru_tail = item;
+}
+
+static void entry_cache_unlink(ENTRY_CACHE * c, ENTRY_CACHE_ITEM ** slot)
+{
+	ENTRY_CACHE_ITEM *item = *slot;
+	*slot = item->hash_next;
+	lru_unlink(c, item);
+
+	c->size -= item->entry->size;
+	c->count--;
+
+	entry_free(item->entry);
+	free(item->key);
+	free(item);
+}
+
+static void entry_cache_grow(ENTRY_CACHE * c)
+{
+	unsigned num_buckets = c->num_buckets * 2;
+	ENTRY_CACHE_ITEM **buckets = calloc(num_buckets, sizeof(ENTRY_CACHE_ITEM *));
+
+	for (unsigned i = 0; i < c->num_buckets; i++)
+	{
+		ENTRY_CACHE_ITEM *item = c->buckets[i];
+		while (item)
+		{
+			ENTRY_CACHE_ITEM *next = item->hash_next;
+			unsigned bucket = dn_hash(item->key) & (num_buckets - 1);
+			item->hash_next = buckets[bucket];
+			buckets[bucket] = item;
+			item = next;
+		}
+	}
+
+	free(c->buckets);
+	c->buckets = buckets;
+	c->num_buckets = num_buckets;
+}
+
+ENTRY *entry_cache_lookup(ENTRY_CACHE * c, const char *dn, bool *stale)
+{
+	ENTRY_CACHE_ITEM **slot = entry_cache_slot(c, dn);
+	if (!*slot)
+		return NULL;
+
+	if (!(*slot)->stale && c->ttl && time(NULL) - (*slot)->stored > c->ttl)
+	{
+		entry_cache_unlink(c, slot);
+		return NULL;
+	}
+
+	lru_unlink(c, *slot);
+	lru_push_front(c, *slot);
+	*stale = (*slot)->stale;
+	return (*slot)->entry;
+}
+
+ENTRY *entry_cache_get(ENTRY_CACHE * c, const char *dn)
+{
+	bool stale;
+	ENTRY *e = entry_cache_lookup(c, dn, &stale);
+	return e && !stale ? e : NULL;
+}
+
+static ENTRY_CACHE_ITEM *entry_cache_insert(ENTRY_CACHE * c, const char *dn, ENTRY * e)
+{
+	entry_cache_remove(c, dn);
+
+	ENTRY_CACHE_ITEM *item = calloc(1, sizeof(ENTRY_CACHE_ITEM));
+	item->key = strdup(dn);
+	item->entry = e;
+	item->stored = time(NULL);
+
+	if (c->count >= c->num_buckets)
+		entry_cache_grow(c);
+
+	ENTRY_CACHE_ITEM **bucket = &c->buckets[dn_hash(dn) & (c->num_buckets - 1)];
+	item->hash_next = *bucket;
+	*bucket = item;
+	lru_push_front(c, item);
+	c->size += e->size;
+	c->count++;
+
+	// evict least recently used, but always keep the entry just stored
+	while (c->size > c->max_size && c->lru_tail != item)
+		entry_cache_remove(c, c->lru_tail->key);
+	return item;
+}
+
+void entry_cache_put(ENTRY_CACHE * c, const char *dn, ENTRY * e)
+{
+	entry_cache_insert(c, dn, e);
+}
+
+void entry_cache_put_stale(ENTRY_CACHE * c, const char *dn, ENTRY * e)
+{
+	entry_cache_insert(c, dn, e)->stale = true;
+}
+
+void entry_cache_foreach(ENTRY_CACHE * c,
+			 void (*fn) (const char *dn, ENTRY * e, bool stale, void *ctx), void *ctx)
+{
+	for (ENTRY_CACHE_ITEM * item = c->lru_tail; item; item = item->lru_prev)
+		fn(item->key, item->entry, item->stale, ctx);
+}
+
+void entry_cache_remove(ENTRY_CACHE * c, const char *dn)
+{
+	ENTRY_CACHE_ITEM **slot = entry_cache_slot(c, dn);
+	if (*slot)
+		entry_cache_unlink(c, slot);
+}
+
+static bool dn_is_below(const char *dn, const char *base)
+{
+	size_t len = strlen(dn), base_len = strlen(base);
+	if (len == base_len)
+		return strcasecmp(dn, base) == 0;
+
+	return len > base_len && dn[len - base_len - 1] == ','
+	    && strcasecmp(dn + len - base_len, base) == 0;
+}
+
+void entry_cache_remove_subtree(ENTRY_CACHE * c, const char *dn)
+{
+	for (unsigned i = 0; i < c->num_buckets; i++)
+	{
+		ENTRY_CACHE_ITEM **slot = &c->buckets[i];
+		while (*slot)
+		{
+			if (dn_is_below((*slot)->key, dn))
+				entry_cache_unlink(c, slot);
+			else
+				slot = &(*slot)->hash_next;
+		}
+	}
+}
+
+void entry_cache_clear(ENTRY_CACHE * c)
+{
+	while (c->lru_head)
+		entry_cache_remove(c, c->lru_head->key);
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <stdbool.h>
+#include <time.h>
+#include "entry.h"
+
+typedef struct ENTRY_CACHE_ITEM_S {
+	char *key;
+	ENTRY *entry;
+	time_t stored;
+	bool stale;		// restored from a snapshot, not yet confirmed by the server
+	struct ENTRY_CACHE_ITEM_S *hash_next;
+	struct ENTRY_CACHE_ITEM_S *lru_prev, *lru_next;
+} ENTRY_CACHE_ITEM;
+
+/**
+ * Bounded LRU cache of decoded entries keyed by DN (case-insensitive).
+ * Entries are evicted least recently used first once the cached entries
+ * exceed max_size bytes, and are dropped on lookup after ttl seconds
+ * (0 never expires).
+ **/
+typedef struct ENTRY_CACHE_S {
+	size_t max_size;
+	size_t size;
+	unsigned ttl;
+	unsigned count;
+	unsigned num_buckets;
+	ENTRY_CACHE_ITEM **buckets;
+	ENTRY_CACHE_ITEM *lru_head, *lru_tail;	// head is the most recently used
+} ENTRY_CACHE;
+
+ENTRY_CACHE *entry_cache_init(size_t max_size, unsigned ttl);
+
+void entry_cache_free(ENTRY_CACHE * c);
+
+/**
+ * Returns the entry stored under dn and marks it as recently used,
+ * NULL if it is not cached or has expired.
+ * The entry stays owned by the cache.
+ **/
+ENTRY *entry_cache_get(ENTRY_CACHE * c, const char *dn);
+
+/**
+ * Like entry_cache_get(), but also returns stale entries, setting *stale
+ * for them.
+ **/
+ENTRY *entry_cache_lookup(ENTRY_CACHE * c, const char *dn, bool *stale);
+
+/**
+ * Stores e under dn, replacing an older entry. The cache takes ownership.
+ **/
+void entry_cache_put(ENTRY_CACHE * c, const char *dn, ENTRY * e);
+
+/**
+ * Stores e as stale: it is kept regardless of ttl, but only returned by
+ * entry_cache_lookup() until entry_cache_put() replaces it.
+ **/
+void entry_cache_put_stale(ENTRY_CACHE * c, const char *dn, ENTRY * e);
+
+/**
+ * Calls fn for every cached entry, least recently used first.
+ **/
+void entry_cache_foreach(ENTRY_CACHE * c,
+			 void (*fn) (const char *dn, ENTRY * e, bool stale, void *ctx), void *ctx);
+
+void entry_cache_remove(ENTRY_CACHE * c, const char *dn);
+
+/**
+ * Removes dn and every cached entry below it.
+ **/
+void entry_cache_remove_subtree(ENTRY_CACHE * c, const char *dn);
+
+void entry_cache_clear(ENTRY_CACHE * c);
@@ -0,0 +1,292 @@
+#include "expander.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define EXPANDER_INITIAL_BUCKETS 256
+
+static char *child_attributes[] = { "hasSubordinates", "numSubordinates", NULL };
+
+typedef struct LISTED_CHILD_S {
+	char *rdn;
+	bool is_leaf;
+	unsigned num_subordinates;
+} LISTED_CHILD;
+
+typedef struct EXPAND_JOB_S {
+	EXPANDER *expander;
+	char *dn;
+	unsigned levels;	// still to list below dn, at least 1
+	LISTED_CHILD *children;
+	unsigned num_children, children_capacity;
+	WORKER_REQUEST *req;
+	struct EXPAND_JOB_S *prev, *next;	// in the queue, or in the running list
+	struct EXPAND_JOB_S *hash_next;	// while queued
+} EXPAND_JOB;
+
+struct EXPANDER_S {
+	WORKER *worker;
+	TREENODE *root;
+	unsigned concurrency;
+	int page_size;
+	unsigned max_children;
+	EXPANDER_LISTED_CALLBACK on_listed;
+	void *ctx;
+
+	EXPAND_JOB *queue_head, *queue_tail;
+	EXPAND_JOB **buckets;	// queued jobs by DN
+	unsigned num_buckets, num_queued;
+	EXPAND_JOB *running;
+	unsigned num_running;
+	unsigned long listed;
+};
+
+static unsigned dn_hash(const char *dn)
+{
+	unsigned hash = 5381;
+	for (const char *c = dn; *c; c++)
+		hash = hash * 33 + tolower((unsigned char)*c);
+	return hash;
+}
+
+static EXPAND_JOB **queued_slot(EXPANDER * e, const char *dn)
+{
+	EXPAND_JOB **slot = &e->buckets[dn_hash(dn) & (e->num_buckets - 1)];
+	while (*slot && strcasecmp((*slot)->dn, dn) != 0)
+		slot = &(*slot)->hash_next;
+	return slot;
+}
+
+static void list_unlink(EXPAND_JOB ** head, EXPAND_JOB ** tail, EXPAND_JOB * job)
+{
+	if (job->prev)
+		job->prev->next = job->next;
+	else
+		*head = job->next;
+
+	if (job->next)
+		job->next->prev = job->prev;
+	else if (tail)
+		*tail = job->prev;
+
+	job->prev = job->next = NULL;
+}
+
+static void queue_grow(EXPANDER * e)
+{
+	unsigned num_buckets = 2 * e->num_buckets;
+	EXPAND_JOB **buckets = calloc(num_buckets, sizeof(EXPAND_JOB *));
+	for (unsigned i = 0; i < e->num_buckets; i++)
+	{
+		EXPAND_JOB *job = e->buckets[i];
+		while (job)
+		{
+			EXPAND_JOB *next = job->hash_next;
+			unsigned bucket = dn_hash(job->dn) & (num_buckets - 1);
+			job->hash_next = buckets[bucket];
+			buckets[bucket] = job;
+			job = next;
+		}
+	}
+
+	free(e->buckets);
+	e->buckets = buckets;
+	e->num_buckets = num_buckets;
+}
+
+static void queue_push(EXPANDER * e, const char *dn, unsigned levels)
+{
+	EXPAND_JOB **slot = queued_slot(e, dn);
+	if (*slot)
+		return;
+
+	EXPAND_JOB *job = calloc(1, sizeof(EXPAND_JOB));
+	job->expander = e;
+	job->dn = strdup(dn);
+	job->levels = levels;
+	*slot = job;
+
+	job->prev = e->queue_tail;
+	if (e->queue_tail)
+		e->queue_tail->next = job;
+	else
+		e->queue_head = job;
+	e->queue_tail = job;
+
+	if (++e->num_queued > e->num_buckets)
+		queue_grow(e);
+}
+
+static void queue_remove(EXPANDER * e, EXPAND_JOB * job)
+{
+	EXPAND_JOB **slot = queued_slot(e, job->dn);
+	*slot = job->hash_next;
+	job->hash_next = NULL;
+	list_unlink(&e->queue_head, &e->queue_tail, job);
+	e->num_queued--;
+}
+
+static void job_free(EXPAND_JOB * job)
+{
+	for (unsigned i = 0; i < job->num_children; i++)
+		free(job->children[i].rdn);
+	free(job->children);
+	free(job->dn);
+	free(job);
+}
+
+/**
+ * Queues the containers below node that still have to be listed to get
+ * levels deep. Loaded children are descended into rather than listed
+ * again.
+ **/
+static void expander_visit(EXPANDER * e, TREENODE * node, unsigned levels)
+{
+	if (levels == 0 || node->is_leaf || node->collapsed || node->vlv_offset)
+		return;
+	if (e->max_children && node->num_subordinates > e->max_children)
+		return;
+
+	if (node->num_children == 0)
+	{
+		queue_push(e, tree_node_dn(node), levels);
+		return;
+	}
+
+	for (unsigned i = 0; i < node->num_children; i++)
+		expander_visit(e, node->children[i], levels - 1);
+}
+
+static void expander_pump(EXPANDER * e);
+
+static void expander_entry(WORKER_ENTRY * entry, void *ctx)
+{
+	EXPAND_JOB *job = ctx;
+	if (!entry->rdn)
+		return;
+
+	if (job->num_children == job->children_capacity)
+	{
+		job->children_capacity = job->children_capacity ? 2 * job->children_capacity : 16;
+		job->children = realloc(job->children, job->children_capacity * sizeof(LISTED_CHILD));
+	}
+
+	LISTED_CHILD *child = &job->children[job->num_children++];
+	child->rdn = strdup(entry->rdn);
+	child->is_leaf = false;
+	child->num_subordinates = 0;
+	entry_subordinates(entry->entry, &child->is_leaf, &child->num_subordinates);
+}
+
+static void expander_done(int result, void *ctx)
+{
+	EXPAND_JOB *job = ctx;
+	EXPANDER *e = job->expander;
+	list_unlink(&e->running, NULL, job);
+	e->num_running--;
+
+	// the container may have been loaded, collapsed or dropped meanwhile
+	TREENODE *node = result == LDAP_SUCCESS ? tree_node_find(e->root, job->dn) : NULL;
+	if (node && !node->collapsed)
+	{
+		e->listed++;
+		if (node->num_children == 0 && job->num_children > 0)
+		{
+			tree_node_reserve_children(node, job->num_children);
+			for (unsigned i = 0; i < job->num_children; i++)
+			{
+				TREENODE *child = tree_node_alloc_child(node, job->children[i].rdn);
+				child->is_leaf = job->children[i].is_leaf;
+				child->num_subordinates = job->children[i].num_subordinates;
+			}
+			if (e->on_listed)
+				e->on_listed(node, e->ctx);
+		}
+
+		for (unsigned i = 0; i < node->num_children; i++)
+			expander_visit(e, node->children[i], job->levels - 1);
+	}
+
+	job_free(job);
+	if (result != LDAP_USER_CANCELLED)
+		expander_pump(e);
+}
+
+static void expander_pump(EXPANDER * e)
+{
+	while (e->num_running < e->concurrency && e->queue_head)
+	{
+		EXPAND_JOB *job = e->queue_head;
+		queue_remove(e, job);
+
+		job->next = e->running;
+		if (e->running)
+			e->running->prev = job;
+		e->running = job;
+		e->num_running++;
+
+		worker_search(e->worker, job->dn, LDAP_SCOPE_ONE, "(objectClass=*)", child_attributes,
+			      e->page_size, expander_entry, expander_done, job, &job->req);
+	}
+}
+
+EXPANDER *expander_start(WORKER * w, TREENODE * root, TREENODE * node, unsigned levels,
+			 unsigned concurrency, int page_size, unsigned max_children,
+			 EXPANDER_LISTED_CALLBACK on_listed, void *ctx)
+{
+	EXPANDER *e = calloc(1, sizeof(EXPANDER));
+	e->worker = w;
+	e->root = root;
+	e->concurrency = concurrency > 0 ? concurrency : 1;
+	e->page_size = page_size;
+	e->max_children = max_children;
+	e->on_listed = on_listed;
+	e->ctx = ctx;
+	e->num_buckets = EXPANDER_INITIAL_BUCKETS;
+	e->buckets = calloc(e->num_buckets, sizeof(EXPAND_JOB *));
+
+	expander_visit(e, node, levels);
+	expander_pump(e);
+	return e;
+}
+
+void expander_free(EXPANDER * e)
+{
+	while (e->running)
+		worker_abandon(e->worker, e->running->req);
+
+	while (e->queue_head)
+	{
+		EXPAND_JOB *job = e->queue_head;
+		queue_remove(e, job);
+		job_free(job);
+	}
+
+	free(e->buckets);
+	free(e);
+}
+
+void expander_prioritize(EXPANDER * e, TREENODE * node)
+{
+	EXPAND_JOB *job = *queued_slot(e, tree_node_dn(node));
+	if (!job || job == e->queue_head)
+		return;
+
+	list_unlink(&e->queue_head, &e->queue_tail, job);
+	job->next = e->queue_head;
+	e->queue_head->prev = job;
+	e->queue_head = job;
+}
+
+void expander_progress(EXPANDER * e, unsigned long *listed, unsigned *pending)
+{
+	*listed = e->listed;
+	*pending = e->num_queued + e->num_running;
+}
+
+bool expander_finished(EXPANDER * e)
+{
+	return e->num_queued == 0 && e->num_running == 0;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <stdbool.h>
+#include "tree.h"
+#include "worker.h"
+
+/**
+ * Lists the containers below a node down to a given depth, breadth first,
+ * with up to a fixed number of one-level searches in flight on the worker
+ * connection. Containers found on the way are queued; those the view asks
+ * for with expander_prioritize() go first. Nodes are looked up by DN when
+ * their search completes, so the tree may change meanwhile.
+ **/
+
+typedef struct EXPANDER_S EXPANDER;
+
+/**
+ * Called after the children of node were added to the tree.
+ **/
+typedef void (*EXPANDER_LISTED_CALLBACK) (TREENODE * node, void *ctx);
+
+/**
+ * Starts expanding node (below root) levels deep. Containers reporting
+ * more than max_children subordinates are left alone (0 lists all).
+ **/
+EXPANDER *expander_start(WORKER * w, TREENODE * root, TREENODE * node, unsigned levels,
+			 unsigned concurrency, int page_size, unsigned max_children,
+			 EXPANDER_LISTED_CALLBACK on_listed, void *ctx);
+
+/**
+ * Abandons the running searches and frees the expander.
+ **/
+void expander_free(EXPANDER * e);
+
+/**
+ * Moves the queued search of node, if any, ahead of all others.
+ **/
+void expander_prioritize(EXPANDER * e, TREENODE * node);
+
+/**
+ * Reports the containers listed so far and those queued or running.
+ **/
+void expander_progress(EXPANDER * e, unsigned long *listed, unsigned *pending);
+
+bool expander_finished(EXPANDER * e);
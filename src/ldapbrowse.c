@@ -5,6 +5,10 @@
 #include <math.h>
 #include <string.h>
 #include <getopt.h>
+#include <poll.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
 
 #include <curses.h>
 #include <form.h>
@@ -13,15 +17,144 @@
 #include "ldifwriter.h"
 #include "treeview.h"
 #include "stringutils.h"
+#include "worker.h"
+#include "entrycache.h"
+#include "vlv.h"
+#include "connection.h"
+#include "ldifexport.h"
+#include "ldifimport.h"
+#include "ldifindex.h"
+#include "snapshot.h"
+#include "syncrepl.h"
+#include "expander.h"
+#include "deleter.h"
+#include "ldapentry.h"
 
 #define KEY_ENTER_MAC 0x0a
 #define KEY_ESC 0x1b
-
-LDAP *ld;
+#define SPINNER_INTERVAL_MS 100
+#define PREFETCH_DELAY_MS 150
+#define SELECTION_DELAY_MS 50
+#define REVALIDATE_CONCURRENCY 4
+
+LDAP *ld;			// encodes and decodes controls, the connection belongs to worker
+WORKER *worker;
+WORKER_REQUEST *expand_request, *attr_request;
+TREENODE *expand_node;
+TREENODE *tree_root;		// of the browsed tree, for lookups by DN
+int expand_result;		// of the last completed expand
+ENTRY_CACHE *cache;
+EXPANDER *expander;		// of the running expand to depth
+DELETER *deleter;		// of the running subtree delete
+LDIF_STATS export_stats;
+LDIF_EXPORT *running_export;
+LDIF_STATS import_stats;
+LDIF_IMPORT *running_import;
+char *import_reject_file;	// of the running import
+LDIF_INDEX *ldif_index;		// of the file browsed with -f, which stands in for the server
+CONNECTION_PARAMS connect_params;
+bool tree_dirty;
+bool selection_pending;
+
+typedef struct PREFETCH_S {
+	char *dn;
+	WORKER_REQUEST *req;
+	struct PREFETCH_S *next;
+} PREFETCH;
+
+PREFETCH *prefetches;
+unsigned prefetch_first, prefetch_last;
+
+typedef struct REVALIDATED_CHILD_S {
+	char *rdn;
+	bool is_leaf;
+	unsigned num_subordinates;
+} REVALIDATED_CHILD;
+
+/**
+ * A container restored from the snapshot whose children are being listed
+ * again, to be compared with the restored ones.
+ **/
+typedef struct REVALIDATION_S {
+	char *dn;
+	REVALIDATED_CHILD *children;
+	unsigned num_children;
+	WORKER_REQUEST *req;
+	struct REVALIDATION_S *next;
+} REVALIDATION;
+
+REVALIDATION *revalidations;	// running
+char **revalidate_queue;	// DNs of expanded containers still to check
+unsigned revalidate_queued, revalidate_capacity;
+
+#define SYNC_INITIAL_BUCKETS 64
+
+typedef struct SYNC_CHILD_S {
+	unsigned char uuid[SYNC_UUID_SIZE];
+	char *rdn;
+	struct SYNC_CHILD_S *hash_next;
+} SYNC_CHILD;
+
+/**
+ * A container listed through a content synchronization session (RFC 4533
+ * refreshAndPersist), which stays open to report changes of its children.
+ * Children are known by entryUUID, so a rename replaces the old row.
+ **/
+typedef struct SYNC_SESSION_S {
+	char *dn;
+	TREENODE *node;		// the container listed, NULL once the session is stopped
+	char *filter;
+	SYNC_CHILD **buckets;	// children by entryUUID
+	unsigned num_buckets, num_children;
+	bool refreshing;	// still sending the initial content
+	WORKER_REQUEST *req;
+	struct SYNC_SESSION_S *next;
+} SYNC_SESSION;
+
+SYNC_SESSION *sync_sessions;
+
+typedef struct COLLAPSED_S {
+	char *dn;
+	size_t size;		// estimated bytes of the hidden subtree
+	struct COLLAPSED_S *next;
+} COLLAPSED;
+
+/**
+ * A container with children marked removed, whose rows prune_rows() takes
+ * out in one pass.
+ **/
+typedef struct PRUNED_S {
+	char *dn;
+	struct PRUNED_S *next;
+} PRUNED;
+
+PRUNED *pruned;
+struct timespec pruned_since;	// when the first of them was marked
+
+COLLAPSED *collapsed;		// hidden subtrees, most recently collapsed first
+size_t collapsed_size;
 TREEVIEW *treeview;
 WINDOW *attrpad;
 int attrpad_toprow = 0, attrpad_rows = 0;
 char **attributes;
+int page_size = 500;
+size_t cache_size = 16 << 20;
+size_t tree_cache_size = 64 << 20;
+unsigned cache_ttl = 300;
+unsigned vlv_threshold = 10000;
+char *vlv_sort_key = "cn";
+unsigned vlv_before, vlv_target;	// window of the pending VLV search
+unsigned expand_concurrency = 8;
+unsigned delete_window = 16;
+unsigned import_window = 32;
+unsigned export_connections = 1;
+bool export_shards = false;
+bool snapshot = false;
+bool sync_enabled = false;
+bool headless;			// batch mode, no curses
+
+// operational attributes requested when listing children, instead of all attributes
+char *child_list_attributes[] = { "hasSubordinates", "numSubordinates", NULL };
 
 struct INPUT_DIALOG {
 	WINDOW *win;
@@ -30,6 +163,10 @@ struct INPUT_DIALOG {
 };
 
 void resize();
+void ldap_load_subtree(TREENODE * root);
+void ldap_load_subtree_filtered(TREENODE * root, const char *filter);
+void sync_stop(TREENODE * node);
+void uncollapse(TREENODE * node);
 
 void curses_init()
 {
@@ -42,26 +179,6 @@ void curses_init()
 	curs_set(0);
 }
 
-char *node_dn(TREENODE * node)
-{
-	char *dn = calloc(1, 1);
-	while (node)
-	{
-		unsigned len = strlen(dn) + strlen(node->value) + 2;
-		dn = realloc(dn, len);
-
-		strcat(dn, ",");
-		strcat(dn, node->value);
-
-		node = node->parent;
-	}
-
-	for (unsigned i = 0; dn[i]; i++)
-		dn[i] = dn[i + 1];
-
-	return dn;
-}
-
 WINDOW *show_message(const char *line1, const char *line2)
 {
 	int screen_height, screen_width;
@@ -78,118 +195,1447 @@ WINDOW *show_message(const char *line1, const char *line2)
 	return win;
 }
 
-void ldap_show_error(LDAP * ld, int errno, const char *s)
+void ldap_show_error(LDAP * ld, int errno, const char *s)
+{
+	char *errstr = ldap_err2string(errno);
+	if (headless)
+	{
+		fprintf(stderr, "%s: %s\n", s, errstr);
+		return;
+	}
+
+	show_message("LDAP error occured", errstr);
+	getch();
+}
+
+void ldap_append_entry(WORKER_ENTRY * e, void *ctx)
+{
+	TREENODE *root = ctx;
+	if (!e->rdn)
+		return;
+
+	TREENODE *child = tree_node_alloc_child(root, e->rdn);
+	entry_subordinates(e->entry, &child->is_leaf, &child->num_subordinates);
+	tree_dirty = true;
+}
+
+void expand_done(int result, void *ctx)
+{
+	expand_result = result;
+	expand_request = NULL;
+	expand_node = NULL;
+	tree_dirty = true;
+
+	if (result != LDAP_SUCCESS && result != LDAP_USER_CANCELLED)
+		ldap_show_error(ld, result, "ldap_search_ext");
+}
+
+/**
+ * Abandons the pending expand if its node lies below node (any node if
+ * NULL) and drops the children loaded so far.
+ **/
+void cancel_expand(TREENODE * node)
+{
+	if (!expand_request)
+		return;
+
+	TREENODE *n = expand_node;
+	while (node && n && n != node)
+		n = n->parent;
+	if (!n)
+		return;
+
+	TREENODE *target = expand_node;
+	worker_abandon(worker, expand_request);
+	sync_stop(target);
+	tree_node_remove_childs(target);
+}
+
+void vlv_result(LDAPControl ** controls, void *ctx)
+{
+	TREENODE *node = ctx;
+	int target_pos, list_count;
+
+	if (!vlv_parse_response(ld, controls, &target_pos, &list_count) || target_pos < 1)
+		return;
+
+	// the window starts vlv_before entries ahead of the target, fewer at the top of the list
+	vlv_target = target_pos;
+	node->vlv_count = list_count;
+	node->vlv_offset = target_pos > vlv_before ? target_pos - vlv_before : 1;
+	tree_dirty = true;
+}
+
+void vlv_done(int result, void *ctx)
+{
+	TREENODE *node = ctx;
+
+	if (result == LDAP_UNAVAILABLE_CRITICAL_EXTENSION)
+	{
+		// server lacks sorting or VLV, list the container as a whole
+		expand_request = NULL;
+		expand_node = NULL;
+		vlv_threshold = 0;
+		ldap_load_subtree(node);
+		return;
+	}
+
+	expand_done(result, ctx);
+	if (result != LDAP_SUCCESS || !node->vlv_offset)
+		return;
+
+	unsigned index = vlv_target - node->vlv_offset;
+	if (index < node->num_children)
+	{
+		treeview_set_current(treeview, node->children[index]);
+		selection_pending = true;
+	}
+}
+
+/**
+ * Lists the window of children around list position offset (1-based), or
+ * around the first child whose sort key is not less than assertion, using
+ * server side sorting and the virtual list view control. The target child
+ * becomes the current node once the window arrived.
+ **/
+void vlv_load(TREENODE * node, unsigned offset, const char *assertion)
+{
+	cancel_expand(NULL);
+	sync_stop(node);
+	uncollapse(node);
+	tree_node_remove_childs(node);
+	node->vlv_offset = 0;
+
+	unsigned height = LINES / 2;
+	LDAPControl **controls;
+	int errno = vlv_controls_create(ld, vlv_sort_key, height, 2 * height, offset,
+					node->vlv_count, assertion, &controls);
+	if (errno != LDAP_SUCCESS)
+	{
+		ldap_show_error(ld, errno, "ldap_search_ext");
+		return;
+	}
+
+	worker_search_ext(worker, tree_node_dn(node), LDAP_SCOPE_ONE, "(objectClass=*)",
+			  child_list_attributes, controls, ldap_append_entry, vlv_result, vlv_done,
+			  node, &expand_request);
+	vlv_controls_free(controls);
+
+	vlv_before = height;
+	expand_node = node;
+}
+
+/**
+ * Moves the VLV window of the container of node if moving by rows leaves
+ * the loaded children. Returns false if the move stays inside the window.
+ **/
+bool vlv_navigate(TREENODE * node, int rows)
+{
+	TREENODE *container = node->parent;
+	if (!container || !container->vlv_offset)
+		return false;
+
+	long position = (long)container->vlv_offset + node->index_in_parent + rows;
+	if (position < 1)
+		position = 1;
+	if (position > container->vlv_count)
+		position = container->vlv_count;
+
+	if (position >= container->vlv_offset
+	    && position < (long)container->vlv_offset + container->num_children)
+		return false;
+
+	vlv_load(container, position, NULL);
+	return true;
+}
+
+/**
+ * Jumps to a list position (if target is a number) or to the first child
+ * whose sort key starts at target.
+ **/
+void vlv_jump(TREENODE * container, const char *target)
+{
+	char *end;
+	unsigned long position = strtoul(target, &end, 10);
+
+	if (*target && !*end)
+		vlv_load(container, position ? position : 1, NULL);
+	else
+		vlv_load(container, 1, target);
+}
+
+/**
+ * Marks a child that no longer exists on the server for removal, with
+ * everything loaded below it. Its row goes with the others of its parent
+ * the next time prune_rows() runs; the caller drops what is cached.
+ **/
+void remove_row(TREENODE * node)
+{
+	TREENODE *parent = node->parent;
+	if (node->removed)
+		return;
+
+	tree_node_mark_removed(node);
+	if (parent->num_subordinates > 0)
+		parent->num_subordinates--;
+
+	const char *dn = tree_node_dn(parent);
+	PRUNED *p = pruned;
+	while (p && strcasecmp(p->dn, dn) != 0)
+		p = p->next;
+	if (!p)
+	{
+		if (!pruned)
+			clock_gettime(CLOCK_MONOTONIC, &pruned_since);
+		p = calloc(1, sizeof(PRUNED));
+		p->dn = strdup(dn);
+		p->next = pruned;
+		pruned = p;
+	}
+	tree_dirty = true;
+}
+
+unsigned uuid_hash(const unsigned char *uuid)
+{
+	unsigned hash = 5381;
+	for (unsigned i = 0; i < SYNC_UUID_SIZE; i++)
+		hash = hash * 33 + uuid[i];
+	return hash;
+}
+
+SYNC_CHILD **sync_child_slot(SYNC_SESSION * s, const unsigned char *uuid)
+{
+	SYNC_CHILD **slot = &s->buckets[uuid_hash(uuid) & (s->num_buckets - 1)];
+	while (*slot && memcmp((*slot)->uuid, uuid, SYNC_UUID_SIZE) != 0)
+		slot = &(*slot)->hash_next;
+	return slot;
+}
+
+void sync_child_grow(SYNC_SESSION * s)
+{
+	unsigned num_buckets = 2 * s->num_buckets;
+	SYNC_CHILD **buckets = calloc(num_buckets, sizeof(SYNC_CHILD *));
+	for (unsigned i = 0; i < s->num_buckets; i++)
+	{
+		SYNC_CHILD *child = s->buckets[i];
+		while (child)
+		{
+			SYNC_CHILD *next = child->hash_next;
+			unsigned bucket = uuid_hash(child->uuid) & (num_buckets - 1);
+			child->hash_next = buckets[bucket];
+			buckets[bucket] = child;
+			child = next;
+		}
+	}
+
+	free(s->buckets);
+	s->buckets = buckets;
+	s->num_buckets = num_buckets;
+}
+
+void sync_child_add(SYNC_SESSION * s, const unsigned char *uuid, const char *rdn)
+{
+	SYNC_CHILD *child = calloc(1, sizeof(SYNC_CHILD));
+	memcpy(child->uuid, uuid, SYNC_UUID_SIZE);
+	child->rdn = strdup(rdn);
+
+	SYNC_CHILD **bucket = &s->buckets[uuid_hash(uuid) & (s->num_buckets - 1)];
+	child->hash_next = *bucket;
+	*bucket = child;
+	if (++s->num_children > s->num_buckets)
+		sync_child_grow(s);
+}
+
+void sync_child_remove(SYNC_SESSION * s, SYNC_CHILD ** slot)
+{
+	SYNC_CHILD *child = *slot;
+	*slot = child->hash_next;
+	s->num_children--;
+	free(child->rdn);
+	free(child);
+}
+
+/**
+ * Applies a change reported in the persist phase to the children of node.
+ **/
+void sync_apply(SYNC_SESSION * s, TREENODE * node, WORKER_ENTRY * e)
+{
+	const char *rdn = e->rdn;
+	SYNC_CHILD **slot = sync_child_slot(s, e->uuid);
+	SYNC_CHILD *known = *slot;
+	if (known && (e->sync_state == LDAP_SYNC_DELETE || strcasecmp(known->rdn, rdn) != 0))
+	{
+		// deleted, moved away or renamed: the old row goes
+		TREENODE *old = tree_node_child(node, known->rdn);
+		if (old)
+		{
+			// only a container has cached entries below it
+			if (old->num_children > 0)
+				entry_cache_remove_subtree(cache, tree_node_dn(old));
+			else
+				entry_cache_remove(cache, tree_node_dn(old));
+			remove_row(old);
+		}
+		sync_child_remove(s, slot);
+		known = NULL;
+	}
+
+	if (e->sync_state == LDAP_SYNC_DELETE)
+		return;
+
+	TREENODE *child = tree_node_child(node, rdn);
+
+	if (!child)
+	{
+		// appending moves the rows below, keep the selection where it is
+		TREENODE *current = treeview_current_node(treeview);
+		child = tree_node_alloc_child(node, rdn);
+		node->num_subordinates++;
+		treeview_set_current(treeview, current);
+	}
+	if (!known)
+		sync_child_add(s, e->uuid, rdn);
+
+	entry_subordinates(e->entry, &child->is_leaf, &child->num_subordinates);
+	entry_cache_remove(cache, tree_node_dn(child));
+	if (child == treeview_current_node(treeview))
+		selection_pending = true;
+}
+
+void sync_message(WORKER_ENTRY * e, void *ctx)
+{
+	SYNC_SESSION *s = ctx;
+
+	if (!e->entry)
+	{
+		if (s->refreshing && e->refresh_done)
+		{
+			s->refreshing = false;
+			expand_done(LDAP_SUCCESS, NULL);
+		}
+		return;
+	}
+
+	TREENODE *node = s->node;
+	if (!node || !e->has_sync_state || !e->rdn)
+		return;
+
+	if (s->refreshing)
+	{
+		// the initial content, listed like a plain search
+		if (e->sync_state != LDAP_SYNC_DELETE)
+		{
+			ldap_append_entry(e, node);
+			sync_child_add(s, e->uuid, e->rdn);
+		}
+	} else
+		sync_apply(s, node, e);
+
+	tree_dirty = true;
+}
+
+void sync_done(int result, void *ctx)
+{
+	SYNC_SESSION *s = ctx;
+	for (SYNC_SESSION ** cur = &sync_sessions; *cur; cur = &(*cur)->next)
+	{
+		if (*cur == s)
+		{
+			*cur = s->next;
+			break;
+		}
+	}
+
+	if (s->req == expand_request)
+	{
+		if (result == LDAP_UNAVAILABLE_CRITICAL_EXTENSION)
+		{
+			// server lacks content synchronization, list the container once
+			expand_request = NULL;
+			expand_node = NULL;
+			sync_enabled = false;
+			if (s->node)
+				ldap_load_subtree_filtered(s->node, s->filter);
+		} else
+			expand_done(result, NULL);
+	}
+
+	for (unsigned i = 0; i < s->num_buckets; i++)
+	{
+		while (s->buckets[i])
+			sync_child_remove(s, &s->buckets[i]);
+	}
+	free(s->buckets);
+	free(s->filter);
+	free(s->dn);
+	free(s);
+}
+
+/**
+ * Lists the children of root through a refreshAndPersist session, which
+ * becomes the pending expand until the initial content arrived.
+ **/
+int sync_start(TREENODE * root, const char *filter)
+{
+	LDAPControl *control;
+	int errno = sync_control_create(ld, LDAP_SYNC_REFRESH_AND_PERSIST, &control);
+	if (errno != LDAP_SUCCESS)
+		return errno;
+
+	SYNC_SESSION *s = calloc(1, sizeof(SYNC_SESSION));
+	s->dn = strdup(tree_node_dn(root));
+	s->node = root;
+	s->filter = strdup(filter);
+	s->refreshing = true;
+	s->num_buckets = SYNC_INITIAL_BUCKETS;
+	s->buckets = calloc(s->num_buckets, sizeof(SYNC_CHILD *));
+
+	LDAPControl *controls[] = { control, NULL };
+	worker_search_persistent(worker, s->dn, LDAP_SCOPE_ONE, filter, child_list_attributes,
+				 controls, sync_message, sync_done, s, &s->req);
+	ldap_control_free(control);
+
+	s->next = sync_sessions;
+	sync_sessions = s;
+	expand_request = s->req;
+	return LDAP_SUCCESS;
+}
+
+/**
+ * Ends the sessions of node and of the containers below it. Whatever
+ * removes a container from the tree stops its sessions first.
+ **/
+void sync_stop(TREENODE * node)
+{
+	// taken out of the list before abandoning, whenever sync_done() runs
+	SYNC_SESSION *stopped = NULL;
+	for (SYNC_SESSION ** cur = &sync_sessions; *cur;)
+	{
+		SYNC_SESSION *s = *cur;
+		TREENODE *n = s->node;
+		while (n && n != node)
+			n = n->parent;
+
+		if (n)
+		{
+			*cur = s->next;
+			s->node = NULL;
+			s->next = stopped;
+			stopped = s;
+		} else
+			cur = &s->next;
+	}
+
+	while (stopped)
+	{
+		SYNC_SESSION *s = stopped;
+		stopped = s->next;
+		worker_abandon(worker, s->req);
+	}
+}
+
+/**
+ * Estimates the bytes held by the descendants of node.
+ **/
+size_t subtree_bytes(TREENODE * node)
+{
+	size_t size = node->arena ? arena_size(node->arena) : 0;
+	size += node->children_capacity * (sizeof(TREENODE *) + sizeof(unsigned));
+	for (unsigned i = 0; i < node->num_children; i++)
+		size += subtree_bytes(node->children[i]);
+	return size;
+}
+
+void collapsed_forget(const char *dn)
+{
+	for (COLLAPSED ** cur = &collapsed; *cur; cur = &(*cur)->next)
+	{
+		if (strcasecmp((*cur)->dn, dn) == 0)
+		{
+			COLLAPSED *c = *cur;
+			*cur = c->next;
+			collapsed_size -= c->size;
+			free(c->dn);
+			free(c);
+			return;
+		}
+	}
+}
+
+/**
+ * Hides the children of node, keeping them loaded. Once the hidden
+ * subtrees hold more than tree_cache_size, the least recently collapsed
+ * ones are freed and have to be listed again when expanded.
+ **/
+void collapse(TREENODE * node)
+{
+	const char *dn = tree_node_dn(node);
+	tree_node_set_collapsed(node, true);
+	collapsed_forget(dn);
+
+	COLLAPSED *c = calloc(1, sizeof(COLLAPSED));
+	c->dn = strdup(dn);
+	c->size = subtree_bytes(node);
+	c->next = collapsed;
+	collapsed = c;
+	collapsed_size += c->size;
+
+	// the subtree just collapsed stays, even if it alone exceeds the budget
+	while (collapsed_size > tree_cache_size && collapsed->next)
+	{
+		COLLAPSED *victim = collapsed;
+		while (victim->next)
+			victim = victim->next;
+
+		TREENODE *n = tree_node_find(tree_root, victim->dn);
+		if (n && n->collapsed)
+		{
+			sync_stop(n);
+			tree_node_remove_childs(n);
+			tree_node_set_collapsed(n, false);
+		}
+		collapsed_forget(victim->dn);
+	}
+}
+
+void uncollapse(TREENODE * node)
+{
+	tree_node_set_collapsed(node, false);
+	collapsed_forget(tree_node_dn(node));
+}
+
+/**
+ * Puts the collapsed nodes restored from a snapshot under the budget.
+ **/
+void collapse_restored(TREENODE * node)
+{
+	for (unsigned i = 0; i < node->num_children; i++)
+		collapse_restored(node->children[i]);
+	if (node->collapsed)
+		collapse(node);
+}
+
+void ldap_load_subtree_filtered(TREENODE * root, const char *filter)
+{
+	cancel_expand(NULL);
+	sync_stop(root);
+	uncollapse(root);
+	tree_node_remove_childs(root);
+	root->vlv_offset = 0;
+	tree_node_reserve_children(root, root->num_subordinates);
+
+	if (sync_enabled)
+	{
+		int errno = sync_start(root, filter);
+		if (errno != LDAP_SUCCESS)
+		{
+			ldap_show_error(ld, errno, "ldap_search_ext");
+			return;
+		}
+	} else
+		worker_search(worker, tree_node_dn(root), LDAP_SCOPE_ONE, filter, child_list_attributes,
+			      page_size, ldap_append_entry, expand_done, root, &expand_request);
+
+	expand_node = root;
+}
+
+/**
+ * Lists the children of root from the index of the browsed file.
+ **/
+void ldif_load_subtree(TREENODE * root)
+{
+	uncollapse(root);
+	tree_node_remove_childs(root);
+
+	unsigned count;
+	const unsigned *children =
+	    ldif_index_children(ldif_index, ldif_index_find(ldif_index, tree_node_dn(root)), &count);
+	tree_node_reserve_children(root, count);
+
+	ARENA *names = arena_alloc();
+	for (unsigned i = 0; i < count; i++)
+	{
+		char *name = ldif_index_name(ldif_index, children[i], names);
+		if (!name)
+			continue;
+
+		TREENODE *child = tree_node_alloc_child(root, name);
+		ldif_index_children(ldif_index, children[i], &child->num_subordinates);
+		child->is_leaf = child->num_subordinates == 0;
+		arena_reset(names);
+	}
+	arena_free(names);
+	tree_dirty = true;
+}
+
+void ldap_load_subtree(TREENODE * root)
+{
+	if (ldif_index)
+		ldif_load_subtree(root);
+	else if (vlv_threshold && root->num_subordinates > vlv_threshold)
+		vlv_load(root, 1, NULL);
+	else
+		ldap_load_subtree_filtered(root, "(objectClass=*)");
+}
+
+void revalidate_push(const char *dn)
+{
+	if (revalidate_queued == revalidate_capacity)
+	{
+		revalidate_capacity = revalidate_capacity ? 2 * revalidate_capacity : 64;
+		revalidate_queue = realloc(revalidate_queue, revalidate_capacity * sizeof(char *));
+	}
+	revalidate_queue[revalidate_queued++] = strdup(dn);
+}
+
+void revalidate_entry(WORKER_ENTRY * e, void *ctx)
+{
+	REVALIDATION *r = ctx;
+	if (!e->rdn)
+		return;
+
+	r->children = realloc(r->children, (r->num_children + 1) * sizeof(REVALIDATED_CHILD));
+	REVALIDATED_CHILD *child = &r->children[r->num_children++];
+	child->rdn = strdup(e->rdn);
+	child->is_leaf = false;
+	child->num_subordinates = 0;
+	entry_subordinates(e->entry, &child->is_leaf, &child->num_subordinates);
+}
+
+/**
+ * Replaces the restored children of node by the listed ones, keeping the
+ * current node if it still exists.
+ **/
+void revalidate_rebuild(TREENODE * node, REVALIDATION * r)
+{
+	TREENODE *root = tree_root;
+	char *current = strdup(tree_node_dn(treeview_current_node(treeview)));
+
+	sync_stop(node);
+	tree_node_remove_childs(node);
+	tree_node_reserve_children(node, r->num_children);
+	for (unsigned i = 0; i < r->num_children; i++)
+	{
+		TREENODE *child = tree_node_alloc_child(node, r->children[i].rdn);
+		child->is_leaf = r->children[i].is_leaf;
+		child->num_subordinates = r->children[i].num_subordinates;
+	}
+
+	TREENODE *selection = tree_node_find(root, current);
+	treeview_set_tree(treeview, root);
+	treeview_set_current(treeview, selection ? selection : node);
+	if (!selection)
+		selection_pending = true;
+	free(current);
+}
+
+void revalidate_next();
+
+void revalidate_done(int result, void *ctx)
+{
+	REVALIDATION *r = ctx;
+	for (REVALIDATION ** cur = &revalidations; *cur; cur = &(*cur)->next)
+	{
+		if (*cur == r)
+		{
+			*cur = r->next;
+			break;
+		}
+	}
+
+	// the user may have collapsed or reloaded the container meanwhile
+	TREENODE *node = result == LDAP_SUCCESS ? tree_node_find(tree_root, r->dn) : NULL;
+	TREENODE *n = expand_node;
+	while (n && n != node)
+		n = n->parent;
+
+	if (node && !n && node->num_children > 0 && !node->vlv_offset)
+	{
+		bool same = node->num_children == r->num_children;
+		for (unsigned i = 0; same && i < r->num_children; i++)
+			same = strcasecmp(node->children[i]->value, r->children[i].rdn) == 0;
+
+		if (same)
+		{
+			for (unsigned i = 0; i < r->num_children; i++)
+			{
+				TREENODE *child = node->children[i];
+				child->is_leaf = r->children[i].is_leaf;
+				child->num_subordinates = r->children[i].num_subordinates;
+				if (child->num_children > 0)
+					revalidate_push(tree_node_dn(child));
+			}
+		} else
+			revalidate_rebuild(node, r);
+		tree_dirty = true;
+	}
+
+	for (unsigned i = 0; i < r->num_children; i++)
+		free(r->children[i].rdn);
+	free(r->children);
+	free(r->dn);
+	free(r);
+
+	if (result != LDAP_USER_CANCELLED)
+		revalidate_next();
+}
+
+/**
+ * Lists the children of queued containers again, a few at a time. VLV
+ * windows are left alone, they are refreshed on the next move.
+ **/
+void revalidate_next()
+{
+	unsigned running = 0;
+	for (REVALIDATION * r = revalidations; r; r = r->next)
+		running++;
+
+	while (running < REVALIDATE_CONCURRENCY && revalidate_queued > 0)
+	{
+		// breadth first, so the upper levels settle first
+		char *dn = revalidate_queue[0];
+		memmove(revalidate_queue, revalidate_queue + 1, --revalidate_queued * sizeof(char *));
+
+		TREENODE *node = tree_node_find(tree_root, dn);
+		if (!node || node->vlv_offset || node->num_children == 0 || node == expand_node)
+		{
+			free(dn);
+			continue;
+		}
+
+		REVALIDATION *r = calloc(1, sizeof(REVALIDATION));
+		r->dn = dn;
+		r->next = revalidations;
+		revalidations = r;
+		running++;
+		worker_search(worker, dn, LDAP_SCOPE_ONE, "(objectClass=*)", child_list_attributes,
+			      page_size, revalidate_entry, revalidate_done, r, &r->req);
+	}
+}
+
+/**
+ * Checks the tree restored from a snapshot against the server in the
+ * background, starting with the children of root.
+ **/
+void revalidate_start(TREENODE * root)
+{
+	revalidate_push(tree_node_dn(root));
+	revalidate_next();
+}
+
+void cancel_revalidation()
+{
+	while (revalidations)
+		worker_abandon(worker, revalidations->req);
+
+	for (unsigned i = 0; i < revalidate_queued; i++)
+		free(revalidate_queue[i]);
+	free(revalidate_queue);
+	revalidate_queue = NULL;
+	revalidate_queued = revalidate_capacity = 0;
+}
+
+/**
+ * Keeps the selection on its node while rows are added above it.
+ **/
+void expander_listed(TREENODE * node, void *ctx)
+{
+	unsigned row;
+	if (tree_node_row(treeview->root, node, &row))
+		treeview_rows_inserted(treeview, row, node->num_children);
+	tree_dirty = true;
+}
+
+void cancel_expand_levels()
+{
+	if (expander)
+		expander_free(expander);
+	expander = NULL;
+}
+
+/**
+ * Lists the containers below node levels deep in the background,
+ * expand_concurrency at a time, the ones on screen first.
+ **/
+void expand_levels(TREENODE * node, unsigned levels)
+{
+	cancel_expand_levels();
+	uncollapse(node);
+	expander = expander_start(worker, tree_root, node, levels, expand_concurrency, page_size,
+				  vlv_threshold, expander_listed, NULL);
+}
+
+/**
+ * Moves the pending containers on screen to the front of the expand queue,
+ * the top row first.
+ **/
+void expand_prioritize_visible()
+{
+	if (!expander)
+		return;
+
+	TREENODE *visible[treeview->height + 1];
+	unsigned count = 0;
+	TREENODE *node = treeview_node_with_index(treeview->root, treeview->toprow);
+	for (; node && count < treeview->height; node = tree_node_next(treeview->root, node))
+		visible[count++] = node;
+
+	while (count > 0)
+	{
+		node = visible[--count];
+		if (!node->is_leaf && node->num_children == 0)
+			expander_prioritize(expander, node);
+	}
+}
+
+/**
+ * Marks the row of a deleted entry for removal, if it is loaded.
+ **/
+void deleter_deleted(const char *dn, void *ctx)
+{
+	// fetched again while the delete runs
+	entry_cache_remove(cache, dn);
+	TREENODE *node = tree_node_find(tree_root, dn);
+	if (node && tree_node_get_parent(tree_root, node))
+		remove_row(node);
+}
+
+void cancel_delete_subtree()
+{
+	if (deleter)
+		deleter_free(deleter);
+	deleter = NULL;
+}
+
+/**
+ * Deletes node and everything below it in the background, removing the
+ * rows as the entries go.
+ **/
+void delete_subtree(TREENODE * node)
+{
+	cancel_delete_subtree();
+	// the rows go as the entries do, what they have loaded goes now
+	cancel_expand(node);
+	sync_stop(node);
+	entry_cache_remove_subtree(cache, tree_node_dn(node));
+	deleter = deleter_start(worker, tree_node_dn(node), delete_window, page_size,
+				deleter_deleted, NULL);
+}
+
+void attrpad_refresh(WINDOW * win)
+{
+	int height, width;
+	getmaxyx(stdscr, height, width);
+	int attrpad_height = height / 2 + 1;
+
+	// limit scrolling
+	if (attrpad_toprow > attrpad_rows + 2 - attrpad_height)
+		attrpad_toprow = attrpad_rows + 2 - attrpad_height;
+	if (attrpad_toprow < 0)
+		attrpad_toprow = 0;
+	prefresh(win, attrpad_toprow, 0, attrpad_height, 0, height - 1, width - 1);
+}
+
+void attrpad_show(WINDOW * win, ENTRY * e)
+{
+	for (unsigned i = 0; i < e->num_attributes; i++)
+	{
+		ENTRY_ATTRIBUTE *attr = &e->attributes[i];
+		for (unsigned j = 0; j < attr->num_values; j++)
+		{
+			waddstr(win, attr->name);
+			waddstr(win, ": ");
+			waddstr(win, attr->values[j].data);
+			waddstr(win, "\n");
+			attrpad_rows++;
+		}
+	}
+
+	attrpad_refresh(win);
+}
+
+/**
+ * Clears the pad down to the DN line, marking entries restored from the
+ * snapshot until the server confirmed them.
+ **/
+void attrpad_begin(WINDOW * win, const char *dn, bool stale)
+{
+	wclear(win);
+	attrpad_rows = 1;
+	waddstr(win, "dn: ");
+	waddstr(win, dn);
+	if (stale)
+		waddstr(win, "  (from snapshot)");
+	waddstr(win, "\n");
+}
+
+void attrpad_entry_received(WORKER_ENTRY * received, void *ctx)
+{
+	char *dn = ctx;
+	ENTRY *e = received->entry;
+	received->entry = NULL;
+	entry_cache_put(cache, dn, e);
+	attrpad_begin(attrpad, dn, false);
+	attrpad_show(attrpad, e);
+}
+
+void attrpad_done(int result, void *ctx)
+{
+	attr_request = NULL;
+	free(ctx);
+
+	if (result != LDAP_SUCCESS && result != LDAP_USER_CANCELLED)
+		ldap_show_error(ld, result, "ldap_search_ext");
+}
+
+/**
+ * Shows the entry dn of the browsed file (only the requested attributes,
+ * if any), printing the values straight from the mapping.
+ **/
+void ldif_show_entry(WINDOW * win, const char *dn)
+{
+	attrpad_begin(win, dn, false);
+
+	LDIF_RECORD record;
+	if (ldif_index_record(ldif_index, ldif_index_find(ldif_index, dn), &record))
+	{
+		// holds the folded and base64 encoded values
+		ARENA *decoded = arena_alloc();
+		LDIF_CURSOR c;
+		LDIF_LINE line;
+		ldif_cursor_init(&c, &record);
+		while (ldif_cursor_next(&c, decoded, &line))
+		{
+			bool requested = !attributes;
+			for (unsigned i = 0; attributes && attributes[i] && !requested; i++)
+				requested = ldif_line_is(&line, attributes[i]);
+			if (!requested || ldif_line_is(&line, "dn"))
+				continue;
+
+			waddnstr(win, line.name, line.name_len);
+			waddstr(win, ": ");
+			waddnstr(win, line.value, line.value_len);
+			waddstr(win, "\n");
+			attrpad_rows++;
+		}
+		arena_free(decoded);
+	}
+
+	attrpad_refresh(win);
+}
+
+void selection_changed(WINDOW * win, TREENODE * selection)
+{
+	if (ldif_index)
+	{
+		ldif_show_entry(win, tree_node_dn(selection));
+		return;
+	}
+
+	if (attr_request)
+		worker_abandon(worker, attr_request);
+
+	const char *dn = tree_node_dn(selection);
+	bool stale = false;
+	ENTRY *cached = entry_cache_lookup(cache, dn, &stale);
+	attrpad_begin(win, dn, stale);
+
+	if (cached)
+	{
+		attrpad_show(win, cached);
+		if (!stale)
+			return;
+	} else
+		attrpad_refresh(win);
+
+	worker_search(worker, dn, LDAP_SCOPE_BASE, "(objectClass=*)", attributes, 0,
+		      attrpad_entry_received, attrpad_done, strdup(dn), &attr_request);
+}
+
+void prefetch_entry_received(WORKER_ENTRY * e, void *ctx)
+{
+	PREFETCH *p = ctx;
+	entry_cache_put(cache, p->dn, e->entry);
+	e->entry = NULL;
+}
+
+void prefetch_done(int result, void *ctx)
+{
+	PREFETCH *p = ctx;
+	for (PREFETCH ** cur = &prefetches; *cur; cur = &(*cur)->next)
+	{
+		if (*cur == p)
+		{
+			*cur = p->next;
+			break;
+		}
+	}
+
+	free(p->dn);
+	free(p);
+}
+
+void cancel_prefetch()
+{
+	while (prefetches)
+		worker_abandon(worker, prefetches->req);
+}
+
+/**
+ * Fetches the uncached entries of the visible page and one page above
+ * and below it in one pipelined burst.
+ **/
+void prefetch_neighbours()
+{
+	if (ldif_index)
+		return;
+
+	unsigned num_nodes = treeview_num_nodes(treeview);
+	unsigned first = treeview->toprow > treeview->height ? treeview->toprow - treeview->height : 0;
+	unsigned last = treeview->toprow + 2 * treeview->height;
+	if (last > num_nodes)
+		last = num_nodes;
+
+	cancel_prefetch();
+	prefetch_first = first;
+	prefetch_last = last;
+
+	for (unsigned i = first; i < last; i++)
+	{
+		const char *dn = tree_node_dn(treeview_node_with_index(treeview->root, i));
+		if (entry_cache_get(cache, dn))
+			continue;
+
+		PREFETCH *p = calloc(1, sizeof(PREFETCH));
+		p->dn = strdup(dn);
+		p->next = prefetches;
+		prefetches = p;
+		worker_search(worker, dn, LDAP_SCOPE_BASE, "(objectClass=*)", attributes, 0,
+			      prefetch_entry_received, prefetch_done, p, &p->req);
+	}
+}
+
+unsigned elapsed_ms(struct timespec *since)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - since->tv_sec) * 1000 + (now.tv_nsec - since->tv_nsec) / 1000000;
+}
+
+// the topmost of node and its ancestors that is marked removed, if any
+TREENODE *removed_ancestor(TREENODE * node)
+{
+	TREENODE *gone = NULL;
+	for (; node; node = node->parent)
+		if (node->removed)
+			gone = node;
+	return gone;
+}
+
+/**
+ * Takes out the rows marked by remove_row(), in one pass per container,
+ * at most every SPINNER_INTERVAL_MS unless now. Expands and sync sessions
+ * below them end, and the selection moves to the nearest remaining row if
+ * it was inside a removed subtree.
+ **/
+void prune_rows(bool now)
+{
+	if (!pruned || (!now && elapsed_ms(&pruned_since) < SPINNER_INTERVAL_MS))
+		return;
+
+	TREENODE *current = treeview_current_node(treeview);
+	TREENODE *gone = removed_ancestor(current);
+	if (gone)
+	{
+		TREENODE *parent = gone->parent;
+		current = NULL;
+		for (unsigned i = gone->index_in_parent + 1; i < parent->num_children && !current; i++)
+			if (!parent->children[i]->removed)
+				current = parent->children[i];
+		for (unsigned i = gone->index_in_parent; i-- > 0 && !current;)
+			if (!parent->children[i]->removed)
+				current = parent->children[i];
+		if (!current)
+			current = parent;
+		selection_pending = true;
+	}
+
+	gone = expand_node ? removed_ancestor(expand_node) : NULL;
+	if (gone)
+		cancel_expand(gone);
+	for (SYNC_SESSION * s = sync_sessions; s;)
+	{
+		gone = removed_ancestor(s->node);
+		if (gone)
+		{
+			// stops s and whatever else lies below, so start over
+			sync_stop(gone);
+			s = sync_sessions;
+		} else
+			s = s->next;
+	}
+
+	while (pruned)
+	{
+		PRUNED *p = pruned;
+		pruned = p->next;
+		// a container removed itself took its marked children along
+		TREENODE *parent = tree_node_find(tree_root, p->dn);
+		if (parent)
+			tree_node_remove_marked(parent);
+		// subordinate counts of the parent are stale now
+		entry_cache_remove(cache, p->dn);
+		free(p->dn);
+		free(p);
+	}
+
+	treeview_set_current(treeview, current);
+	tree_dirty = true;
+}
+
+/**
+ * Shows entries and bytes written per second on the separator line while
+ * an export runs.
+ **/
+void draw_export_progress(int row, int width)
+{
+	if (!__atomic_load_n(&export_stats.running, __ATOMIC_ACQUIRE) || width < 8)
+		return;
+
+	double seconds = elapsed_ms(&export_stats.start) / 1000.0;
+	if (seconds <= 0)
+		seconds = 0.001;
+
+	// written by the export thread when running in parallel
+	unsigned long entries = __atomic_load_n(&export_stats.entries, __ATOMIC_RELAXED);
+	size_t bytes = __atomic_load_n(&export_stats.bytes, __ATOMIC_RELAXED);
+
+	char line[128];
+	snprintf(line, sizeof(line), " export: %lu entries, %.1f MB, %.0f entries/s, %.1f MB/s ",
+		 entries, bytes / 1048576.0, entries / seconds, bytes / 1048576.0 / seconds);
+	mvaddnstr(row, 2, line, width - 6);
+}
+
+/**
+ * Reports the result of a finished export.
+ **/
+void check_running_export()
+{
+	if (!running_export || !ldif_export_finished(running_export))
+		return;
+
+	int result = ldif_export_join(running_export);
+	running_export = NULL;
+	if (result != LDAP_SUCCESS && result != LDAP_USER_CANCELLED)
+		ldap_show_error(ld, result, "ldif_export");
+}
+
+void draw_expand_progress(int row, int width)
+{
+	if (!expander || deleter || running_import || width < 8
+	    || __atomic_load_n(&export_stats.running, __ATOMIC_ACQUIRE))
+		return;
+
+	unsigned long listed;
+	unsigned pending;
+	expander_progress(expander, &listed, &pending);
+
+	char line[128];
+	snprintf(line, sizeof(line), " expand: %lu containers listed, %u to go ", listed, pending);
+	mvaddnstr(row, 2, line, width - 6);
+}
+
+/**
+ * Drops the finished expand to depth and its progress line.
+ **/
+void check_expand_levels()
+{
+	if (!expander || !expander_finished(expander))
+		return;
+
+	cancel_expand_levels();
+	int height, width;
+	getmaxyx(stdscr, height, width);
+	mvhline(height / 2, 0, 0, width);
+}
+
+/**
+ * Shows the entries deleted so far and the rate on the separator line.
+ **/
+void draw_delete_progress(int row, int width)
+{
+	if (!deleter || __atomic_load_n(&export_stats.running, __ATOMIC_ACQUIRE) || width < 8)
+		return;
+
+	DELETER_PROGRESS progress;
+	deleter_progress(deleter, &progress);
+
+	char line[128];
+	if (progress.phase == DELETER_DELETING)
+		snprintf(line, sizeof(line), " delete: %lu of %lu entries, %.0f entries/s ",
+			 progress.deleted, progress.found,
+			 progress.seconds > 0 ? progress.deleted / progress.seconds : 0);
+	else if (progress.phase == DELETER_TREE_DELETE)
+		snprintf(line, sizeof(line), " delete: subtree with the Tree Delete control, %.0f s ",
+			 progress.seconds);
+	else
+		snprintf(line, sizeof(line), " delete: listing, %lu entries found ", progress.found);
+
+	// the line of one phase may be shorter than that of the last
+	mvhline(row, 2, 0, width - 6);
+	mvaddnstr(row, 2, line, width - 6);
+}
+
+/**
+ * Reports the result of a finished subtree delete and drops its progress
+ * line.
+ **/
+void check_delete_subtree()
+{
+	if (!deleter || !deleter_finished(deleter))
+		return;
+
+	const char *failed_dn;
+	int result = deleter_result(deleter, &failed_dn);
+	if (result != LDAP_SUCCESS)
+	{
+		WINDOW *msg = show_message(ldap_err2string(result), failed_dn);
+		getch();
+		delwin(msg);
+		tree_dirty = true;
+		selection_pending = true;
+	}
+
+	cancel_delete_subtree();
+	prune_rows(true);
+	int height, width;
+	getmaxyx(stdscr, height, width);
+	mvhline(height / 2, 0, 0, width);
+}
+
+/**
+ * Shows the entries added and rejected so far on the separator line while
+ * an import runs.
+ **/
+void draw_import_progress(int row, int width)
 {
-	char *text = malloc(2000);
+	if (!__atomic_load_n(&import_stats.running, __ATOMIC_ACQUIRE)
+	    || __atomic_load_n(&export_stats.running, __ATOMIC_ACQUIRE) || deleter || width < 8)
+		return;
 
-	char *errstr = ldap_err2string(errno);
-	show_message("LDAP error occured", errstr);
-	getch();
+	double seconds = elapsed_ms(&import_stats.start) / 1000.0;
+	if (seconds <= 0)
+		seconds = 0.001;
+
+	// written by the import thread
+	unsigned long entries = __atomic_load_n(&import_stats.entries, __ATOMIC_RELAXED);
+	unsigned long rejected = __atomic_load_n(&import_stats.rejected, __ATOMIC_RELAXED);
+	size_t bytes = __atomic_load_n(&import_stats.bytes, __ATOMIC_RELAXED);
+
+	char line[128];
+	snprintf(line, sizeof(line), " import: %lu entries, %lu rejected, %.1f MB read, %.0f entries/s ",
+		 entries, rejected, bytes / 1048576.0, entries / seconds);
+	mvaddnstr(row, 2, line, width - 6);
 }
 
-void ldap_load_subtree_filtered(TREENODE * root, const char *filter)
+/**
+ * Shows an entry the import added below parent. Containers not listed yet
+ * (or listed through VLV) only count one more subordinate, a leaf becomes
+ * a container to expand. Containers with a content synchronization
+ * session learn about the entry from the server.
+ **/
+void import_show_added(TREENODE * parent, const char *dn)
 {
-	LDAPMessage *msg;
-	char *dn = node_dn(root);
-	int errno = ldap_search_s(ld, dn, LDAP_SCOPE_ONE, filter, NULL, 0, &msg);
-	if (errno != LDAP_SUCCESS)
+	for (SYNC_SESSION * s = sync_sessions; s; s = s->next)
 	{
-		ldap_show_error(ld, errno, "ldap_search_s");
+		if (s->node == parent)
+			return;
+	}
+
+	parent->num_subordinates++;
+	bool listed = parent->num_children > 0 && !parent->vlv_offset && parent != expand_node;
+	parent->is_leaf = false;
+	tree_dirty = true;
+	if (!listed)
 		return;
+
+	char *rdn = ldap_dn_rdn(dn);
+	if (rdn)
+	{
+		TREENODE *child = tree_node_alloc_child(parent, rdn);
+		child->is_leaf = true;
+		ldap_memfree(rdn);
 	}
+}
 
-	free(dn);
-	dn = NULL;
+/**
+ * Adds the rows of the entries imported since the last call and reports
+ * the result of a finished import.
+ **/
+void check_running_import()
+{
+	if (!running_import)
+		return;
 
-	tree_node_remove_childs(root);
+	bool finished = ldif_import_finished(running_import);
 
-	LDAPMessage *entry;
-	for (entry = ldap_first_entry(ld, msg); entry != NULL; entry = ldap_next_entry(ld, entry))
+	// usually many entries in a row share the parent
+	char *parent_dn = NULL;
+	TREENODE *parent = NULL;
+	TREENODE *current = treeview_current_node(treeview);
+	char *dn;
+	while ((dn = ldif_import_next_added(running_import)))
 	{
-		TREENODE *child = tree_node_alloc();
-		char *dn = ldap_get_dn(ld, entry);
-		char **dns = ldap_explode_dn(dn, 0);
-		free(dn);
-		dn = NULL;
-
-		// normalize to LDAPV2 to replace \2B by \+ (more readable)
-		char *rdnout = NULL;
-		if (ldap_dn_normalize(dns[0], LDAP_DN_FORMAT_LDAP, &rdnout, LDAP_DN_FORMAT_LDAPV2)
-		    != LDAP_SUCCESS)
+		const char *p = ldap_dn_parent(dn);
+		if (!parent_dn || strcasecmp(parent_dn, p) != 0)
 		{
-			ldap_show_error(ld, errno, "ldap_search_s");
-			return;
+			free(parent_dn);
+			parent_dn = strdup(p);
+			parent = tree_node_find(tree_root, parent_dn);
+			if (parent)
+				entry_cache_remove(cache, parent_dn);
 		}
-		ldap_value_free(dns);
-		dns = NULL;
+		if (parent)
+			import_show_added(parent, dn);
+		free(dn);
+	}
+	free(parent_dn);
+	// appending moves the rows below, keep the selection where it is
+	if (tree_dirty)
+		treeview_set_current(treeview, current);
 
-		child->value = rdnout;
-		tree_node_append_child(root, child);
+	if (!finished)
+		return;
+
+	int result = ldif_import_join(running_import);
+	running_import = NULL;
+	if (result != LDAP_SUCCESS && result != LDAP_USER_CANCELLED)
+		ldap_show_error(ld, result, "ldif_import");
+	else if (import_stats.rejected > 0)
+	{
+		char line[128];
+		snprintf(line, sizeof(line), "%lu entries were rejected, see", import_stats.rejected);
+		WINDOW *msg = show_message(line, import_reject_file);
+		getch();
+		delwin(msg);
 	}
+	free(import_reject_file);
+	import_reject_file = NULL;
 
-	ldap_msgfree(msg);
+	int height, width;
+	getmaxyx(stdscr, height, width);
+	mvhline(height / 2, 0, 0, width);
 }
 
-void ldap_load_subtree(TREENODE * root)
+void draw_spinner()
 {
-	ldap_load_subtree_filtered(root, "(objectClass=*)");
+	static const char frames[] = "|/-\\";
+	static unsigned frame = 0;
+
+	int height, width;
+	getmaxyx(stdscr, height, width);
+	draw_export_progress(height / 2, width);
+	draw_expand_progress(height / 2, width);
+	draw_delete_progress(height / 2, width);
+	draw_import_progress(height / 2, width);
+	if (worker && worker_busy(worker))
+		mvaddch(height / 2, width - 2, frames[frame++ % (sizeof(frames) - 1)]);
+	else
+		mvaddch(height / 2, width - 2, ACS_HLINE);
+	refresh();
 }
 
-void selection_changed(WINDOW * win, TREENODE * selection)
+/**
+ * Waits for the next key press while dispatching LDAP results as they
+ * arrive, so the tree fills in and the spinner keeps moving.
+ **/
+int wait_for_key()
 {
-	LDAPMessage *msg;
-	char *dn = node_dn(selection);
-	int errno = ldap_search_s(ld, dn, LDAP_SCOPE_BASE, "(objectClass=*)", attributes, 0, &msg);
-	if (errno != LDAP_SUCCESS)
+	// the user navigated away from what we were prefetching
+	unsigned current = treeview->currentItemIndex;
+	if (current < prefetch_first || current >= prefetch_last)
+		cancel_prefetch();
+
+	// only fetch the row the user stops on
+	if (selection_pending)
 	{
-		ldap_show_error(ld, errno, "ldap_search_s");
-		return;
+		timeout(SELECTION_DELAY_MS);
+		int c = getch();
+		timeout(-1);
+		if (c != ERR)
+			return c;
+
+		prune_rows(true);
+		selection_pending = false;
+		selection_changed(attrpad, treeview_current_node(treeview));
 	}
 
-	wclear(win);
-	attrpad_rows = 1;
-	waddstr(win, "dn: ");
-	waddstr(win, dn);
-	waddstr(win, "\n");
-
-	free(dn);
-	dn = NULL;
+	struct timespec idle_since;
+	clock_gettime(CLOCK_MONOTONIC, &idle_since);
+	bool prefetched = false;
 
-	BerElement *pber;
-	char *attr;
-	for (attr = ldap_first_attribute(ld, msg, &pber); attr != NULL;
-	     ldap_memfree(attr), attr = ldap_next_attribute(ld, msg, pber))
+	while (true)
 	{
-		char **values;
-		if (!(values = ldap_get_values(ld, msg, attr)))
+		timeout(0);
+		int c = getch();
+		timeout(-1);
+		if (c != ERR)
+			return c;
+
+		bool busy = worker && worker_busy(worker);
+		// poll() skips the negative descriptor when browsing a file
+		struct pollfd fds[] = {
+			{STDIN_FILENO, POLLIN, 0},
+			{worker ? worker_fd(worker) : -1, POLLIN, 0}
+		};
+		bool exporting = __atomic_load_n(&export_stats.running, __ATOMIC_ACQUIRE);
+		int wait_ms = busy || exporting || running_import ? SPINNER_INTERVAL_MS : -1;
+		if (!prefetched)
+			wait_ms = PREFETCH_DELAY_MS;
+		poll(fds, 2, wait_ms);
+
+		if (worker)
+			worker_process(worker, 0);
+		check_running_export();
+		check_expand_levels();
+		check_delete_subtree();
+		check_running_import();
+		prune_rows(false);
+		expand_prioritize_visible();
+		if (tree_dirty)
 		{
-			continue;
+			tree_dirty = false;
+			treeview_driver(treeview, 0);
 		}
 
-		for (unsigned i = 0; values[i]; i++)
+		if (!prefetched && elapsed_ms(&idle_since) >= PREFETCH_DELAY_MS)
 		{
-			waddstr(win, attr);
-			waddstr(win, ": ");
-			waddstr(win, values[i]);
-			waddstr(win, "\n");
-			attrpad_rows++;
+			prefetched = true;
+			if (!prefetches)
+				prefetch_neighbours();
 		}
-		ldap_value_free(values);
+
+		draw_spinner();
 	}
+}
 
-	ber_free(pber, 0);
-	ldap_msgfree(msg);
+/**
+ * Blocks until req completes, keeping the spinner moving.
+ **/
+int wait_for_request(WORKER_REQUEST * req)
+{
+	bool done = false;
+	int result = LDAP_SUCCESS;
+	worker_watch(req, &done, &result);
 
-	int height, width;
-	getmaxyx(stdscr, height, width);
-	int attrpad_height = height / 2 + 1;
+	while (!done)
+	{
+		worker_process(worker, SPINNER_INTERVAL_MS);
+		draw_spinner();
+	}
 
-	// limit scrolling
-	if (attrpad_toprow < 0)
-		attrpad_toprow = 0;
-	if (attrpad_toprow > attrpad_rows + 2 - attrpad_height)
-		attrpad_toprow = attrpad_rows + 2 - attrpad_height;
-	prefresh(win, attrpad_toprow, 0, attrpad_height, 0, height - 1, width - 1);
+	treeview_driver(treeview, 0);
+	return result;
 }
 
 struct INPUT_DIALOG input_dialog_create(const char *description, const char *placeholder)
@@ -308,22 +1754,29 @@ void filtered_search(TREENODE * selected_node)
 
 void ldap_save_subtree(TREENODE * selected_node)
 {
+	if (__atomic_load_n(&export_stats.running, __ATOMIC_ACQUIRE))
+	{
+		WINDOW *msg = show_message("An export is still running.", "");
+		getch();
+		delwin(msg);
+		return;
+	}
 
 	char *nameSuggestion = NULL;
-	char *dn = node_dn(selected_node);
-	char *rdn = string_before(dn, ',');
+	char *rdn = string_before(tree_node_dn(selected_node), ',');
 	asprintf(&nameSuggestion, "%s.ldif", string_after_last(rdn, '='));
-	free(dn);
-	dn = NULL;
 	free(rdn);
 	rdn = NULL;
 
 	char *filename = input_dialog("Save as:", nameSuggestion);
 	if (filename)
 	{
-		char *dn = node_dn(selected_node);
-		ldif_write(ld, filename, dn, attributes);
-		free(dn);
+		// on connections of its own, the browsing one stays free
+		running_export = ldif_export_start(&connect_params, export_connections, filename,
+						   export_shards, tree_node_dn(selected_node),
+						   attributes, page_size, &export_stats);
+		if (!running_export)
+			ldap_show_error(ld, LDAP_LOCAL_ERROR, "ldif_export_start");
 		free(filename);
 		filename = NULL;
 	}
@@ -333,32 +1786,52 @@ void ldap_save_subtree(TREENODE * selected_node)
 
 }
 
-TREENODE *ldap_delete_subtree(TREENODE * root, TREENODE * selected_node)
+/**
+ * Asks for an LDIF file and adds its entries in the background. Entries
+ * the server refuses go to the same file name with .rej appended.
+ **/
+void import_ldif()
 {
-	char *dn = node_dn(selected_node);
-	int errno = ldap_delete_s(ld, dn);
-	free(dn);
-	dn = NULL;
-
-	if (errno != LDAP_SUCCESS)
+	if (running_import)
 	{
-		ldap_show_error(ld, errno, "ldap_delete_s");
-		return NULL;
+		WINDOW *msg = show_message("An import is still running.", "");
+		getch();
+		delwin(msg);
+		return;
 	}
 
-	TREENODE *parent = tree_node_get_parent(root, selected_node);
-	if (parent)
+	char *filename = input_dialog("Import LDIF file:", "");
+	if (filename)
 	{
-		// reload
-		tree_node_remove_childs(parent);
-		ldap_load_subtree(parent);
-		treeview_set_tree(treeview, root);
-		treeview_set_current(treeview, parent);
-
-		selection_changed(attrpad, parent);
+		asprintf(&import_reject_file, "%s.rej", filename);
+		// on a connection of its own, like the export
+		running_import = ldif_import_start(&connect_params, filename, import_reject_file,
+						   import_window, true, &import_stats);
+		if (!running_import)
+		{
+			ldap_show_error(ld, LDAP_LOCAL_ERROR, "ldif_import_start");
+			free(import_reject_file);
+			import_reject_file = NULL;
+		}
+		free(filename);
+		filename = NULL;
 	}
+}
 
-	return parent;
+/**
+ * Tells the user that the key needs a server when browsing a file,
+ * returns true in that case.
+ **/
+bool refuse_offline()
+{
+	if (!ldif_index)
+		return false;
+
+	WINDOW *msg = show_message("Not available when browsing an LDIF file.", "");
+	getch();
+	delwin(msg);
+	treeview_driver(treeview, 0);
+	return true;
 }
 
 void resize()
@@ -391,8 +1864,10 @@ void render(TREENODE * root, void (expand_callback) (TREENODE *))
 	selection_changed(attrpad, treeview_current_node(treeview));
 
 	int c;
-	while ((c = getch()) != 'q')
+	while ((c = wait_for_key()) != 'q')
 	{
+		// keys act on the rows as shown
+		prune_rows(true);
 		TREENODE *selected_node = treeview_current_node(treeview);
 
 		switch (c)
@@ -401,52 +1876,54 @@ void render(TREENODE * root, void (expand_callback) (TREENODE *))
 			resize();
 			break;
 		case KEY_UP:
-			treeview_driver(treeview, REQ_UP_ITEM);
-			attrpad_toprow = 0;
-			selection_changed(attrpad, treeview_current_node(treeview));
-			break;
-
 		case KEY_DOWN:
-			treeview_driver(treeview, REQ_DOWN_ITEM);
+		case KEY_PPAGE:
+		case KEY_NPAGE:
+			{
+				int rows = treeview_navigation_rows(treeview, c)
+				    + treeview_drain_navigation(treeview);
+				if (!vlv_navigate(selected_node, rows))
+					treeview_move(treeview, rows);
+			}
 			attrpad_toprow = 0;
-			selection_changed(attrpad, treeview_current_node(treeview));
+			selection_pending = true;
 			break;
 
 		case 'o':
 			attrpad_toprow++;
-			selection_changed(attrpad, treeview_current_node(treeview));
+			attrpad_refresh(attrpad);
 			break;
 
 		case 'p':
 			attrpad_toprow--;
-			selection_changed(attrpad, treeview_current_node(treeview));
-			break;
-
-		case KEY_PPAGE:
-			treeview_driver(treeview, REQ_SCR_UPAGE);
-			selection_changed(attrpad, treeview_current_node(treeview));
-			break;
-
-		case KEY_NPAGE:
-			treeview_driver(treeview, REQ_SCR_DPAGE);
-			selection_changed(attrpad, treeview_current_node(treeview));
+			attrpad_refresh(attrpad);
 			break;
 
 		case KEY_RIGHT:
 			{
-				expand_callback(selected_node);
+				if (selected_node->is_leaf)
+					break;
+
+				// collapsed containers are still loaded
+				if (selected_node->collapsed)
+					uncollapse(selected_node);
+				else
+					expand_callback(selected_node);
 				treeview_driver(treeview, 0);
 				break;
 			}
 
 		case KEY_LEFT:
 			{
-				if (tree_node_children_count(selected_node) == 0)
+				if (tree_node_children_count(selected_node) == 0 || selected_node->collapsed)
 					selected_node = tree_node_get_parent(root, selected_node);
 
 				if (selected_node)
 				{
-					tree_node_remove_childs(selected_node);
+					// an expand still running is dropped, what is loaded only hidden
+					cancel_expand(selected_node);
+					if (tree_node_children_count(selected_node) > 0)
+						collapse(selected_node);
 
 					treeview_set_tree(treeview, root);
 					treeview_set_current(treeview, selected_node);
@@ -456,14 +1933,26 @@ void render(TREENODE * root, void (expand_callback) (TREENODE *))
 
 		case 'D':
 			{
-				char *dn = node_dn(selected_node);
-				WINDOW *msg =
+				if (refuse_offline())
+					break;
+
+				bool running = deleter != NULL;
+				WINDOW *msg = running ?
+				    show_message("a delete is still running, cancel it? (y/n)", "") :
 				    show_message
-				    ("do you really want to delete the following DN? (y/n)", dn);
-				free(dn);
-				dn = NULL;
+				    ("do you really want to delete the following DN and everything below it? (y/n)",
+				     tree_node_dn(selected_node));
 				if (getch() == 'y')
-					selected_node = ldap_delete_subtree(root, selected_node);
+				{
+					if (running)
+					{
+						cancel_delete_subtree();
+						int height, width;
+						getmaxyx(stdscr, height, width);
+						mvhline(height / 2, 0, 0, width);
+					} else
+						delete_subtree(selected_node);
+				}
 
 				delwin(msg);
 				treeview_driver(treeview, 0);
@@ -474,6 +1963,9 @@ void render(TREENODE * root, void (expand_callback) (TREENODE *))
 
 		case 's':
 			{
+				if (refuse_offline())
+					break;
+
 				ldap_save_subtree(selected_node);
 
 				treeview_driver(treeview, 0);
@@ -481,24 +1973,254 @@ void render(TREENODE * root, void (expand_callback) (TREENODE *))
 			}
 			break;
 
+		case 'i':
+			{
+				if (refuse_offline())
+					break;
+
+				import_ldif();
+
+				treeview_driver(treeview, 0);
+				selection_changed(attrpad, treeview_current_node(treeview));
+			}
+			break;
+
 		case 'f':
 			{
+				if (refuse_offline())
+					break;
+
 				filtered_search(treeview_current_node(treeview));
 				treeview_driver(treeview, 0);
 				selection_changed(attrpad, treeview_current_node(treeview));
 			}
 			break;
+
+		case 'e':
+			{
+				if (selected_node->is_leaf || refuse_offline())
+					break;
+
+				char *levels = input_dialog("Expand levels:", "3");
+				if (levels)
+				{
+					if (atoi(levels) > 0)
+						expand_levels(selected_node, atoi(levels));
+					free(levels);
+				}
+				treeview_driver(treeview, 0);
+			}
+			break;
+
+		case 'j':
+			{
+				TREENODE *container =
+				    selected_node->vlv_offset ? selected_node : selected_node->parent;
+				if (!container || !container->vlv_offset)
+					break;
+
+				char *target = input_dialog("Jump to position or name:", "");
+				if (target)
+				{
+					vlv_jump(container, target);
+					free(target);
+				}
+				treeview_driver(treeview, 0);
+			}
+			break;
 		}
 
 		getmaxyx(stdscr, height, width);
 		mvhline(height / 2, 0, 0, width);
+		draw_spinner();
 	}
 
+	// the snapshot saves what is left
+	prune_rows(true);
 	treeview_free(treeview);
 	treeview = NULL;
 
 }
 
+enum BATCH_MODE { BATCH_NONE, BATCH_EXPORT, BATCH_IMPORT, BATCH_LIST, BATCH_COUNT };
+
+/**
+ * Prints the statistics of a batch run as key=value pairs on stderr.
+ **/
+void batch_report(const char *operation, unsigned long entries, size_t bytes,
+		  struct timespec *start, int result)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double seconds = (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	fprintf(stderr,
+		"operation=%s result=%d entries=%lu bytes=%zu seconds=%.3f entries_per_second=%.0f"
+		" mb_per_second=%.2f max_rss_kb=%ld\n", operation, result, entries, bytes, seconds,
+		seconds > 0 ? entries / seconds : 0, seconds > 0 ? bytes / 1048576.0 / seconds : 0,
+		usage.ru_maxrss);
+}
+
+void batch_count_entry(WORKER_ENTRY * e, void *ctx)
+{
+	unsigned long *count = ctx;
+	(*count)++;
+}
+
+/**
+ * Runs one operation on dn without the user interface: lists its children,
+ * counts the entries of its subtree, exports the subtree to filename or
+ * imports filename (dn unused). Returns the LDAP result, which is not
+ * LDAP_SUCCESS if the import rejected entries.
+ **/
+int batch_run(enum BATCH_MODE mode, const char *dn, const char *filename)
+{
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	int result = LDAP_SUCCESS;
+
+	if (mode == BATCH_LIST)
+	{
+		TREENODE *root = tree_node_alloc();
+		root->value = strdup(dn);
+
+		ldap_load_subtree_filtered(root, "(objectClass=*)");
+		while (expand_request)
+			worker_process(worker, -1);
+
+		size_t bytes = 0;
+		for (unsigned i = 0; i < root->num_children; i++)
+		{
+			int n = printf("%s\n", tree_node_dn(root->children[i]));
+			bytes += n > 0 ? n : 0;
+		}
+		fflush(stdout);
+
+		// expand_done() already reported errors
+		result = expand_result;
+		batch_report("list", root->num_children, bytes, &start, result);
+		sync_stop(root);
+		tree_node_free(root);
+	} else if (mode == BATCH_COUNT)
+	{
+		static char *no_attributes[] = { LDAP_NO_ATTRS, NULL };
+		unsigned long count = 0;
+		WORKER_REQUEST *req;
+
+		worker_search(worker, dn, LDAP_SCOPE_SUB, "(objectClass=*)", no_attributes, page_size,
+			      batch_count_entry, NULL, &count, &req);
+		result = worker_wait(worker, req);
+		if (result != LDAP_SUCCESS)
+			ldap_show_error(ld, result, "ldap_search_ext");
+		else
+			printf("%lu\n", count);
+
+		batch_report("count", count, 0, &start, result);
+	} else if (mode == BATCH_IMPORT)
+	{
+		char *reject_filename = NULL;
+		asprintf(&reject_filename, "%s.rej", filename);
+		LDIF_IMPORT *import = ldif_import_start(&connect_params, filename, reject_filename,
+							import_window, false, &import_stats);
+		result = import ? ldif_import_join(import) : LDAP_LOCAL_ERROR;
+		if (result != LDAP_SUCCESS)
+			ldap_show_error(ld, result, "ldif_import");
+
+		batch_report("import", import_stats.entries, import_stats.bytes, &start, result);
+		if (import_stats.rejected > 0)
+		{
+			fprintf(stderr, "%lu entries rejected, see %s\n", import_stats.rejected,
+				reject_filename);
+			// so scripts notice
+			if (result == LDAP_SUCCESS)
+				result = LDAP_OTHER;
+		}
+		free(reject_filename);
+	} else
+	{
+		LDIF_EXPORT *export = ldif_export_start(&connect_params, export_connections, filename,
+							export_shards, dn, attributes, page_size,
+							&export_stats);
+		result = export ? ldif_export_join(export) : LDAP_LOCAL_ERROR;
+		if (result != LDAP_SUCCESS)
+			ldap_show_error(ld, result, "ldif_export");
+
+		batch_report("export", export_stats.entries, export_stats.bytes, &start, result);
+	}
+
+	return result;
+}
+
+/**
+ * Takes the base from the first naming context of the root DSE.
+ **/
+void naming_context_received(WORKER_ENTRY * e, void *ctx)
+{
+	char **base = ctx;
+	ENTRY_ATTRIBUTE *attr = e->entry ? entry_get_attribute(e->entry, "namingContexts") : NULL;
+	if (!*base && attr && attr->num_values > 0)
+		*base = strdup(attr->values[0].data);
+}
+
+/**
+ * Browses the LDIF file filename without a server, starting at base or,
+ * without one, at the top entry of the file (at the empty DN if it has
+ * several). Returns the exit status.
+ **/
+int browse_file(const char *filename, const char *base)
+{
+	ldif_index = ldif_index_open(filename);
+	if (!ldif_index)
+	{
+		perror(filename);
+		return EXIT_FAILURE;
+	}
+
+	if (base && *base && ldif_index_find(ldif_index, base) == LDIF_INDEX_NONE)
+	{
+		fprintf(stderr, "%s is not in %s\n", base, filename);
+		ldif_index_close(ldif_index);
+		ldif_index = NULL;
+		return EXIT_FAILURE;
+	}
+
+	TREENODE *root = tree_node_alloc();
+	tree_root = root;
+	unsigned count;
+	const unsigned *top = ldif_index_children(ldif_index, ldif_index_count(ldif_index), &count);
+	if (base)
+		root->value = strdup(base);
+	else if (count == 1)
+	{
+		ARENA *arena = arena_alloc();
+		root->value = strdup(ldif_index_name(ldif_index, top[0], arena));
+		arena_free(arena);
+	} else
+		root->value = strdup("");
+
+	// the server side list window does not apply
+	vlv_threshold = 0;
+	cache = entry_cache_init(cache_size, cache_ttl);
+
+	curses_init();
+	ldap_load_subtree(root);
+	render(root, ldap_load_subtree);
+	endwin();
+
+	while (collapsed)
+		collapsed_forget(collapsed->dn);
+	entry_cache_free(cache);
+	cache = NULL;
+	tree_node_free(root);
+	tree_root = NULL;
+	ldif_index_close(ldif_index);
+	ldif_index = NULL;
+	return EXIT_SUCCESS;
+}
+
 int main(int argc, char *argv[])
 {
 	char *ldap_host = "127.0.0.1";
@@ -508,10 +2230,21 @@ int main(int argc, char *argv[])
 	unsigned port = 389;
 	char *ldap_uri = NULL;
 	int deref = LDAP_DEREF_NEVER;
+	enum BATCH_MODE batch_mode = BATCH_NONE;
+	char *batch_dn = NULL, *batch_file = NULL;
+	char *ldif_file = NULL;
+
+	static struct option long_options[] = {
+		{"export", required_argument, NULL, 'X'},
+		{"import", required_argument, NULL, 'I'},
+		{"list", required_argument, NULL, 'L'},
+		{"count", required_argument, NULL, 'C'},
+		{NULL, 0, NULL, 0}
+	};
 
 	while (true)
 	{
-		char c = getopt(argc, argv, "H:h:p:w:D:b:a:");
+		int c = getopt_long(argc, argv, "H:h:p:w:D:b:a:E:o:f:", long_options, NULL);
 
 		if (c == -1)	// check for end of options
 			break;
@@ -539,6 +2272,10 @@ int main(int argc, char *argv[])
 			bind_dn = optarg;
 			break;
 
+		case 'f':
+			ldif_file = optarg;
+			break;
+
 		case 'b':
 			base = strdup(optarg);
 			break;
@@ -564,9 +2301,93 @@ int main(int argc, char *argv[])
 
 			break;
 
+		case 'E':
+			if (strncasecmp("pr=", optarg, 3) == 0)
+			{
+				page_size = atoi(optarg + 3);
+			} else
+			{
+				fprintf(stderr, "%s is not a supported search extension\n", optarg);
+				exit(-1);
+			}
+
+			break;
+
+		case 'o':
+			if (strncasecmp("cache-size=", optarg, 11) == 0)
+			{
+				cache_size = (size_t) atoi(optarg + 11) << 20;
+			} else if (strncasecmp("tree-cache-size=", optarg, 16) == 0)
+			{
+				tree_cache_size = (size_t) atoi(optarg + 16) << 20;
+			} else if (strncasecmp("cache-ttl=", optarg, 10) == 0)
+			{
+				cache_ttl = atoi(optarg + 10);
+			} else if (strncasecmp("vlv-threshold=", optarg, 14) == 0)
+			{
+				vlv_threshold = atoi(optarg + 14);
+			} else if (strncasecmp("vlv-sort=", optarg, 9) == 0)
+			{
+				vlv_sort_key = optarg + 9;
+			} else if (strncasecmp("expand-concurrency=", optarg, 19) == 0)
+			{
+				expand_concurrency = atoi(optarg + 19);
+			} else if (strncasecmp("delete-window=", optarg, 14) == 0)
+			{
+				delete_window = atoi(optarg + 14);
+			} else if (strncasecmp("import-window=", optarg, 14) == 0)
+			{
+				import_window = atoi(optarg + 14);
+			} else if (strncasecmp("export-connections=", optarg, 19) == 0)
+			{
+				export_connections = atoi(optarg + 19);
+			} else if (strcasecmp("export-shards", optarg) == 0)
+			{
+				export_shards = true;
+			} else if (strcasecmp("snapshot", optarg) == 0)
+			{
+				snapshot = true;
+			} else if (strcasecmp("sync", optarg) == 0)
+			{
+				sync_enabled = true;
+			} else
+			{
+				fprintf(stderr, "%s is not a valid general option\n", optarg);
+				exit(-1);
+			}
+
+			break;
+
+		case 'X':
+			// --export DN FILE
+			if (optind >= argc)
+			{
+				fprintf(stderr, "--export needs a DN and a file name\n");
+				exit(-1);
+			}
+			batch_mode = BATCH_EXPORT;
+			batch_dn = optarg;
+			batch_file = argv[optind++];
+			break;
+
+		case 'I':
+			batch_mode = BATCH_IMPORT;
+			batch_file = optarg;
+			break;
+
+		case 'L':
+			batch_mode = BATCH_LIST;
+			batch_dn = optarg;
+			break;
+
+		case 'C':
+			batch_mode = BATCH_COUNT;
+			batch_dn = optarg;
+			break;
+
 		default:
 			fprintf(stderr,
-				"USAGE: %s [-H ldapuri] [-D binddn] [-w passwd] [-h ldaphost] [-p ldapport] [-b searchbase] [-a {never|always|search|find}] [attributes...]\n",
+				"USAGE: %s [--export DN FILE | --import FILE | --list DN | --count DN] [-f file.ldif] [-H ldapuri] [-D binddn] [-w passwd] [-h ldaphost] [-p ldapport] [-b searchbase] [-a {never|always|search|find}] [-E pr=pagesize] [-o cache-size=MB] [-o cache-ttl=seconds] [-o tree-cache-size=MB] [-o vlv-threshold=N] [-o vlv-sort=attribute] [-o expand-concurrency=N] [-o delete-window=N] [-o import-window=N] [-o export-connections=N] [-o export-shards] [-o snapshot] [-o sync] [attributes...]\n",
 				argv[0]);
 			exit(-1);
 		}
@@ -577,6 +2398,19 @@ int main(int argc, char *argv[])
 		attributes = argv + optind;
 	}
 
+	if (ldif_file)
+	{
+		if (batch_mode != BATCH_NONE)
+		{
+			fprintf(stderr, "batch operations need a server, not -f\n");
+			exit(-1);
+		}
+
+		int result = browse_file(ldif_file, base);
+		free(base);
+		return result;
+	}
+
 	if (ldap_uri == NULL)
 	{
 		asprintf(&ldap_uri, "ldap://%s:%d", ldap_host, port);
@@ -585,65 +2419,64 @@ int main(int argc, char *argv[])
 		ldap_uri = strdup(ldap_uri);
 	}
 
-	if (ldap_initialize(&ld, ldap_uri) != LDAP_SUCCESS)
-	{
-		ldap_perror(ld, "ldap_initialize failed");
-		exit(EXIT_FAILURE);
-	}
+	connect_params.uri = ldap_uri;
+	connect_params.bind_dn = bind_dn;
+	connect_params.passwd = passwd;
+	connect_params.deref = deref;
 
-	int version = LDAP_VERSION3;
-	if (ldap_set_option(ld, LDAP_OPT_PROTOCOL_VERSION, &version) != LDAP_OPT_SUCCESS)
+	LDAP *connection;
+	int errno = connection_open(&connect_params, &connection);
+	if (errno != LDAP_SUCCESS)
 	{
-		ldap_perror(ld, "ldap_set_option");
+		fprintf(stderr, "ldap_bind: %s\n", ldap_err2string(errno));
 		exit(EXIT_FAILURE);
 	}
 
-	if (ldap_set_option(ld, LDAP_OPT_DEREF, &deref) != LDAP_OPT_SUCCESS)
+	// from here on only the worker thread talks to the server
+	worker = worker_start(connection);
+	if (!worker || ldap_initialize(&ld, NULL) != LDAP_SUCCESS)
 	{
-		ldap_perror(ld, "ldap_set_option");
+		fprintf(stderr, "could not start the connection thread\n");
 		exit(EXIT_FAILURE);
 	}
 
-	int msgid = 0;
-	if (ldap_sasl_bind(ld, bind_dn, LDAP_SASL_SIMPLE, &passwd, NULL, NULL, &msgid) !=
-	    LDAP_SUCCESS)
+	if (batch_mode != BATCH_NONE)
 	{
-		ldap_perror(ld, "ldap_bind");
-		exit(EXIT_FAILURE);
+		// the VLV window follows the screen size
+		headless = true;
+		vlv_threshold = 0;
+
+		int result = batch_run(batch_mode, batch_dn, batch_file);
+
+		worker_stop(worker);
+		worker = NULL;
+		ldap_unbind_ext(ld, NULL, NULL);
+		free(ldap_uri);
+		return result == LDAP_SUCCESS ? EXIT_SUCCESS : EXIT_FAILURE;
 	}
 
-	LDAPMessage *msg;
+	// a snapshot saved without -b also stands in for the root DSE query
+	const char *snapshot_base = base ? base : "";
+	char *snapshot_file = snapshot ? snapshot_path(ldap_uri, snapshot_base) : NULL;
+	cache = entry_cache_init(cache_size, cache_ttl);
+	TREENODE *root = tree_node_alloc();
+	tree_root = root;
+	bool restored = snapshot_file
+	    && snapshot_load(snapshot_file, ldap_uri, snapshot_base, root, cache);
+	if (restored && !base)
+		base = strdup(root->value);
+
 	if (!base)
 	{
-		char **values;
-
-		if (ldap_search_s(ld, "", LDAP_SCOPE_ONE, "(objectClass=*)", NULL, 0, &msg) !=
-		    LDAP_SUCCESS)
+		WORKER_REQUEST *req;
+		worker_search(worker, "", LDAP_SCOPE_ONE, "(objectClass=*)", NULL, 0,
+			      naming_context_received, NULL, &base, &req);
+		errno = worker_wait(worker, req);
+		if (errno != LDAP_SUCCESS)
 		{
-			ldap_perror(ld, "ldap_get_values");
+			fprintf(stderr, "ldap_search: %s\n", ldap_err2string(errno));
 			exit(EXIT_FAILURE);
 		}
-
-		if (!(values = ldap_get_values(ld, msg, "namingContexts")))
-		{
-			ldap_perror(ld, "ldap_get_values");
-		}
-
-		if (values)
-		{
-			base = strdup(values[0]);
-		}
-
-		for (unsigned i = 0; values && values[i]; i++)
-		{
-			free(values[i]);
-			values[i] = NULL;
-		}
-		free(values);
-		values = NULL;
-
-		ldap_msgfree(msg);
-		msg = NULL;
 	}
 
 	if (!base)
@@ -652,20 +2485,59 @@ int main(int argc, char *argv[])
 		exit(EXIT_FAILURE);
 	}
 
-	TREENODE *root = tree_node_alloc();
-	root->value = strdup(base);
-
-	ldap_load_subtree(root);
+	if (!restored)
+		root->value = strdup(base);
 
 	curses_init();
 
+	if (restored)
+		collapse_restored(root);
+	if (restored && root->num_children > 0)
+		revalidate_start(root);
+	else
+		ldap_load_subtree(root);
+
 	render(root, ldap_load_subtree);
 
 	endwin();
 
-	tree_node_remove_childs(root);
-	free(root->value);
-	free(root);
+	cancel_revalidation();
+	cancel_expand_levels();
+	cancel_delete_subtree();
+	sync_stop(root);
+	while (collapsed)
+		collapsed_forget(collapsed->dn);
+	if (snapshot_file)
+	{
+		cancel_expand(NULL);
+		if (!snapshot_save(snapshot_file, ldap_uri, snapshot_base, root, cache))
+			fprintf(stderr, "could not save snapshot %s\n", snapshot_file);
+		free(snapshot_file);
+	}
+
+	if (running_export)
+	{
+		ldif_export_cancel(running_export);
+		ldif_export_join(running_export);
+		running_export = NULL;
+	}
+	if (running_import)
+	{
+		ldif_import_cancel(running_import);
+		ldif_import_join(running_import);
+		running_import = NULL;
+	}
+	free(import_reject_file);
+	import_reject_file = NULL;
+
+	worker_stop(worker);
+	worker = NULL;
+	ldap_unbind_ext(ld, NULL, NULL);
+	ld = NULL;
+	entry_cache_free(cache);
+	cache = NULL;
+
+	tree_node_free(root);
 	root = NULL;
 
 	free(base);
@@ -0,0 +1,59 @@
+#include "ldapentry.h"
+
+ENTRY *ldap_entry_decode(LDAP * ld, LDAPMessage * msg)
+{
+	char *dn = ldap_get_dn(ld, msg);
+	ENTRY *e = entry_alloc(dn ? dn : "");
+	ldap_memfree(dn);
+
+	BerElement *pber;
+	char *attr;
+	for (attr = ldap_first_attribute(ld, msg, &pber); attr != NULL;
+	     ldap_memfree(attr), attr = ldap_next_attribute(ld, msg, pber))
+	{
+		struct berval **values;
+		if (!(values = ldap_get_values_len(ld, msg, attr)))
+		{
+			continue;
+		}
+
+		entry_add_attribute(e, attr);
+		for (unsigned i = 0; values[i]; i++)
+			entry_add_value(e, values[i]->bv_val, values[i]->bv_len);
+		ldap_value_free_len(values);
+	}
+	ber_free(pber, 0);
+
+	return e;
+}
+
+char *ldap_dn_rdn(const char *dn)
+{
+	char **dns = ldap_explode_dn(dn, 0);
+	if (!dns || !dns[0])
+	{
+		ldap_value_free(dns);
+		return NULL;
+	}
+
+	char *rdnout = NULL;
+	int rc = ldap_dn_normalize(dns[0], LDAP_DN_FORMAT_LDAP, &rdnout, LDAP_DN_FORMAT_LDAPV2);
+	ldap_value_free(dns);
+	return rc == LDAP_SUCCESS ? rdnout : NULL;
+}
+
+const char *ldap_dn_parent(const char *dn)
+{
+	const char *c = dn;
+	for (; *c && *c != ','; c++)
+	{
+		if (*c == '\\' && c[1])
+			c++;
+	}
+
+	if (*c == ',')
+		c++;
+	while (*c == ' ')
+		c++;
+	return c;
+}
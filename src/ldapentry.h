@@ -0,0 +1,20 @@
+#pragma once
+#include <ldap.h>
+#include "entry.h"
+
+/**
+ * Decodes a search result entry, keeping binary values intact.
+ **/
+ENTRY *ldap_entry_decode(LDAP * ld, LDAPMessage * msg);
+
+/**
+ * Returns the first RDN of dn in LDAPv2 form (\+ instead of \2B, more
+ * readable), NULL if dn cannot be parsed. Free with ldap_memfree().
+ **/
+char *ldap_dn_rdn(const char *dn);
+
+/**
+ * Returns the DN of the parent of dn: the rest of dn after its first RDN,
+ * the empty string if dn has only one.
+ **/
+const char *ldap_dn_parent(const char *dn);
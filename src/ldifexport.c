@@ -0,0 +1,409 @@
+#include "ldifexport.h"
+#include "async.h"
+
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// branches deeper than this are exported with a single subtree search
+#define EXPORT_MAX_SPLIT_DEPTH 3
+// searches in flight per connection, so small branches do not wait on round trips
+#define EXPORT_PIPELINE 8
+#define EXPORT_POLL_MS 100
+
+typedef enum { JOB_BASE, JOB_LIST, JOB_SUBTREE } JOB_TYPE;
+
+typedef struct BRANCH_S {
+	char *dn;
+	unsigned depth;
+	struct BRANCH_S *next;
+} BRANCH;
+
+typedef struct SHARD_S {
+	struct LDIF_EXPORT_S *export;
+	LDAP *ld;
+	ASYNC *async;
+	LDIF_WRITER *writer;
+	unsigned outstanding;	// searches in flight
+} SHARD;
+
+typedef struct JOB_S {
+	SHARD *shard;
+	JOB_TYPE type;
+	BRANCH *branch;
+} JOB;
+
+struct LDIF_EXPORT_S {
+	CONNECTION_PARAMS params;
+	char *filename;
+	bool split_files;
+	char *dn;
+	char **attributes;
+	int page_size;
+	LDIF_STATS *stats;
+	LDIF_STATS own_stats;
+	unsigned num_shards;
+	SHARD *shards;
+	BRANCH *queue_head, *queue_tail;	// branches waiting for a connection
+	unsigned queue_len;
+	int result;
+	bool cancelled;
+	bool finished;
+	pthread_t thread;
+};
+
+static char *string_dup_or_null(const char *s)
+{
+	return s ? strdup(s) : NULL;
+}
+
+static void branch_free(BRANCH * branch)
+{
+	free(branch->dn);
+	free(branch);
+}
+
+static void ldif_export_queue(LDIF_EXPORT * export, const char *dn, unsigned depth)
+{
+	BRANCH *branch = calloc(1, sizeof(BRANCH));
+	branch->dn = strdup(dn);
+	branch->depth = depth;
+
+	if (export->queue_tail)
+		export->queue_tail->next = branch;
+	else
+		export->queue_head = branch;
+	export->queue_tail = branch;
+	export->queue_len++;
+}
+
+static BRANCH *ldif_export_dequeue(LDIF_EXPORT * export)
+{
+	BRANCH *branch = export->queue_head;
+	export->queue_head = branch->next;
+	if (!export->queue_head)
+		export->queue_tail = NULL;
+	export->queue_len--;
+	branch->next = NULL;
+	return branch;
+}
+
+/**
+ * Inserts ".<number>" before the extension of filename.
+ **/
+static char *shard_filename(const char *filename, unsigned number)
+{
+	const char *slash = strrchr(filename, '/');
+	const char *dot = strrchr(filename, '.');
+	size_t stem = dot && (!slash || dot > slash) ? (size_t) (dot - filename) : strlen(filename);
+
+	size_t size = strlen(filename) + 16;
+	char *result = malloc(size);
+	snprintf(result, size, "%.*s.%u%s", (int)stem, filename, number, filename + stem);
+	return result;
+}
+
+static void job_entry(LDAP * ld, LDAPMessage * entry, void *ctx)
+{
+	JOB *job = ctx;
+
+	if (job->type == JOB_SUBTREE)
+	{
+		// the branch entry itself was written when its parent was listed
+		char *dn = ldap_get_dn(ld, entry);
+		bool is_branch = dn && strcasecmp(dn, job->branch->dn) == 0;
+		ldap_memfree(dn);
+		if (is_branch)
+			return;
+	}
+
+	ldif_writer_entry(job->shard->writer, ld, entry);
+
+	if (job->type == JOB_LIST)
+	{
+		char *dn = ldap_get_dn(ld, entry);
+		if (dn)
+			ldif_export_queue(job->shard->export, dn, job->branch->depth + 1);
+		ldap_memfree(dn);
+	}
+}
+
+static void job_done(LDAP * ld, int result, void *ctx)
+{
+	JOB *job = ctx;
+	LDIF_EXPORT *export = job->shard->export;
+
+	if (result != LDAP_SUCCESS && export->result == LDAP_SUCCESS)
+	{
+		// an incomplete export is useless, stop the others too
+		export->result = result;
+		__atomic_store_n(&export->cancelled, true, __ATOMIC_RELAXED);
+	}
+
+	// children are only searched once their parent has been written
+	if (job->type == JOB_BASE && result == LDAP_SUCCESS)
+		ldif_export_queue(export, export->dn, 0);
+
+	job->shard->outstanding--;
+	branch_free(job->branch);
+	free(job);
+}
+
+static int ldif_export_search(SHARD * shard, JOB_TYPE type, BRANCH * branch)
+{
+	static const int scopes[] = { LDAP_SCOPE_BASE, LDAP_SCOPE_ONE, LDAP_SCOPE_SUB };
+	LDIF_EXPORT *export = shard->export;
+
+	JOB *job = calloc(1, sizeof(JOB));
+	job->shard = shard;
+	job->type = type;
+	job->branch = branch;
+
+	int rc = async_search(shard->async, branch->dn, scopes[type], "(objectClass=*)",
+			      export->attributes, type == JOB_BASE ? 0 : export->page_size,
+			      job_entry, job_done, job, NULL);
+	if (rc != LDAP_SUCCESS)
+	{
+		branch_free(branch);
+		free(job);
+		return rc;
+	}
+
+	shard->outstanding++;
+	return LDAP_SUCCESS;
+}
+
+static unsigned ldif_export_idle_shards(LDIF_EXPORT * export)
+{
+	unsigned idle = 0;
+	for (unsigned i = 0; i < export->num_shards; i++)
+		idle += export->shards[i].outstanding == 0;
+	return idle;
+}
+
+static SHARD *ldif_export_least_busy(LDIF_EXPORT * export)
+{
+	SHARD *result = &export->shards[0];
+	for (unsigned i = 1; i < export->num_shards; i++)
+		if (export->shards[i].outstanding < result->outstanding)
+			result = &export->shards[i];
+	return result;
+}
+
+/**
+ * Hands queued branches to the least busy connections. A branch is listed
+ * (its children written and queued as branches of their own) at the top
+ * level and while connections would otherwise stay idle; else its whole
+ * subtree is fetched with one search.
+ **/
+static int ldif_export_dispatch(LDIF_EXPORT * export)
+{
+	while (export->queue_head)
+	{
+		SHARD *shard = ldif_export_least_busy(export);
+		if (shard->outstanding >= EXPORT_PIPELINE)
+			break;
+
+		unsigned idle = ldif_export_idle_shards(export);
+		BRANCH *branch = ldif_export_dequeue(export);
+		bool split = branch->depth == 0 || (branch->depth < EXPORT_MAX_SPLIT_DEPTH
+						    && export->queue_len + 1 < idle);
+
+		int rc = ldif_export_search(shard, split ? JOB_LIST : JOB_SUBTREE, branch);
+		if (rc != LDAP_SUCCESS)
+			return rc;
+	}
+
+	return LDAP_SUCCESS;
+}
+
+static int ldif_export_open(LDIF_EXPORT * export)
+{
+	for (unsigned i = 0; i < export->num_shards; i++)
+	{
+		SHARD *shard = &export->shards[i];
+		shard->export = export;
+
+		int rc = connection_open(&export->params, &shard->ld);
+		if (rc != LDAP_SUCCESS)
+			return rc;
+		shard->async = async_init(shard->ld);
+
+		if (i == 0 || export->split_files)
+		{
+			char *filename =
+			    export->split_files ? shard_filename(export->filename,
+								 i) : strdup(export->filename);
+			shard->writer = ldif_writer_open(filename, export->stats);
+			free(filename);
+			if (!shard->writer)
+				return LDAP_LOCAL_ERROR;
+		} else
+		{
+			shard->writer = export->shards[0].writer;
+		}
+	}
+
+	return LDAP_SUCCESS;
+}
+
+static int ldif_export_close(LDIF_EXPORT * export)
+{
+	int result = LDAP_SUCCESS;
+
+	for (unsigned i = 0; i < export->num_shards; i++)
+	{
+		SHARD *shard = &export->shards[i];
+
+		// abandons what is still running
+		if (shard->async)
+			async_free(shard->async);
+		shard->async = NULL;
+		if (shard->ld)
+			ldap_unbind_ext(shard->ld, NULL, NULL);
+		shard->ld = NULL;
+
+		if (shard->writer && (i == 0 || export->split_files))
+		{
+			int rc = ldif_writer_close(shard->writer);
+			if (result == LDAP_SUCCESS)
+				result = rc;
+		}
+		shard->writer = NULL;
+	}
+
+	while (export->queue_head)
+		branch_free(ldif_export_dequeue(export));
+
+	return result;
+}
+
+static void *ldif_export_run(void *arg)
+{
+	LDIF_EXPORT *export = arg;
+
+	int rc = ldif_export_open(export);
+
+	// the top entry goes first, then its children are spread over the pool
+	if (rc == LDAP_SUCCESS)
+	{
+		BRANCH *top = calloc(1, sizeof(BRANCH));
+		top->dn = strdup(export->dn);
+		rc = ldif_export_search(&export->shards[0], JOB_BASE, top);
+	}
+
+	struct pollfd *fds = calloc(export->num_shards, sizeof(struct pollfd));
+	while (rc == LDAP_SUCCESS && !__atomic_load_n(&export->cancelled, __ATOMIC_RELAXED))
+	{
+		rc = ldif_export_dispatch(export);
+		if (rc != LDAP_SUCCESS || ldif_export_idle_shards(export) == export->num_shards)
+			break;
+
+		for (unsigned i = 0; i < export->num_shards; i++)
+		{
+			SHARD *shard = &export->shards[i];
+			fds[i].fd = shard->outstanding ? async_fd(shard->async) : -1;
+			fds[i].events = POLLIN;
+			fds[i].revents = 0;
+		}
+		poll(fds, export->num_shards, EXPORT_POLL_MS);
+
+		for (unsigned i = 0; i < export->num_shards; i++)
+			if (fds[i].revents)
+				async_process(export->shards[i].async, 0);
+	}
+	free(fds);
+
+	if (export->result == LDAP_SUCCESS)
+		export->result = rc;
+	if (export->result == LDAP_SUCCESS && __atomic_load_n(&export->cancelled, __ATOMIC_RELAXED))
+		export->result = LDAP_USER_CANCELLED;
+
+	rc = ldif_export_close(export);
+	if (export->result == LDAP_SUCCESS)
+		export->result = rc;
+
+	__atomic_store_n(&export->stats->running, false, __ATOMIC_RELEASE);
+	__atomic_store_n(&export->finished, true, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+static void ldif_export_free(LDIF_EXPORT * export)
+{
+	free(export->params.uri);
+	free(export->params.bind_dn);
+	free(export->params.passwd.bv_val);
+	free(export->filename);
+	free(export->dn);
+	for (unsigned i = 0; export->attributes && export->attributes[i]; i++)
+		free(export->attributes[i]);
+	free(export->attributes);
+	free(export->shards);
+	free(export);
+}
+
+LDIF_EXPORT *ldif_export_start(const CONNECTION_PARAMS * params, unsigned connections,
+			       const char *filename, bool split_files, const char *dn,
+			       char **attributes, int page_size, LDIF_STATS * stats)
+{
+	LDIF_EXPORT *export = calloc(1, sizeof(LDIF_EXPORT));
+	export->params.uri = string_dup_or_null(params->uri);
+	export->params.bind_dn = string_dup_or_null(params->bind_dn);
+	export->params.passwd.bv_len = params->passwd.bv_len;
+	export->params.passwd.bv_val = malloc(params->passwd.bv_len + 1);
+	memcpy(export->params.passwd.bv_val, params->passwd.bv_val ? params->passwd.bv_val : "",
+	       params->passwd.bv_len);
+	export->params.passwd.bv_val[params->passwd.bv_len] = '\0';
+	export->params.deref = params->deref;
+
+	export->filename = strdup(filename);
+	export->split_files = split_files;
+	export->dn = strdup(dn);
+	if (attributes)
+	{
+		unsigned len;
+		for (len = 0; attributes[len]; len++)
+			;
+		export->attributes = calloc(len + 1, sizeof(char *));
+		for (unsigned i = 0; i < len; i++)
+			export->attributes[i] = strdup(attributes[i]);
+	}
+	export->page_size = page_size;
+	export->num_shards = connections > 0 ? connections : 1;
+	export->shards = calloc(export->num_shards, sizeof(SHARD));
+
+	export->stats = stats ? stats : &export->own_stats;
+	memset(export->stats, 0, sizeof(LDIF_STATS));
+	clock_gettime(CLOCK_MONOTONIC, &export->stats->start);
+	__atomic_store_n(&export->stats->running, true, __ATOMIC_RELEASE);
+
+	if (pthread_create(&export->thread, NULL, ldif_export_run, export) != 0)
+	{
+		__atomic_store_n(&export->stats->running, false, __ATOMIC_RELEASE);
+		ldif_export_free(export);
+		return NULL;
+	}
+
+	return export;
+}
+
+bool ldif_export_finished(LDIF_EXPORT * export)
+{
+	return __atomic_load_n(&export->finished, __ATOMIC_ACQUIRE);
+}
+
+void ldif_export_cancel(LDIF_EXPORT * export)
+{
+	__atomic_store_n(&export->cancelled, true, __ATOMIC_RELAXED);
+}
+
+int ldif_export_join(LDIF_EXPORT * export)
+{
+	pthread_join(export->thread, NULL);
+
+	int result = export->result;
+	ldif_export_free(export);
+	return result;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <stdbool.h>
+#include "connection.h"
+#include "ldifwriter.h"
+
+typedef struct LDIF_EXPORT_S LDIF_EXPORT;
+
+/**
+ * Exports the subtree below dn over a pool of connections opened with
+ * params, on a background thread. The subtree is split at its first levels
+ * and the branches are handed to whichever connection is idle. Entries go
+ * to filename, or with split_files to one file per connection, named like
+ * filename with the connection number before the extension. Parents are
+ * always written before their children. stats may be NULL, otherwise it
+ * has to outlive the export. Returns NULL if the thread could not start.
+ **/
+LDIF_EXPORT *ldif_export_start(const CONNECTION_PARAMS * params, unsigned connections,
+			       const char *filename, bool split_files, const char *dn,
+			       char **attributes, int page_size, LDIF_STATS * stats);
+
+bool ldif_export_finished(LDIF_EXPORT * export);
+
+/**
+ * Asks the export to stop, ldif_export_join() then returns
+ * LDAP_USER_CANCELLED.
+ **/
+void ldif_export_cancel(LDIF_EXPORT * export);
+
+/**
+ * Waits for the export to finish, frees it and returns its LDAP result.
+ **/
+int ldif_export_join(LDIF_EXPORT * export);
@@ -0,0 +1,406 @@
+#include "ldifimport.h"
+#include "async.h"
+#include "ldapentry.h"
+#include "ldifreader.h"
+#include "outstream.h"
+#include "spsc.h"
+
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define IMPORT_POLL_MS 100
+
+typedef struct ADD_S {
+	struct LDIF_IMPORT_S *import;
+	char *dn;
+	LDIF_RECORD record;	// for the reject file
+	struct ADD_S *prev, *next;
+} ADD;
+
+struct LDIF_IMPORT_S {
+	CONNECTION_PARAMS params;
+	char *filename;
+	char *reject_filename;
+	unsigned window;
+	bool report_added;
+	LDIF_STATS *stats;
+	LDIF_STATS own_stats;
+
+	LDAP *ld;
+	ASYNC *async;
+	LDIF_READER *reader;
+	OUTSTREAM *rejects;	// opened with the first reject
+	ARENA *arena;		// decoded values and modifications of the entry being sent
+	LDIF_LINE *lines;
+	unsigned lines_capacity;
+	LDIF_RECORD waiting;	// read, but its parent is still being added
+	bool has_waiting;
+	ADD *running;
+	unsigned num_running;
+	SPSC_QUEUE added;	// DNs, to the caller of ldif_import_next_added()
+
+	int result;
+	bool cancelled;
+	bool finished;
+	pthread_t thread;
+};
+
+static char *string_dup_or_null(const char *s)
+{
+	return s ? strdup(s) : NULL;
+}
+
+static void ldif_import_fail(LDIF_IMPORT * import, int result)
+{
+	if (import->result == LDAP_SUCCESS)
+		import->result = result;
+}
+
+/**
+ * Writes record to the reject file after a comment with the reason.
+ **/
+static void ldif_import_reject(LDIF_IMPORT * import, const LDIF_RECORD * record,
+			       const char *reason)
+{
+	if (!import->rejects)
+	{
+		import->rejects = outstream_open(import->reject_filename);
+		if (!import->rejects)
+		{
+			// going on would lose entries
+			ldif_import_fail(import, LDAP_LOCAL_ERROR);
+			return;
+		}
+		outstream_write(import->rejects, "version: 1\n\n", 12);
+	}
+
+	char comment[256];
+	int n = snprintf(comment, sizeof(comment), "# line %lu: %s\n", record->line, reason);
+	outstream_write(import->rejects, comment, n < (int)sizeof(comment) ? n : sizeof(comment) - 1);
+	outstream_write(import->rejects, record->text, record->len);
+	if (record->text[record->len - 1] != '\n')
+		outstream_write(import->rejects, "\n", 1);
+	outstream_write(import->rejects, "\n", 1);
+
+	__atomic_fetch_add(&import->stats->rejected, 1, __ATOMIC_RELAXED);
+}
+
+static void ldif_import_done(LDAP * ld, int result, void *ctx)
+{
+	ADD *add = ctx;
+	LDIF_IMPORT *import = add->import;
+
+	if (add->prev)
+		add->prev->next = add->next;
+	else
+		import->running = add->next;
+	if (add->next)
+		add->next->prev = add->prev;
+	import->num_running--;
+
+	if (result == LDAP_SUCCESS)
+	{
+		__atomic_fetch_add(&import->stats->entries, 1, __ATOMIC_RELAXED);
+		if (import->report_added)
+		{
+			spsc_push(&import->added, add->dn);
+			add->dn = NULL;
+		}
+	} else if (result != LDAP_USER_CANCELLED)
+		ldif_import_reject(import, &add->record, ldap_err2string(result));
+
+	free(add->dn);
+	free(add);
+}
+
+/**
+ * Groups the values of the first count lines by attribute, in the arena.
+ **/
+static LDAPMod **ldif_import_mods(LDIF_IMPORT * import, unsigned count)
+{
+	ARENA *arena = import->arena;
+	LDAPMod **mods = arena_malloc(arena, (count + 1) * sizeof(LDAPMod *));
+	unsigned *mod_of_line = arena_malloc(arena, (count + 1) * sizeof(unsigned));
+	unsigned *values = arena_malloc(arena, (count + 1) * sizeof(unsigned));
+	unsigned num_mods = 0;
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		LDIF_LINE *line = &import->lines[i];
+		unsigned m;
+		for (m = 0; m < num_mods; m++)
+		{
+			const char *type = mods[m]->mod_type;
+			if (strncasecmp(type, line->name, line->name_len) == 0
+			    && type[line->name_len] == '\0')
+				break;
+		}
+
+		if (m == num_mods)
+		{
+			LDAPMod *mod = arena_malloc(arena, sizeof(LDAPMod));
+			mod->mod_op = LDAP_MOD_ADD | LDAP_MOD_BVALUES;
+			mod->mod_type = arena_malloc(arena, line->name_len + 1);
+			memcpy(mod->mod_type, line->name, line->name_len);
+			mod->mod_type[line->name_len] = '\0';
+			mods[num_mods] = mod;
+			values[num_mods++] = 0;
+		}
+		mod_of_line[i] = m;
+		values[m]++;
+	}
+	mods[num_mods] = NULL;
+
+	for (unsigned m = 0; m < num_mods; m++)
+	{
+		mods[m]->mod_bvalues = arena_malloc(arena, (values[m] + 1) * sizeof(struct berval *));
+		mods[m]->mod_bvalues[values[m]] = NULL;
+		values[m] = 0;
+	}
+
+	// values point into the mapping, or the arena if they were decoded
+	struct berval *bvs = arena_malloc(arena, (count + 1) * sizeof(struct berval));
+	for (unsigned i = 0; i < count; i++)
+	{
+		LDAPMod *mod = mods[mod_of_line[i]];
+		bvs[i].bv_val = (char *)import->lines[i].value;
+		bvs[i].bv_len = import->lines[i].value_len;
+		mod->mod_bvalues[values[mod_of_line[i]]++] = &bvs[i];
+	}
+
+	return mods;
+}
+
+/**
+ * Sends the add of record, or rejects it. Returns false, sending nothing,
+ * while the add of its parent is in flight.
+ **/
+static bool ldif_import_send(LDIF_IMPORT * import, const LDIF_RECORD * record)
+{
+	ARENA *arena = import->arena;
+	arena_reset(arena);
+
+	LDIF_CURSOR c;
+	LDIF_LINE line;
+	ldif_cursor_init(&c, record);
+	if (!ldif_cursor_next(&c, arena, &line) || !ldif_line_is(&line, "dn"))
+	{
+		ldif_import_reject(import, record, c.error ? c.error : "no dn line");
+		return true;
+	}
+
+	char *dn = arena_malloc(arena, line.value_len + 1);
+	memcpy(dn, line.value, line.value_len);
+	dn[line.value_len] = '\0';
+
+	const char *parent = ldap_dn_parent(dn);
+	for (ADD * add = import->running; add; add = add->next)
+		if (strcasecmp(add->dn, parent) == 0)
+			return false;
+
+	unsigned count = 0;
+	while (ldif_cursor_next(&c, arena, &line))
+	{
+		if (ldif_line_is(&line, "changetype"))
+		{
+			if (line.value_len == 3 && strncasecmp(line.value, "add", 3) == 0)
+				continue;
+			ldif_import_reject(import, record, "only entries can be imported");
+			return true;
+		}
+		if (ldif_line_is(&line, "control"))
+		{
+			ldif_import_reject(import, record, "controls are not supported");
+			return true;
+		}
+
+		if (count == import->lines_capacity)
+		{
+			import->lines_capacity = import->lines_capacity ? 2 * import->lines_capacity : 64;
+			import->lines = realloc(import->lines, import->lines_capacity * sizeof(LDIF_LINE));
+		}
+		import->lines[count++] = line;
+	}
+	if (c.error)
+	{
+		ldif_import_reject(import, record, c.error);
+		return true;
+	}
+
+	ADD *add = calloc(1, sizeof(ADD));
+	add->import = import;
+	add->dn = strdup(dn);
+	add->record = *record;
+
+	int rc = async_add(import->async, dn, ldif_import_mods(import, count), ldif_import_done, add,
+			   NULL);
+	if (rc != LDAP_SUCCESS)
+	{
+		// the connection is gone, the following entries would fail the same way
+		ldif_import_reject(import, record, ldap_err2string(rc));
+		ldif_import_fail(import, rc);
+		free(add->dn);
+		free(add);
+		return true;
+	}
+
+	add->next = import->running;
+	if (import->running)
+		import->running->prev = add;
+	import->running = add;
+	import->num_running++;
+	return true;
+}
+
+/**
+ * Reads and sends entries until window adds are in flight, the next entry
+ * has to wait for its parent or the file is through.
+ **/
+static void ldif_import_fill(LDIF_IMPORT * import)
+{
+	while (import->result == LDAP_SUCCESS && import->num_running < import->window)
+	{
+		if (!import->has_waiting)
+		{
+			if (!ldif_reader_next(import->reader, &import->waiting))
+				return;
+			import->has_waiting = true;
+			__atomic_store_n(&import->stats->bytes, ldif_reader_offset(import->reader),
+					 __ATOMIC_RELAXED);
+		}
+
+		if (!ldif_import_send(import, &import->waiting))
+			return;
+		import->has_waiting = false;
+	}
+}
+
+static void *ldif_import_run(void *arg)
+{
+	LDIF_IMPORT *import = arg;
+
+	import->reader = ldif_reader_open(import->filename);
+	if (!import->reader)
+		ldif_import_fail(import, LDAP_LOCAL_ERROR);
+	else
+		ldif_import_fail(import, connection_open(&import->params, &import->ld));
+	if (import->result == LDAP_SUCCESS)
+		import->async = async_init(import->ld);
+
+	while (import->result == LDAP_SUCCESS
+	       && !__atomic_load_n(&import->cancelled, __ATOMIC_RELAXED))
+	{
+		ldif_import_fill(import);
+		if (import->num_running == 0)
+			break;
+
+		struct pollfd fd = { async_fd(import->async), POLLIN, 0 };
+		poll(&fd, 1, IMPORT_POLL_MS);
+		if (fd.revents)
+			async_process(import->async, 0);
+	}
+
+	if (import->result == LDAP_SUCCESS
+	    && __atomic_load_n(&import->cancelled, __ATOMIC_RELAXED))
+		import->result = LDAP_USER_CANCELLED;
+
+	// abandons the adds still in flight
+	if (import->async)
+		async_free(import->async);
+	import->async = NULL;
+	if (import->ld)
+		ldap_unbind_ext(import->ld, NULL, NULL);
+	import->ld = NULL;
+	if (import->reader)
+		ldif_reader_close(import->reader);
+	import->reader = NULL;
+	if (import->rejects && !outstream_close(import->rejects))
+		ldif_import_fail(import, LDAP_LOCAL_ERROR);
+	import->rejects = NULL;
+
+	__atomic_store_n(&import->stats->running, false, __ATOMIC_RELEASE);
+	__atomic_store_n(&import->finished, true, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+static void ldif_import_free(LDIF_IMPORT * import)
+{
+	char *dn;
+	while ((dn = spsc_pop(&import->added)))
+		free(dn);
+	spsc_destroy(&import->added);
+
+	free(import->params.uri);
+	free(import->params.bind_dn);
+	free(import->params.passwd.bv_val);
+	free(import->filename);
+	free(import->reject_filename);
+	arena_free(import->arena);
+	free(import->lines);
+	free(import);
+}
+
+LDIF_IMPORT *ldif_import_start(const CONNECTION_PARAMS * params, const char *filename,
+			       const char *reject_filename, unsigned window, bool report_added,
+			       LDIF_STATS * stats)
+{
+	LDIF_IMPORT *import = calloc(1, sizeof(LDIF_IMPORT));
+	import->params.uri = string_dup_or_null(params->uri);
+	import->params.bind_dn = string_dup_or_null(params->bind_dn);
+	import->params.passwd.bv_len = params->passwd.bv_len;
+	import->params.passwd.bv_val = malloc(params->passwd.bv_len + 1);
+	memcpy(import->params.passwd.bv_val, params->passwd.bv_val ? params->passwd.bv_val : "",
+	       params->passwd.bv_len);
+	import->params.passwd.bv_val[params->passwd.bv_len] = '\0';
+	import->params.deref = params->deref;
+
+	import->filename = strdup(filename);
+	import->reject_filename = strdup(reject_filename);
+	import->window = window > 0 ? window : 1;
+	import->report_added = report_added;
+	import->arena = arena_alloc();
+	spsc_init(&import->added);
+	import->result = LDAP_SUCCESS;
+
+	import->stats = stats ? stats : &import->own_stats;
+	memset(import->stats, 0, sizeof(LDIF_STATS));
+	clock_gettime(CLOCK_MONOTONIC, &import->stats->start);
+	__atomic_store_n(&import->stats->running, true, __ATOMIC_RELEASE);
+
+	if (pthread_create(&import->thread, NULL, ldif_import_run, import) != 0)
+	{
+		__atomic_store_n(&import->stats->running, false, __ATOMIC_RELEASE);
+		ldif_import_free(import);
+		return NULL;
+	}
+
+	return import;
+}
+
+bool ldif_import_finished(LDIF_IMPORT * import)
+{
+	return __atomic_load_n(&import->finished, __ATOMIC_ACQUIRE);
+}
+
+char *ldif_import_next_added(LDIF_IMPORT * import)
+{
+	return spsc_pop(&import->added);
+}
+
+void ldif_import_cancel(LDIF_IMPORT * import)
+{
+	__atomic_store_n(&import->cancelled, true, __ATOMIC_RELAXED);
+}
+
+int ldif_import_join(LDIF_IMPORT * import)
+{
+	pthread_join(import->thread, NULL);
+
+	int result = import->result;
+	ldif_import_free(import);
+	return result;
+}
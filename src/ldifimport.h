@@ -0,0 +1,43 @@
+#pragma once
+#include <stdbool.h>
+#include "connection.h"
+#include "ldifwriter.h"
+
+typedef struct LDIF_IMPORT_S LDIF_IMPORT;
+
+/**
+ * Adds the entries of the LDIF file filename (see ldifreader.h) over a
+ * connection opened with params, on a background thread, with up to window
+ * adds in flight. An entry waits while the add of its parent is in flight,
+ * so files listing parents first load in order. Entries that cannot be read
+ * or that the server refuses are written to reject_filename, each after a
+ * comment with the reason, and the import goes on; the file is only created
+ * if anything is rejected. With report_added the DNs of the entries added
+ * are queued for ldif_import_next_added(). stats may be NULL, otherwise it
+ * has to outlive the import. Returns NULL if the thread could not start.
+ **/
+LDIF_IMPORT *ldif_import_start(const CONNECTION_PARAMS * params, const char *filename,
+			       const char *reject_filename, unsigned window, bool report_added,
+			       LDIF_STATS * stats);
+
+bool ldif_import_finished(LDIF_IMPORT * import);
+
+/**
+ * Returns the DN of the next entry added, NULL if no other was added yet.
+ * Free with free(). Only one thread may call it.
+ **/
+char *ldif_import_next_added(LDIF_IMPORT * import);
+
+/**
+ * Asks the import to stop, ldif_import_join() then returns
+ * LDAP_USER_CANCELLED. Adds in flight are abandoned, their entries may
+ * or may not have been added.
+ **/
+void ldif_import_cancel(LDIF_IMPORT * import);
+
+/**
+ * Waits for the import to finish, frees it and returns its LDAP result:
+ * LDAP_SUCCESS once the whole file was read, even if entries were
+ * rejected.
+ **/
+int ldif_import_join(LDIF_IMPORT * import);
@@ -0,0 +1,380 @@
+#include "ldifindex.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define DROP_BEHIND (64 << 20)
+
+/**
+ * Per entry the index holds 28 bytes plus two hash table slots: the
+ * record (offset and length), the hash of the normalized DN, the parent
+ * and the children in compressed sparse row form. DNs are not kept, a
+ * hash match is confirmed against the DN in the mapping.
+ **/
+struct LDIF_INDEX_S {
+	LDIF_READER *reader;
+	const char *data;
+	uint32_t count, capacity;
+	uint64_t *offsets;
+	uint32_t *lengths;
+	uint32_t *hashes;
+	uint32_t *parents;	// count for entries whose parent is not in the file
+	uint32_t *child_start;	// children of id: children[child_start[id] .. child_start[id + 1]]
+	uint32_t *children;
+	uint32_t *table;	// entry + 1, 0 for free slots
+	uint32_t table_mask;
+	unsigned long skipped;
+	ARENA *scratch;		// decoded DNs
+};
+
+/**
+ * Walks a DN the way it is hashed and compared: lower case, without the
+ * spaces after RDN separators.
+ **/
+typedef struct {
+	const char *p, *end;
+	bool escaped;
+} DN_CHARS;
+
+static inline int dn_next(DN_CHARS * c)
+{
+	if (c->p == c->end)
+		return -1;
+
+	unsigned char ch = *c->p++;
+	if (c->escaped)
+		c->escaped = false;
+	else if (ch == '\\')
+		c->escaped = true;
+	else if (ch == ',')
+		while (c->p < c->end && *c->p == ' ')
+			c->p++;
+	// ASCII only, bytes of UTF-8 sequences are left alone as tolower() would
+	return ch >= 'A' && ch <= 'Z' ? ch - 'A' + 'a' : ch;
+}
+
+static uint32_t dn_hash(const char *dn, size_t len)
+{
+	DN_CHARS c = { dn, dn + len, false };
+	uint32_t hash = 5381;
+	int ch;
+	while ((ch = dn_next(&c)) >= 0)
+		hash = hash * 33 + ch;
+	return hash;
+}
+
+static bool dn_equal(const char *a, size_t a_len, const char *b, size_t b_len)
+{
+	DN_CHARS ca = { a, a + a_len, false }, cb = { b, b + b_len, false };
+	int ch;
+	while ((ch = dn_next(&ca)) == dn_next(&cb))
+		if (ch < 0)
+			return true;
+	return false;
+}
+
+/**
+ * Stores the parent of the DN in dn..dn + len in parent, returns false if
+ * the DN has a single RDN.
+ **/
+static bool dn_parent(const char *dn, size_t len, const char **parent, size_t *parent_len)
+{
+	const char *end = dn + len;
+	const char *c = dn;
+	for (; c < end && *c != ','; c++)
+	{
+		if (*c == '\\' && c + 1 < end)
+			c++;
+	}
+	if (c == end)
+		return false;
+
+	for (c++; c < end && *c == ' '; c++)
+		;
+	*parent = c;
+	*parent_len = end - c;
+	return true;
+}
+
+/**
+ * Reads the DN of a record, decoded into the scratch arena if needed.
+ **/
+static bool record_dn(LDIF_INDEX * index, const LDIF_RECORD * record, const char **dn,
+		      size_t *len)
+{
+	LDIF_CURSOR c;
+	LDIF_LINE line;
+	ldif_cursor_init(&c, record);
+	if (!ldif_cursor_next(&c, index->scratch, &line) || !ldif_line_is(&line, "dn"))
+		return false;
+
+	*dn = line.value;
+	*len = line.value_len;
+	return true;
+}
+
+bool ldif_index_record(LDIF_INDEX * index, unsigned id, LDIF_RECORD * record)
+{
+	if (id >= index->count)
+		return false;
+
+	record->text = index->data + index->offsets[id];
+	record->len = index->lengths[id];
+	// line numbers are not kept
+	record->line = 0;
+	return true;
+}
+
+static bool entry_dn(LDIF_INDEX * index, uint32_t id, const char **dn, size_t *len)
+{
+	LDIF_RECORD record;
+	return ldif_index_record(index, id, &record) && record_dn(index, &record, dn, len);
+}
+
+static uint32_t ldif_index_lookup(LDIF_INDEX * index, const char *dn, size_t len,
+				  uint32_t hash)
+{
+	for (uint32_t slot = hash & index->table_mask; index->table[slot];
+	     slot = (slot + 1) & index->table_mask)
+	{
+		uint32_t id = index->table[slot] - 1;
+		const char *other;
+		size_t other_len;
+		if (index->hashes[id] == hash && entry_dn(index, id, &other, &other_len)
+		    && dn_equal(dn, len, other, other_len))
+			return id;
+	}
+	return LDIF_INDEX_NONE;
+}
+
+static void ldif_index_insert(LDIF_INDEX * index, uint32_t id)
+{
+	uint32_t slot = index->hashes[id] & index->table_mask;
+	while (index->table[slot])
+		slot = (slot + 1) & index->table_mask;
+	index->table[slot] = id + 1;
+}
+
+/**
+ * Keeps the table at most half full, rehashing from the stored hashes.
+ **/
+static void ldif_index_grow_table(LDIF_INDEX * index)
+{
+	if (index->table && 2 * (size_t)index->count < index->table_mask + 1)
+		return;
+
+	size_t slots = index->table ? 2 * ((size_t)index->table_mask + 1) : 1024;
+	free(index->table);
+	index->table = calloc(slots, sizeof(uint32_t));
+	index->table_mask = slots - 1;
+	for (uint32_t id = 0; id < index->count; id++)
+		ldif_index_insert(index, id);
+}
+
+static void ldif_index_append(LDIF_INDEX * index, const LDIF_RECORD * record, uint32_t hash,
+			      uint32_t parent)
+{
+	if (index->count == index->capacity)
+	{
+		index->capacity = index->capacity ? 2 * index->capacity : 1024;
+		index->offsets = realloc(index->offsets, index->capacity * sizeof(uint64_t));
+		index->lengths = realloc(index->lengths, index->capacity * sizeof(uint32_t));
+		index->hashes = realloc(index->hashes, index->capacity * sizeof(uint32_t));
+		index->parents = realloc(index->parents, index->capacity * sizeof(uint32_t));
+	}
+
+	uint32_t id = index->count++;
+	index->offsets[id] = record->text - index->data;
+	index->lengths[id] = record->len;
+	index->hashes[id] = hash;
+	index->parents[id] = parent;
+	ldif_index_grow_table(index);
+	ldif_index_insert(index, id);
+}
+
+/**
+ * Finds the parent of every entry. Most files list parents first, so
+ * most are found while reading; the others are looked up again here.
+ **/
+static void ldif_index_link(LDIF_INDEX * index)
+{
+	// no more entries come, give back the room kept for them
+	if (index->count && index->count < index->capacity)
+	{
+		index->capacity = index->count;
+		index->offsets = realloc(index->offsets, index->capacity * sizeof(uint64_t));
+		index->lengths = realloc(index->lengths, index->capacity * sizeof(uint32_t));
+		index->hashes = realloc(index->hashes, index->capacity * sizeof(uint32_t));
+		index->parents = realloc(index->parents, index->capacity * sizeof(uint32_t));
+	}
+
+	uint32_t root = index->count;
+	for (uint32_t id = 0; id < index->count; id++)
+	{
+		if (index->parents[id] != LDIF_INDEX_NONE)
+			continue;
+
+		arena_reset(index->scratch);
+		const char *dn, *parent;
+		size_t len, parent_len;
+		index->parents[id] = root;
+		if (entry_dn(index, id, &dn, &len) && dn_parent(dn, len, &parent, &parent_len))
+		{
+			uint32_t found = ldif_index_lookup(index, parent, parent_len,
+							   dn_hash(parent, parent_len));
+			if (found != LDIF_INDEX_NONE)
+				index->parents[id] = found;
+		}
+	}
+
+	// count the children first, then place them in file order
+	index->child_start = calloc(index->count + 2, sizeof(uint32_t));
+	index->children = malloc((index->count ? index->count : 1) * sizeof(uint32_t));
+	for (uint32_t id = 0; id < index->count; id++)
+		index->child_start[index->parents[id] + 1]++;
+	for (uint32_t id = 0; id <= index->count; id++)
+		index->child_start[id + 1] += index->child_start[id];
+
+	uint32_t *fill = malloc((index->count + 1) * sizeof(uint32_t));
+	memcpy(fill, index->child_start, (index->count + 1) * sizeof(uint32_t));
+	for (uint32_t id = 0; id < index->count; id++)
+		index->children[fill[index->parents[id]]++] = id;
+	free(fill);
+}
+
+LDIF_INDEX *ldif_index_open(const char *filename)
+{
+	LDIF_READER *reader = ldif_reader_open(filename);
+	if (!reader)
+		return NULL;
+
+	LDIF_INDEX *index = calloc(1, sizeof(LDIF_INDEX));
+	size_t size;
+	index->reader = reader;
+	index->data = ldif_reader_data(reader, &size);
+	index->scratch = arena_alloc();
+	ldif_index_grow_table(index);
+
+	LDIF_RECORD record;
+	size_t dropped = 0;
+	while (ldif_reader_next(reader, &record))
+	{
+		// the pages read so far leave the resident set every DROP_BEHIND
+		// bytes, parents read again later are faulted back in
+		size_t offset = ldif_reader_offset(reader) & ~(size_t)(DROP_BEHIND - 1);
+		if (offset - dropped >= DROP_BEHIND)
+		{
+			madvise((void *)(index->data + dropped), offset - dropped, MADV_DONTNEED);
+			dropped = offset;
+		}
+
+		arena_reset(index->scratch);
+		const char *dn, *parent;
+		size_t len, parent_len;
+		if (!record_dn(index, &record, &dn, &len) || record.len > UINT32_MAX)
+		{
+			index->skipped++;
+			continue;
+		}
+
+		uint32_t hash = dn_hash(dn, len);
+		if (ldif_index_lookup(index, dn, len, hash) != LDIF_INDEX_NONE)
+		{
+			index->skipped++;
+			continue;
+		}
+
+		uint32_t parent_id = LDIF_INDEX_NONE;
+		if (dn_parent(dn, len, &parent, &parent_len))
+			parent_id = ldif_index_lookup(index, parent, parent_len,
+						      dn_hash(parent, parent_len));
+		ldif_index_append(index, &record, hash, parent_id);
+	}
+	ldif_index_link(index);
+
+	// as do the rest, browsing faults in the records it shows
+	if (size > 0)
+	{
+		madvise((void *)index->data, size, MADV_DONTNEED);
+		madvise((void *)index->data, size, MADV_RANDOM);
+	}
+	return index;
+}
+
+void ldif_index_close(LDIF_INDEX * index)
+{
+	ldif_reader_close(index->reader);
+	free(index->offsets);
+	free(index->lengths);
+	free(index->hashes);
+	free(index->parents);
+	free(index->child_start);
+	free(index->children);
+	free(index->table);
+	arena_free(index->scratch);
+	free(index);
+}
+
+unsigned ldif_index_count(LDIF_INDEX * index)
+{
+	return index->count;
+}
+
+unsigned long ldif_index_skipped(LDIF_INDEX * index)
+{
+	return index->skipped;
+}
+
+size_t ldif_index_size(LDIF_INDEX * index)
+{
+	return sizeof(LDIF_INDEX) + index->capacity * (sizeof(uint64_t) + 3 * sizeof(uint32_t))
+	    + (2 * (size_t)index->count + 2) * sizeof(uint32_t)
+	    + ((size_t)index->table_mask + 1) * sizeof(uint32_t) + arena_size(index->scratch);
+}
+
+unsigned ldif_index_find(LDIF_INDEX * index, const char *dn)
+{
+	if (!*dn)
+		return index->count;
+
+	arena_reset(index->scratch);
+	size_t len = strlen(dn);
+	return ldif_index_lookup(index, dn, len, dn_hash(dn, len));
+}
+
+const unsigned *ldif_index_children(LDIF_INDEX * index, unsigned id, unsigned *count)
+{
+	if (id > index->count)
+	{
+		*count = 0;
+		return NULL;
+	}
+
+	*count = index->child_start[id + 1] - index->child_start[id];
+	return index->children + index->child_start[id];
+}
+
+char *ldif_index_name(LDIF_INDEX * index, unsigned id, ARENA * arena)
+{
+	arena_reset(index->scratch);
+	const char *dn, *parent;
+	size_t len, parent_len;
+	if (!entry_dn(index, id, &dn, &len))
+		return NULL;
+
+	// the first RDN, unless the parent is not there to supply the rest
+	if (index->parents[id] != index->count && dn_parent(dn, len, &parent, &parent_len))
+	{
+		// back over the spaces after the separator, then the separator
+		len = parent - dn;
+		while (dn[len - 1] == ' ')
+			len--;
+		len--;
+	}
+
+	char *name = arena_malloc(arena, len + 1);
+	memcpy(name, dn, len);
+	name[len] = '\0';
+	return name;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include "arena.h"
+#include "ldifreader.h"
+
+/**
+ * Lets an LDIF file (like a slapcat dump) be browsed without a server.
+ * Opening it reads the file once through the mapping of ldifreader.h and
+ * keeps, per entry, only the offset of its record, its parent and a hash
+ * of its DN; DNs and values are read from the mapping again when needed.
+ * Entries are numbered in file order; the number one past the last entry
+ * stands for the empty DN, the parent of the entries whose parent is not
+ * in the file.
+ **/
+
+typedef struct LDIF_INDEX_S LDIF_INDEX;
+
+#define LDIF_INDEX_NONE ((unsigned)-1)
+
+/**
+ * Maps and indexes filename, returns NULL (with errno set) if it could
+ * not be read. Records without a dn line and repeated DNs are skipped.
+ **/
+LDIF_INDEX *ldif_index_open(const char *filename);
+
+void ldif_index_close(LDIF_INDEX * index);
+
+/**
+ * Returns the number of entries indexed, which is also the number of the
+ * empty DN.
+ **/
+unsigned ldif_index_count(LDIF_INDEX * index);
+
+/**
+ * Returns the number of records skipped while indexing.
+ **/
+unsigned long ldif_index_skipped(LDIF_INDEX * index);
+
+/**
+ * Returns the bytes held by the index, not counting the mapping.
+ **/
+size_t ldif_index_size(LDIF_INDEX * index);
+
+/**
+ * Returns the entry with the given DN, compared case-insensitively and
+ * ignoring spaces after the RDN separators, LDIF_INDEX_NONE if the file
+ * has none.
+ **/
+unsigned ldif_index_find(LDIF_INDEX * index, const char *dn);
+
+/**
+ * Returns the children of entry id in file order and their number in
+ * count.
+ **/
+const unsigned *ldif_index_children(LDIF_INDEX * index, unsigned id, unsigned *count);
+
+/**
+ * Stores the record of entry id, returns false for the empty DN.
+ **/
+bool ldif_index_record(LDIF_INDEX * index, unsigned id, LDIF_RECORD * record);
+
+/**
+ * Returns the name of entry id below its parent, copied into arena: its
+ * first RDN, or its whole DN if its parent is not in the file.
+ **/
+char *ldif_index_name(LDIF_INDEX * index, unsigned id, ARENA * arena);
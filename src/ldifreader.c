@@ -0,0 +1,253 @@
+#include "ldifreader.h"
+#include "base64.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct LDIF_READER_S {
+	const char *data;
+	size_t size;
+	size_t pos;		// start of the next record
+	unsigned long line;	// number of the line at pos
+	bool started;		// a record was returned, the version line is behind us
+};
+
+LDIF_READER *ldif_reader_open(const char *filename)
+{
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	struct stat st;
+	const char *data = NULL;
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		return NULL;
+	}
+	if (st.st_size > 0)
+	{
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED)
+		{
+			close(fd);
+			return NULL;
+		}
+		// read front to back, pages behind us may go
+		madvise((void *)data, st.st_size, MADV_SEQUENTIAL);
+	}
+	// the mapping stays valid without the descriptor
+	close(fd);
+
+	LDIF_READER *r = calloc(1, sizeof(LDIF_READER));
+	r->data = data;
+	r->size = st.st_size;
+	r->line = 1;
+	return r;
+}
+
+void ldif_reader_close(LDIF_READER * r)
+{
+	if (r->data)
+		munmap((void *)r->data, r->size);
+	free(r);
+}
+
+const char *ldif_reader_data(LDIF_READER * r, size_t *size)
+{
+	*size = r->size;
+	return r->data;
+}
+
+size_t ldif_reader_offset(LDIF_READER * r)
+{
+	return r->pos;
+}
+
+static bool is_blank(const char *p, const char *end)
+{
+	return *p == '\n' || (*p == '\r' && p + 1 < end && p[1] == '\n');
+}
+
+/**
+ * Returns the end of the line starting at p without its line break, and in
+ * next the start of the line after it.
+ **/
+static const char *line_end(const char *p, const char *end, const char **next)
+{
+	const char *nl = memchr(p, '\n', end - p);
+	*next = nl ? nl + 1 : end;
+
+	const char *e = nl ? nl : end;
+	if (e > p && e[-1] == '\r')
+		e--;
+	return e;
+}
+
+bool ldif_reader_next(LDIF_READER * r, LDIF_RECORD * record)
+{
+	const char *end = r->data + r->size;
+
+	while (r->pos < r->size)
+	{
+		const char *p = r->data + r->pos;
+		while (p < end && is_blank(p, end))
+		{
+			p += *p == '\r' ? 2 : 1;
+			r->line++;
+		}
+		if (p == end)
+			break;
+
+		record->text = p;
+		record->line = r->line;
+
+		// comment lines and their continuations alone do not make an entry
+		bool content = false;
+		const char *line = p;
+		while (line < end && !is_blank(line, end))
+		{
+			if (*line != '#' && *line != ' ')
+				content = true;
+
+			const char *nl = memchr(line, '\n', end - line);
+			line = nl ? nl + 1 : end;
+			r->line++;
+		}
+		record->len = line - p;
+		r->pos = line - r->data;
+		if (!content)
+			continue;
+
+		if (!r->started && record->len >= 8 && strncasecmp(p, "version:", 8) == 0)
+		{
+			r->started = true;
+			const char *next;
+			line_end(p, p + record->len, &next);
+			record->len -= next - p;
+			record->text = next;
+			record->line++;
+			if (record->len == 0)
+				continue;
+		}
+
+		r->started = true;
+		return true;
+	}
+
+	r->pos = r->size;
+	return false;
+}
+
+void ldif_cursor_init(LDIF_CURSOR * c, const LDIF_RECORD * record)
+{
+	c->p = record->text;
+	c->end = record->text + record->len;
+	c->error = NULL;
+}
+
+static bool ldif_parse_line(LDIF_CURSOR * c, ARENA * arena, const char *p, const char *end,
+			    LDIF_LINE * line)
+{
+	const char *colon = *p == ' ' ? NULL : memchr(p, ':', end - p);
+	if (!colon || colon == p)
+	{
+		c->error = "not an attribute line";
+		return false;
+	}
+
+	line->name = p;
+	line->name_len = colon - p;
+
+	const char *value = colon + 1;
+	if (value < end && *value == '<')
+	{
+		c->error = "URL values are not supported";
+		return false;
+	}
+	bool base64 = value < end && *value == ':';
+	if (base64)
+		value++;
+	while (value < end && *value == ' ')
+		value++;
+
+	if (!base64)
+	{
+		line->value = value;
+		line->value_len = end - value;
+		return true;
+	}
+
+	unsigned char *decoded = arena_malloc(arena, base64_decoded_size(end - value) + 1);
+	size_t len = base64_decode(value, end - value, decoded);
+	if (len == (size_t) - 1)
+	{
+		c->error = "invalid base64 value";
+		return false;
+	}
+
+	line->value = (const char *)decoded;
+	line->value_len = len;
+	return true;
+}
+
+bool ldif_cursor_next(LDIF_CURSOR * c, ARENA * arena, LDIF_LINE * line)
+{
+	c->error = NULL;
+
+	while (c->p < c->end)
+	{
+		const char *start = c->p, *next;
+		const char *end = line_end(start, c->end, &next);
+		bool comment = *start == '#';
+
+		if (next < c->end && *next == ' ')
+		{
+			// joined without the leading space of each continuation line
+			size_t len = end - start;
+			const char *q = next;
+			while (q < c->end && *q == ' ')
+			{
+				const char *after;
+				const char *e = line_end(q, c->end, &after);
+				len += e - q - 1;
+				q = after;
+			}
+
+			if (!comment)
+			{
+				char *joined = arena_malloc(arena, len + 1);
+				memcpy(joined, start, end - start);
+				size_t used = end - start;
+				for (const char *s = next; s < q;)
+				{
+					const char *after;
+					const char *e = line_end(s, c->end, &after);
+					memcpy(joined + used, s + 1, e - s - 1);
+					used += e - s - 1;
+					s = after;
+				}
+				start = joined;
+				end = joined + len;
+			}
+			next = q;
+		}
+
+		c->p = next;
+		if (!comment)
+			return ldif_parse_line(c, arena, start, end, line);
+	}
+
+	return false;
+}
+
+bool ldif_line_is(const LDIF_LINE * line, const char *name)
+{
+	size_t len = strlen(name);
+	return line->name_len == len && strncasecmp(line->name, name, len) == 0;
+}
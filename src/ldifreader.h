@@ -0,0 +1,77 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include "arena.h"
+
+/**
+ * Reads LDIF (RFC 2849) from a file mapped into memory, one record at a
+ * time. Values are handed out as slices of the mapping; only folded and
+ * base64 encoded ones are decoded into an arena of the caller. Compressed
+ * files are not supported.
+ **/
+
+typedef struct LDIF_READER_S LDIF_READER;
+
+/**
+ * The lines of one entry, up to the blank line after them.
+ **/
+typedef struct LDIF_RECORD_S {
+	const char *text;	// in the mapping, not NUL terminated
+	size_t len;		// including the newline ending the last line
+	unsigned long line;	// number of the first line, counting from 1
+} LDIF_RECORD;
+
+/**
+ * An attribute line of a record, unfolded and decoded. Neither name nor
+ * value is NUL terminated.
+ **/
+typedef struct LDIF_LINE_S {
+	const char *name;
+	size_t name_len;
+	const char *value;
+	size_t value_len;
+} LDIF_LINE;
+
+typedef struct LDIF_CURSOR_S {
+	const char *p, *end;
+	const char *error;	// why the last line could not be read
+} LDIF_CURSOR;
+
+/**
+ * Maps filename, returns NULL (with errno set) if that failed.
+ **/
+LDIF_READER *ldif_reader_open(const char *filename);
+
+void ldif_reader_close(LDIF_READER * r);
+
+/**
+ * Returns the start of the mapping and its size in bytes.
+ **/
+const char *ldif_reader_data(LDIF_READER * r, size_t *size);
+
+/**
+ * Returns the number of bytes read so far.
+ **/
+size_t ldif_reader_offset(LDIF_READER * r);
+
+/**
+ * Moves to the next record, skipping the version line and records holding
+ * only comments. Returns false at the end of the file.
+ **/
+bool ldif_reader_next(LDIF_READER * r, LDIF_RECORD * record);
+
+void ldif_cursor_init(LDIF_CURSOR * c, const LDIF_RECORD * record);
+
+/**
+ * Reads the next attribute line of the record, skipping comments. Returns
+ * false at the end of the record, or with c->error set at a line that
+ * cannot be read (URL values are not supported). Decoded values stay valid
+ * until arena is reset.
+ **/
+bool ldif_cursor_next(LDIF_CURSOR * c, ARENA * arena, LDIF_LINE * line);
+
+/**
+ * Tells whether the attribute name of line is name, compared
+ * case-insensitively.
+ **/
+bool ldif_line_is(const LDIF_LINE * line, const char *name);
@@ -1,60 +1,154 @@
 #include "ldifwriter.h"
-#include "ldapbrowse.h"
+#include "outstream.h"
+#include "base64.h"
 
-#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-void ldif_write(LDAP * ld, const char *filename, const char *dn, char **attributes)
+// RFC 2849 does not limit line length, but 76 columns is what other tools write
+#define LDIF_LINE_WIDTH 76
+
+struct LDIF_WRITER_S {
+	OUTSTREAM *out;
+	char *scratch;		// base64 of the value being written
+	size_t scratch_size;
+	size_t entry_bytes;	// bytes of the entry being written
+	LDIF_STATS *stats;
+	LDIF_STATS own_stats;	// used if the caller does not track progress
+};
+
+static void ldif_put(LDIF_WRITER * writer, const char *s, size_t len)
 {
-	FILE *out = fopen(filename, "w");
+	outstream_write(writer->out, s, len);
+	writer->entry_bytes += len;
+}
 
-	fputs("version: 1\n\n", out);
+static void ldif_puts(LDIF_WRITER * writer, const char *s)
+{
+	ldif_put(writer, s, strlen(s));
+}
 
-	LDAPMessage *msg;
-	int errno = ldap_search_s(ld, dn, LDAP_SCOPE_SUB, "(objectClass=*)", attributes, 0, &msg);
-	if (errno != LDAP_SUCCESS)
+// stats are shared with other threads, count once per entry
+static void ldif_count(LDIF_WRITER * writer, unsigned long entries)
+{
+	__atomic_fetch_add(&writer->stats->entries, entries, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&writer->stats->bytes, writer->entry_bytes, __ATOMIC_RELAXED);
+	writer->entry_bytes = 0;
+}
+
+LDIF_WRITER *ldif_writer_open(const char *filename, LDIF_STATS * stats)
+{
+	OUTSTREAM *out = outstream_open(filename);
+	if (!out)
+		return NULL;
+
+	LDIF_WRITER *writer = calloc(1, sizeof(LDIF_WRITER));
+	writer->out = out;
+	writer->stats = stats ? stats : &writer->own_stats;
+
+	ldif_puts(writer, "version: 1\n\n");
+	ldif_count(writer, 0);
+	return writer;
+}
+
+/**
+ * Tells whether value can be written as is (RFC 2849 SAFE-STRING). Values
+ * ending in a space are not, as readers tend to strip it.
+ **/
+static bool ldif_is_safe(const char *value, size_t len)
+{
+	if (len == 0)
+		return true;
+
+	unsigned char first = value[0];
+	if (first == ' ' || first == ':' || first == '<' || value[len - 1] == ' ')
+		return false;
+
+	for (size_t i = 0; i < len; i++)
 	{
-		ldap_show_error(ld, errno, "ldap_search_s");
-		return;
+		unsigned char c = value[i];
+		if (c == '\0' || c == '\n' || c == '\r' || c > 127)
+			return false;
 	}
 
-	do
+	return true;
+}
+
+/**
+ * Writes "name: value", or "name:: base64" for unsafe values, folded to
+ * LDIF_LINE_WIDTH columns.
+ **/
+static void ldif_put_line(LDIF_WRITER * writer, const char *name, size_t name_len,
+			  const char *value, size_t len)
+{
+	ldif_put(writer, name, name_len);
+	size_t column = name_len + 2;
+
+	if (ldif_is_safe(value, len))
+	{
+		ldif_put(writer, ": ", 2);
+	} else
+	{
+		size_t size = base64_encoded_size(len);
+		if (size > writer->scratch_size)
+		{
+			writer->scratch_size = size;
+			free(writer->scratch);
+			writer->scratch = malloc(size);
+		}
+		len = base64_encode((const unsigned char *)value, len, writer->scratch);
+		value = writer->scratch;
+
+		ldif_put(writer, ":: ", 3);
+		column++;
+	}
+
+	// continuation lines start with a space
+	while (column + len > LDIF_LINE_WIDTH)
 	{
+		size_t n = column < LDIF_LINE_WIDTH ? LDIF_LINE_WIDTH - column : 0;
+		ldif_put(writer, value, n);
+		ldif_put(writer, "\n ", 2);
+		value += n;
+		len -= n;
+		column = 1;
+	}
+	ldif_put(writer, value, len);
+	ldif_put(writer, "\n", 1);
+}
 
-		fputs("dn: ", out);
-		char *entry_dn = ldap_get_dn(ld, msg);
-		fputs(entry_dn, out);
-		free(entry_dn);
-		fputs("\n", out);
+void ldif_writer_entry(LDIF_WRITER * writer, LDAP * ld, LDAPMessage * entry)
+{
+	char *entry_dn = ldap_get_dn(ld, entry);
+	ldif_put_line(writer, "dn", 2, entry_dn, strlen(entry_dn));
+	ldap_memfree(entry_dn);
 
-		BerElement *pber;
-		char *attr;
-		for (attr = ldap_first_attribute(ld, msg, &pber); attr != NULL;
-		     ldap_memfree(attr), attr = ldap_next_attribute(ld, msg, pber))
+	BerElement *pber;
+	char *attr;
+	for (attr = ldap_first_attribute(ld, entry, &pber); attr != NULL;
+	     ldap_memfree(attr), attr = ldap_next_attribute(ld, entry, pber))
+	{
+		struct berval **values;
+		if (!(values = ldap_get_values_len(ld, entry, attr)))
 		{
-			char **values;
-			if (!(values = ldap_get_values(ld, msg, attr)))
-			{
-				ldap_perror(ld, "ldap_get_values");
-			}
-
-			for (unsigned i = 0; values[i]; i++)
-			{
-				fputs(attr, out);
-				fputs(": ", out);
-				fputs(values[i], out);
-				fputs("\n", out);
-			}
-			ldap_value_free(values);
+			continue;
 		}
-		ber_free(pber, 0);
 
-		fputs("\n", out);
+		size_t attr_len = strlen(attr);
+		for (unsigned i = 0; values[i]; i++)
+			ldif_put_line(writer, attr, attr_len, values[i]->bv_val, values[i]->bv_len);
+		ldap_value_free_len(values);
 	}
-	while ((msg = ldap_next_entry(ld, msg)) != NULL);
+	ber_free(pber, 0);
 
-	ldap_msgfree(msg);
+	ldif_puts(writer, "\n");
+	ldif_count(writer, 1);
+}
 
-	fclose(out);
-	out = NULL;
+int ldif_writer_close(LDIF_WRITER * writer)
+{
+	int rc = outstream_close(writer->out) ? LDAP_SUCCESS : LDAP_LOCAL_ERROR;
+	free(writer->scratch);
+	free(writer);
+	return rc;
 }
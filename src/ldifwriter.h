@@ -1,4 +1,32 @@
 #pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
 #include <ldap.h>
 
-void ldif_write(LDAP * ld, const char *filename, const char *dn, char **attributes);
+/**
+ * Progress of an export or import, updated as entries are written or
+ * added. Several writers may share one, also from other threads.
+ **/
+typedef struct LDIF_STATS_S {
+	unsigned long entries;
+	size_t bytes;		// written, or read from the imported file
+	unsigned long rejected;	// entries an import could not add
+	struct timespec start;
+	bool running;
+} LDIF_STATS;
+
+typedef struct LDIF_WRITER_S LDIF_WRITER;
+
+/**
+ * Creates filename (compressed according to its extension, see
+ * outstream.h) and writes the LDIF version line. stats may be NULL.
+ **/
+LDIF_WRITER *ldif_writer_open(const char *filename, LDIF_STATS * stats);
+
+void ldif_writer_entry(LDIF_WRITER * writer, LDAP * ld, LDAPMessage * entry);
+
+/**
+ * Flushes and closes the file, returns LDAP_LOCAL_ERROR if that failed.
+ **/
+int ldif_writer_close(LDIF_WRITER * writer);
@@ -0,0 +1,299 @@
+#include "outstream.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#define OUTSTREAM_BLOCK_SIZE (1 << 20)
+// blocks handed to the writer thread at most, bounds memory if it falls behind
+#define OUTSTREAM_QUEUE_BLOCKS 8
+
+typedef enum { OUTSTREAM_PLAIN, OUTSTREAM_GZIP, OUTSTREAM_ZSTD } OUTSTREAM_FORMAT;
+
+typedef struct BLOCK_S {
+	char *data;
+	size_t len;
+	struct BLOCK_S *next;
+} BLOCK;
+
+struct OUTSTREAM_S {
+	int fd;
+	OUTSTREAM_FORMAT format;
+	BLOCK *current;		// filled by the caller
+	BLOCK *queue_head, *queue_tail;	// full blocks, oldest first
+	BLOCK *free_blocks;	// written blocks for reuse
+	unsigned blocks;	// allocated so far
+	bool closing;
+	bool failed;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	pthread_t thread;
+	z_stream gzip;
+#ifdef HAVE_ZSTD
+	ZSTD_CCtx *zstd;
+#endif
+	char *compressed;	// output buffer of the compressor
+	size_t compressed_size;
+};
+
+static bool ends_with(const char *s, const char *suffix)
+{
+	size_t len = strlen(s), suffix_len = strlen(suffix);
+	return len >= suffix_len && strcmp(s + len - suffix_len, suffix) == 0;
+}
+
+static bool write_all(int fd, const char *data, size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t n = write(fd, data, len);
+		if (n < 0)
+			return false;
+		data += n;
+		len -= n;
+	}
+	return true;
+}
+
+static bool outstream_gzip(OUTSTREAM * out, const char *data, size_t len, bool finish)
+{
+	out->gzip.next_in = (Bytef *) data;
+	out->gzip.avail_in = len;
+
+	int rc;
+	do
+	{
+		out->gzip.next_out = (Bytef *) out->compressed;
+		out->gzip.avail_out = out->compressed_size;
+		rc = deflate(&out->gzip, finish ? Z_FINISH : Z_NO_FLUSH);
+		if (rc == Z_STREAM_ERROR)
+			return false;
+		if (!write_all(out->fd, out->compressed, out->compressed_size - out->gzip.avail_out))
+			return false;
+	} while (out->gzip.avail_out == 0 || (finish && rc != Z_STREAM_END));
+
+	return true;
+}
+
+#ifdef HAVE_ZSTD
+static bool outstream_zstd(OUTSTREAM * out, const char *data, size_t len, bool finish)
+{
+	ZSTD_inBuffer in = { data, len, 0 };
+	size_t remaining;
+	do
+	{
+		ZSTD_outBuffer output = { out->compressed, out->compressed_size, 0 };
+		remaining = ZSTD_compressStream2(out->zstd, &output, &in,
+						 finish ? ZSTD_e_end : ZSTD_e_continue);
+		if (ZSTD_isError(remaining))
+			return false;
+		if (!write_all(out->fd, out->compressed, output.pos))
+			return false;
+	} while (finish ? remaining != 0 : in.pos < in.size);
+
+	return true;
+}
+#endif
+
+static bool outstream_emit(OUTSTREAM * out, const char *data, size_t len, bool finish)
+{
+	switch (out->format)
+	{
+	case OUTSTREAM_GZIP:
+		return outstream_gzip(out, data, len, finish);
+#ifdef HAVE_ZSTD
+	case OUTSTREAM_ZSTD:
+		return outstream_zstd(out, data, len, finish);
+#endif
+	default:
+		return write_all(out->fd, data, len);
+	}
+}
+
+static void *outstream_run(void *arg)
+{
+	OUTSTREAM *out = arg;
+
+	pthread_mutex_lock(&out->lock);
+	while (true)
+	{
+		while (!out->queue_head && !out->closing)
+			pthread_cond_wait(&out->changed, &out->lock);
+
+		BLOCK *block = out->queue_head;
+		if (!block)
+			break;
+		out->queue_head = block->next;
+		if (!out->queue_head)
+			out->queue_tail = NULL;
+		pthread_mutex_unlock(&out->lock);
+
+		bool ok = out->failed || outstream_emit(out, block->data, block->len, false);
+
+		pthread_mutex_lock(&out->lock);
+		out->failed = !ok;
+		block->len = 0;
+		block->next = out->free_blocks;
+		out->free_blocks = block;
+		pthread_cond_broadcast(&out->changed);
+	}
+	pthread_mutex_unlock(&out->lock);
+
+	if (!out->failed && !outstream_emit(out, NULL, 0, true))
+		out->failed = true;
+	return NULL;
+}
+
+OUTSTREAM *outstream_open(const char *filename)
+{
+	OUTSTREAM_FORMAT format = OUTSTREAM_PLAIN;
+	if (ends_with(filename, ".gz"))
+		format = OUTSTREAM_GZIP;
+	else if (ends_with(filename, ".zst"))
+	{
+#ifdef HAVE_ZSTD
+		format = OUTSTREAM_ZSTD;
+#else
+		return NULL;
+#endif
+	}
+
+	int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0)
+		return NULL;
+
+	OUTSTREAM *out = calloc(1, sizeof(OUTSTREAM));
+	out->fd = fd;
+	out->format = format;
+	pthread_mutex_init(&out->lock, NULL);
+	pthread_cond_init(&out->changed, NULL);
+
+	if (format == OUTSTREAM_GZIP)
+	{
+		// 15 + 16: default window with a gzip header
+		deflateInit2(&out->gzip, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+			     Z_DEFAULT_STRATEGY);
+		out->compressed_size = OUTSTREAM_BLOCK_SIZE;
+	}
+#ifdef HAVE_ZSTD
+	if (format == OUTSTREAM_ZSTD)
+	{
+		out->zstd = ZSTD_createCCtx();
+		ZSTD_CCtx_setParameter(out->zstd, ZSTD_c_compressionLevel, ZSTD_CLEVEL_DEFAULT);
+		out->compressed_size = ZSTD_CStreamOutSize();
+	}
+#endif
+	if (out->compressed_size)
+		out->compressed = malloc(out->compressed_size);
+
+	out->current = calloc(1, sizeof(BLOCK));
+	out->current->data = malloc(OUTSTREAM_BLOCK_SIZE);
+	out->blocks = 1;
+
+	if (pthread_create(&out->thread, NULL, outstream_run, out) != 0)
+	{
+		out->closing = true;
+		outstream_close(out);
+		return NULL;
+	}
+
+	return out;
+}
+
+/**
+ * Queues the current block and takes a free one, waiting for the writer
+ * thread if all blocks are in flight.
+ **/
+static void outstream_flush(OUTSTREAM * out)
+{
+	pthread_mutex_lock(&out->lock);
+	if (out->queue_tail)
+		out->queue_tail->next = out->current;
+	else
+		out->queue_head = out->current;
+	out->queue_tail = out->current;
+	pthread_cond_broadcast(&out->changed);
+
+	while (!out->free_blocks && out->blocks >= OUTSTREAM_QUEUE_BLOCKS)
+		pthread_cond_wait(&out->changed, &out->lock);
+
+	BLOCK *block = out->free_blocks;
+	if (block)
+		out->free_blocks = block->next;
+	pthread_mutex_unlock(&out->lock);
+
+	if (!block)
+	{
+		block = calloc(1, sizeof(BLOCK));
+		block->data = malloc(OUTSTREAM_BLOCK_SIZE);
+		out->blocks++;
+	}
+	block->next = NULL;
+	out->current = block;
+}
+
+void outstream_write(OUTSTREAM * out, const void *data, size_t len)
+{
+	const char *bytes = data;
+	while (len > 0)
+	{
+		size_t n = OUTSTREAM_BLOCK_SIZE - out->current->len;
+		if (n > len)
+			n = len;
+		memcpy(out->current->data + out->current->len, bytes, n);
+		out->current->len += n;
+		bytes += n;
+		len -= n;
+
+		if (out->current->len == OUTSTREAM_BLOCK_SIZE)
+			outstream_flush(out);
+	}
+}
+
+bool outstream_close(OUTSTREAM * out)
+{
+	if (!out->closing)
+	{
+		if (out->current->len > 0)
+			outstream_flush(out);
+
+		pthread_mutex_lock(&out->lock);
+		out->closing = true;
+		pthread_cond_broadcast(&out->changed);
+		pthread_mutex_unlock(&out->lock);
+		pthread_join(out->thread, NULL);
+	}
+
+	bool ok = !out->failed;
+	if (close(out->fd) != 0)
+		ok = false;
+
+	if (out->format == OUTSTREAM_GZIP)
+		deflateEnd(&out->gzip);
+#ifdef HAVE_ZSTD
+	if (out->zstd)
+		ZSTD_freeCCtx(out->zstd);
+#endif
+	free(out->compressed);
+
+	free(out->current->data);
+	free(out->current);
+	while (out->free_blocks)
+	{
+		BLOCK *block = out->free_blocks;
+		out->free_blocks = block->next;
+		free(block->data);
+		free(block);
+	}
+
+	pthread_mutex_destroy(&out->lock);
+	pthread_cond_destroy(&out->changed);
+	free(out);
+	return ok;
+}
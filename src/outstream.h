@@ -0,0 +1,21 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct OUTSTREAM_S OUTSTREAM;
+
+/**
+ * Creates filename for writing. Names ending in .gz are gzip compressed,
+ * names ending in .zst zstd compressed (if built with ZSTD=1). Writes are
+ * collected in blocks which a separate thread compresses and writes, so
+ * the caller does not wait for compression or the disk.
+ **/
+OUTSTREAM *outstream_open(const char *filename);
+
+void outstream_write(OUTSTREAM * out, const void *data, size_t len);
+
+/**
+ * Writes what is left, closes the file and frees out. Returns false if
+ * anything could not be written.
+ **/
+bool outstream_close(OUTSTREAM * out);
@@ -0,0 +1,382 @@
+#include "snapshot.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SNAPSHOT_MAGIC "LDBSNAP"
+#define SNAPSHOT_VERSION 1
+#define NO_PARENT UINT32_MAX
+#define NODE_IS_LEAF 1
+#define NODE_COLLAPSED 2
+
+/**
+ * File layout: header, key (uri, newline, base), node records in
+ * pre-order so every parent precedes its children, the blob of node
+ * values, then the entries. An entry is its cache key, its DN, the number of attributes
+ * and for each attribute its name, the number of values and the values,
+ * all strings prefixed by their 32 bit length. Integers are stored in
+ * host byte order, the magic doubles as a byte order check.
+ **/
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t key_len;
+	uint64_t num_nodes;
+	uint64_t nodes_offset;
+	uint64_t strings_offset;
+	uint64_t strings_len;
+	uint64_t num_entries;
+	uint64_t entries_offset;
+	uint64_t entries_len;
+} SNAPSHOT_HEADER;
+
+typedef struct {
+	uint32_t parent;	// index of the parent record, NO_PARENT for the root
+	uint32_t flags;
+	uint64_t value_offset;	// into the strings blob
+	uint32_t value_len;
+	uint32_t num_subordinates;
+	uint32_t vlv_offset;
+	uint32_t vlv_count;
+} SNAPSHOT_NODE;
+
+static char *snapshot_key(const char *uri, const char *base)
+{
+	size_t len = strlen(uri) + strlen(base) + 2;
+	char *key = malloc(len);
+	snprintf(key, len, "%s\n%s", uri, base);
+	return key;
+}
+
+// FNV-1a, only used to name the file
+static uint64_t snapshot_hash(const char *s)
+{
+	uint64_t h = 14695981039346656037ULL;
+	for (; *s; s++)
+		h = (h ^ (unsigned char)*s) * 1099511628211ULL;
+	return h;
+}
+
+static bool make_dir(const char *dir)
+{
+	return mkdir(dir, 0700) == 0 || errno == EEXIST;
+}
+
+char *snapshot_path(const char *uri, const char *base)
+{
+	const char *cache_home = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+	char dir[4096];
+
+	if (cache_home && *cache_home)
+		snprintf(dir, sizeof(dir), "%s", cache_home);
+	else if (home && *home)
+		snprintf(dir, sizeof(dir), "%s/.cache", home);
+	else
+		return NULL;
+
+	if (!make_dir(dir))
+		return NULL;
+	strncat(dir, "/ldapbrowse", sizeof(dir) - strlen(dir) - 1);
+	if (!make_dir(dir))
+		return NULL;
+
+	char *key = snapshot_key(uri, base);
+	size_t len = strlen(dir) + 32;
+	char *path = malloc(len);
+	snprintf(path, len, "%s/%016llx.snapshot", dir, (unsigned long long)snapshot_hash(key));
+	free(key);
+	return path;
+}
+
+static void put_string(FILE * f, const char *s, size_t len)
+{
+	uint32_t n = len;
+	fwrite(&n, sizeof(n), 1, f);
+	fwrite(s, 1, len, f);
+}
+
+static void put_entry(const char *dn, ENTRY * e, bool stale, void *ctx)
+{
+	FILE *f = ctx;
+	put_string(f, dn, strlen(dn));
+	put_string(f, e->dn, strlen(e->dn));
+
+	uint32_t num_attributes = e->num_attributes;
+	fwrite(&num_attributes, sizeof(num_attributes), 1, f);
+	for (unsigned i = 0; i < e->num_attributes; i++)
+	{
+		ENTRY_ATTRIBUTE *a = &e->attributes[i];
+		put_string(f, a->name, strlen(a->name));
+
+		uint32_t num_values = a->num_values;
+		fwrite(&num_values, sizeof(num_values), 1, f);
+		for (unsigned j = 0; j < a->num_values; j++)
+			put_string(f, a->values[j].data, a->values[j].len);
+	}
+}
+
+static void count_entry(const char *dn, ENTRY * e, bool stale, void *ctx)
+{
+	(*(uint64_t *) ctx)++;
+}
+
+typedef struct {
+	FILE *f;
+	SNAPSHOT_HEADER *header;
+	char *strings;
+	size_t strings_capacity;
+} SAVE_STATE;
+
+// writes the records of node and its descendants in pre-order
+static void put_nodes(SAVE_STATE * st, TREENODE * node, uint32_t parent)
+{
+	const char *value = node->value ? node->value : "";
+	SNAPSHOT_NODE rec = { parent };
+	rec.flags = (node->is_leaf ? NODE_IS_LEAF : 0) | (node->collapsed ? NODE_COLLAPSED : 0);
+	rec.value_offset = st->header->strings_len;
+	rec.value_len = strlen(value);
+	rec.num_subordinates = node->num_subordinates;
+	rec.vlv_offset = node->vlv_offset;
+	rec.vlv_count = node->vlv_count;
+	fwrite(&rec, sizeof(rec), 1, st->f);
+
+	if (rec.value_offset + rec.value_len > st->strings_capacity)
+	{
+		st->strings_capacity = 2 * st->strings_capacity + rec.value_len;
+		st->strings = realloc(st->strings, st->strings_capacity);
+	}
+	if (rec.value_len)
+		memcpy(st->strings + rec.value_offset, value, rec.value_len);
+	st->header->strings_len += rec.value_len;
+
+	uint32_t index = st->header->num_nodes++;
+	for (unsigned i = 0; i < node->num_children; i++)
+		put_nodes(st, node->children[i], index);
+}
+
+bool snapshot_save(const char *path, const char *uri, const char *base, TREENODE * root,
+		   ENTRY_CACHE * cache)
+{
+	size_t len = strlen(path) + 8;
+	char *tmp = malloc(len);
+	snprintf(tmp, len, "%s.XXXXXX", path);
+	int fd = mkstemp(tmp);
+	FILE *f = fd >= 0 ? fdopen(fd, "wb") : NULL;
+	if (!f)
+	{
+		if (fd >= 0)
+			close(fd);
+		free(tmp);
+		return false;
+	}
+
+	char *key = snapshot_key(uri, base);
+	SNAPSHOT_HEADER header = { SNAPSHOT_MAGIC, SNAPSHOT_VERSION, strlen(key) };
+	fwrite(&header, sizeof(header), 1, f);
+	fwrite(key, 1, header.key_len, f);
+	free(key);
+
+	// node records first, their values are collected for the blob behind them
+	header.nodes_offset = ftell(f);
+	SAVE_STATE st = { f, &header };
+	put_nodes(&st, root, NO_PARENT);
+
+	header.strings_offset = ftell(f);
+	fwrite(st.strings, 1, header.strings_len, f);
+	free(st.strings);
+
+	header.entries_offset = ftell(f);
+	entry_cache_foreach(cache, count_entry, &header.num_entries);
+	entry_cache_foreach(cache, put_entry, f);
+	header.entries_len = ftell(f) - header.entries_offset;
+
+	rewind(f);
+	fwrite(&header, sizeof(header), 1, f);
+
+	bool ok = !ferror(f);
+	ok = fclose(f) == 0 && ok;
+	ok = ok && rename(tmp, path) == 0;
+	if (!ok)
+		unlink(tmp);
+	free(tmp);
+	return ok;
+}
+
+typedef struct {
+	const char *pos, *end;
+} READER;
+
+static bool get_u32(READER * r, uint32_t * n)
+{
+	if ((size_t)(r->end - r->pos) < sizeof(*n))
+		return false;
+	memcpy(n, r->pos, sizeof(*n));
+	r->pos += sizeof(*n);
+	return true;
+}
+
+static bool get_string(READER * r, const char **s, uint32_t * len)
+{
+	if (!get_u32(r, len) || (size_t)(r->end - r->pos) < *len)
+		return false;
+	*s = r->pos;
+	r->pos += *len;
+	return true;
+}
+
+/**
+ * Reads the next entry record, decoding it into *e and its cache key into
+ * *key unless e is NULL (which only checks the record).
+ **/
+static bool get_entry(READER * r, char **key, ENTRY ** e)
+{
+	const char *k, *s;
+	uint32_t key_len, len, num_attributes, num_values;
+	char *str;
+
+	if (!get_string(r, &k, &key_len) || !get_string(r, &s, &len)
+	    || !get_u32(r, &num_attributes))
+		return false;
+	if (e)
+	{
+		*key = strndup(k, key_len);
+		str = strndup(s, len);
+		*e = entry_alloc(str);
+		free(str);
+	}
+
+	for (uint32_t i = 0; i < num_attributes; i++)
+	{
+		if (!get_string(r, &s, &len) || !get_u32(r, &num_values))
+			return false;
+		if (e)
+		{
+			str = strndup(s, len);
+			entry_add_attribute(*e, str);
+			free(str);
+		}
+
+		for (uint32_t j = 0; j < num_values; j++)
+		{
+			if (!get_string(r, &s, &len))
+				return false;
+			if (e)
+				entry_add_value(*e, s, len);
+		}
+	}
+	return true;
+}
+
+static bool range_ok(uint64_t offset, uint64_t len, size_t size)
+{
+	return offset <= size && len <= size - offset;
+}
+
+// checks everything snapshot_load() reads, so building the tree cannot fail half way
+static bool snapshot_check(const char *map, size_t size, const char *key)
+{
+	SNAPSHOT_HEADER h;
+	if (size < sizeof(h))
+		return false;
+	memcpy(&h, map, sizeof(h));
+
+	if (memcmp(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic)) != 0 || h.version != SNAPSHOT_VERSION
+	    || h.key_len != strlen(key) || !range_ok(sizeof(h), h.key_len, size)
+	    || memcmp(map + sizeof(h), key, h.key_len) != 0)
+		return false;
+
+	if (h.num_nodes == 0 || h.num_nodes > UINT32_MAX
+	    || h.num_nodes > (size - sizeof(h)) / sizeof(SNAPSHOT_NODE)
+	    || !range_ok(h.nodes_offset, h.num_nodes * sizeof(SNAPSHOT_NODE), size)
+	    || !range_ok(h.strings_offset, h.strings_len, size)
+	    || !range_ok(h.entries_offset, h.entries_len, size))
+		return false;
+
+	for (uint64_t i = 0; i < h.num_nodes; i++)
+	{
+		SNAPSHOT_NODE rec;
+		memcpy(&rec, map + h.nodes_offset + i * sizeof(rec), sizeof(rec));
+		if ((i == 0) != (rec.parent == NO_PARENT) || (i > 0 && rec.parent >= i)
+		    || !range_ok(rec.value_offset, rec.value_len, h.strings_len))
+			return false;
+	}
+
+	READER r = { map + h.entries_offset, map + h.entries_offset + h.entries_len };
+	for (uint64_t i = 0; i < h.num_entries; i++)
+		if (!get_entry(&r, NULL, NULL))
+			return false;
+	return true;
+}
+
+bool snapshot_load(const char *path, const char *uri, const char *base, TREENODE * root,
+		   ENTRY_CACHE * cache)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	const char *map = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return false;
+
+	char *key = snapshot_key(uri, base);
+	bool ok = snapshot_check(map, st.st_size, key);
+	free(key);
+
+	if (ok)
+	{
+		SNAPSHOT_HEADER h;
+		memcpy(&h, map, sizeof(h));
+		const char *strings = map + h.strings_offset;
+		TREENODE **nodes = malloc(h.num_nodes * sizeof(TREENODE *));
+
+		for (uint64_t i = 0; i < h.num_nodes; i++)
+		{
+			SNAPSHOT_NODE rec;
+			memcpy(&rec, map + h.nodes_offset + i * sizeof(rec), sizeof(rec));
+			char *value = strndup(strings + rec.value_offset, rec.value_len);
+
+			if (i == 0)
+			{
+				free(root->value);
+				root->value = value;
+				nodes[i] = root;
+			} else
+			{
+				nodes[i] = tree_node_alloc_child(nodes[rec.parent], value);
+				free(value);
+			}
+
+			nodes[i]->is_leaf = rec.flags & NODE_IS_LEAF;
+			nodes[i]->num_subordinates = rec.num_subordinates;
+			nodes[i]->vlv_offset = rec.vlv_offset;
+			nodes[i]->vlv_count = rec.vlv_count;
+			tree_node_set_collapsed(nodes[i], rec.flags & NODE_COLLAPSED);
+		}
+		free(nodes);
+
+		READER r = { map + h.entries_offset, map + h.entries_offset + h.entries_len };
+		for (uint64_t i = 0; i < h.num_entries; i++)
+		{
+			char *dn;
+			ENTRY *e;
+			get_entry(&r, &dn, &e);
+			entry_cache_put_stale(cache, dn, e);
+			free(dn);
+		}
+	}
+
+	munmap((void *)map, st.st_size);
+	return ok;
+}
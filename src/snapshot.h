@@ -0,0 +1,36 @@
+#pragma once
+#include <stdbool.h>
+#include "tree.h"
+#include "entrycache.h"
+
+/**
+ * On-disk copy of the loaded tree and the cached entries, so a restart
+ * can show the last state at once and revalidate it in the background.
+ * A snapshot is keyed by the server URI and the base given on the command
+ * line (empty if the base came from the root DSE); loading a file written
+ * for another key fails.
+ **/
+
+/**
+ * Returns the snapshot file for uri and base below $XDG_CACHE_HOME (or
+ * ~/.cache), creating the directory. NULL if there is no home directory.
+ * The caller frees the result.
+ **/
+char *snapshot_path(const char *uri, const char *base);
+
+/**
+ * Writes the nodes below root and all entries of cache to path,
+ * replacing the previous snapshot atomically.
+ **/
+bool snapshot_save(const char *path, const char *uri, const char *base, TREENODE * root,
+		   ENTRY_CACHE * cache);
+
+/**
+ * Maps path and rebuilds the saved tree below root, which must not have
+ * children yet; its value is replaced by the saved base DN. Entries are
+ * put into cache as stale. Returns false, leaving root and cache
+ * untouched, if the file is missing, truncated or was saved for another
+ * key.
+ **/
+bool snapshot_load(const char *path, const char *uri, const char *base, TREENODE * root,
+		   ENTRY_CACHE * cache);
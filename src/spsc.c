@@ -0,0 +1,43 @@
+#include "spsc.h"
+
+#include <stdlib.h>
+
+void spsc_init(SPSC_QUEUE * q)
+{
+	q->head = q->tail = calloc(1, sizeof(SPSC_NODE));
+}
+
+void spsc_destroy(SPSC_QUEUE * q)
+{
+	while (q->head)
+	{
+		SPSC_NODE *next = q->head->next;
+		free(q->head);
+		q->head = next;
+	}
+	q->tail = NULL;
+}
+
+void spsc_push(SPSC_QUEUE * q, void *value)
+{
+	SPSC_NODE *node = malloc(sizeof(SPSC_NODE));
+	node->value = value;
+	node->next = NULL;
+
+	// publishes value and next together with the link
+	__atomic_store_n(&q->tail->next, node, __ATOMIC_RELEASE);
+	q->tail = node;
+}
+
+void *spsc_pop(SPSC_QUEUE * q)
+{
+	SPSC_NODE *next = __atomic_load_n(&q->head->next, __ATOMIC_ACQUIRE);
+	if (!next)
+		return NULL;
+
+	// next becomes the new stub; its value is taken out first
+	void *value = next->value;
+	free(q->head);
+	q->head = next;
+	return value;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <stdbool.h>
+
+/**
+ * Unbounded lock-free queue of pointers between exactly one producer
+ * thread and one consumer thread. Pushing never blocks; a node is
+ * allocated per element and freed by the consumer.
+ **/
+
+typedef struct SPSC_NODE_S {
+	struct SPSC_NODE_S *next;
+	void *value;
+} SPSC_NODE;
+
+typedef struct SPSC_QUEUE_S {
+	SPSC_NODE *head;	// consumer side, the node before the first element
+	char pad[64 - sizeof(SPSC_NODE *)];	// keep the two ends on separate cache lines
+	SPSC_NODE *tail;	// producer side, the last element
+} SPSC_QUEUE;
+
+void spsc_init(SPSC_QUEUE * q);
+
+/**
+ * Frees the queue. Neither side may use it any more; elements still
+ * queued are dropped without being freed.
+ **/
+void spsc_destroy(SPSC_QUEUE * q);
+
+/**
+ * Appends value (not NULL). Producer thread only.
+ **/
+void spsc_push(SPSC_QUEUE * q, void *value);
+
+/**
+ * Removes and returns the oldest element, NULL if the queue is empty.
+ * Consumer thread only.
+ **/
+void *spsc_pop(SPSC_QUEUE * q);
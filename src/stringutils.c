@@ -14,7 +14,7 @@ char *string_after_last(char *str, char c)
 	return ++last;
 }
 
-char *string_before(char *str, char c)
+char *string_before(const char *str, char c)
 {
 	int len;
 	for (len = 0; str[len] != NULL && str[len] != c; len++)
@@ -1,5 +1,5 @@
 #pragma once
 #include <ctype.h>
 char *string_after_last(char *str, char c);
-char *string_before(char *str, char c);
+char *string_before(const char *str, char c);
 char *trim_whitespaces(char *str);
@@ -0,0 +1,80 @@
+#include "syncrepl.h"
+
+#include <string.h>
+
+int sync_control_create(LDAP * ld, int mode, LDAPControl ** controlp)
+{
+	BerElement *ber = ber_alloc_t(LBER_USE_DER);
+	if (!ber)
+		return LDAP_NO_MEMORY;
+
+	// syncRequestValue ::= SEQUENCE { mode ENUMERATED, cookie, reloadHint }
+	struct berval value;
+	int rc = LDAP_ENCODING_ERROR;
+	if (ber_printf(ber, "{e}", (ber_int_t) mode) != -1 && ber_flatten2(ber, &value, 0) == 0)
+		rc = ldap_control_create(LDAP_CONTROL_SYNC, 1, &value, 1, controlp);
+
+	ber_free(ber, 1);
+	return rc;
+}
+
+bool sync_parse_state(LDAP * ld, LDAPMessage * entry, int *state,
+		      unsigned char uuid[SYNC_UUID_SIZE])
+{
+	LDAPControl **controls = NULL;
+	if (ldap_get_entry_controls(ld, entry, &controls) != LDAP_SUCCESS)
+		return false;
+
+	bool found = false;
+	LDAPControl *control = ldap_control_find(LDAP_CONTROL_SYNC_STATE, controls, NULL);
+	BerElement *ber = control ? ber_init(&control->ldctl_value) : NULL;
+	if (ber)
+	{
+		// syncStateValue ::= SEQUENCE { state ENUMERATED, entryUUID, cookie OPTIONAL }
+		ber_int_t value;
+		struct berval id;
+		if (ber_scanf(ber, "{em", &value, &id) != LBER_ERROR && id.bv_len == SYNC_UUID_SIZE)
+		{
+			*state = value;
+			memcpy(uuid, id.bv_val, SYNC_UUID_SIZE);
+			found = true;
+		}
+		ber_free(ber, 1);
+	}
+
+	ldap_controls_free(controls);
+	return found;
+}
+
+bool sync_parse_refresh_done(LDAP * ld, LDAPMessage * msg)
+{
+	char *oid = NULL;
+	struct berval *data = NULL;
+	if (ldap_parse_intermediate(ld, msg, &oid, &data, NULL, 0) != LDAP_SUCCESS)
+		return false;
+
+	bool done = false;
+	BerElement *ber = oid && data && strcmp(oid, LDAP_SYNC_INFO) == 0 ? ber_init(data) : NULL;
+	if (ber)
+	{
+		// refreshDelete and refreshPresent are SEQUENCE { cookie OPTIONAL, refreshDone DEFAULT TRUE }
+		ber_len_t len;
+		ber_tag_t tag = ber_peek_tag(ber, &len);
+		if ((tag == LDAP_TAG_SYNC_REFRESH_DELETE || tag == LDAP_TAG_SYNC_REFRESH_PRESENT)
+		    && ber_scanf(ber, "{") != LBER_ERROR)
+		{
+			done = true;
+			if (ber_peek_tag(ber, &len) == LDAP_TAG_SYNC_COOKIE)
+				ber_scanf(ber, "x");
+			ber_int_t refresh_done;
+			if (ber_peek_tag(ber, &len) == LDAP_TAG_REFRESHDONE
+			    && ber_scanf(ber, "b", &refresh_done) != LBER_ERROR)
+				done = refresh_done;
+		}
+		ber_free(ber, 1);
+	}
+
+	ldap_memfree(oid);
+	ber_bvfree(data);
+	return done;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <stdbool.h>
+#include <ldap.h>
+
+#define SYNC_UUID_SIZE 16
+
+/**
+ * Builds a content synchronization request control (RFC 4533) for mode
+ * (LDAP_SYNC_REFRESH_ONLY or LDAP_SYNC_REFRESH_AND_PERSIST), without a
+ * cookie, so the refresh phase sends the whole content.
+ **/
+int sync_control_create(LDAP * ld, int mode, LDAPControl ** controlp);
+
+/**
+ * Reads the sync state control of a search entry: one of LDAP_SYNC_PRESENT,
+ * LDAP_SYNC_ADD, LDAP_SYNC_MODIFY or LDAP_SYNC_DELETE, and the entryUUID.
+ * Returns false if the entry carries none.
+ **/
+bool sync_parse_state(LDAP * ld, LDAPMessage * entry, int *state,
+		      unsigned char uuid[SYNC_UUID_SIZE]);
+
+/**
+ * Returns true if msg is a sync info message ending the refresh phase,
+ * after which changes are only reported as they happen.
+ **/
+bool sync_parse_refresh_done(LDAP * ld, LDAPMessage * msg);
@@ -1,62 +1,532 @@
 #include "tree.h"
+#include <ctype.h>
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 
 TREENODE *tree_node_alloc()
 {
 	TREENODE *result = calloc(1, sizeof(TREENODE));
+	result->subtree_size = 1;
 	return result;
 }
 
 void tree_node_free(TREENODE * n)
 {
 	tree_node_remove_childs(n);
+	if (n->arena)
+		arena_free(n->arena);
+	n->arena = NULL;
+
+	if (n->in_arena)
+		return;
+
 	free(n->value);
+	free(n->dn);
 	n->parent = NULL;
 	n->value = NULL;
+	n->dn = NULL;
 	free(n);
 }
 
 unsigned tree_node_children_count(TREENODE * root)
 {
-	unsigned i;
-	for (i = 0; root->children && root->children[i] != NULL; i++)
-		;
-	return i;
+	return root->num_children;
 }
 
 TREENODE* tree_node_get_parent(TREENODE* root, TREENODE *node) {
-	for (unsigned i = 0; root->children && root->children[i] != NULL; i++) {
-    if(root->children[i] == node)
-      return root;
-    else {
-      TREENODE * sub = tree_node_get_parent(root->children[i], node);
-      if(sub)
-        return sub;
-    }
+	for (TREENODE *n = node->parent; n; n = n->parent) {
+    if(n == root)
+      return node->parent;
   }
   return NULL;
 }
 
-void tree_node_append_child(TREENODE * root, TREENODE * child)
+/*
+ * child_sizes is a Fenwick tree (1-based) over the subtree sizes of the
+ * children, so prefix sums and the child covering a row take O(log n).
+ */
+
+static void child_sizes_add(TREENODE * n, unsigned index, long delta)
+{
+	for (unsigned j = index + 1; j <= n->num_children; j += j & -j)
+		n->child_sizes[j] += delta;
+}
+
+static unsigned child_sizes_prefix(TREENODE * n, unsigned count)
+{
+	unsigned sum = 0;
+	for (unsigned j = count; j > 0; j -= j & -j)
+		sum += n->child_sizes[j];
+	return sum;
+}
+
+/**
+ * Returns the index of the child whose subtree holds row (counting from
+ * the first child) and reduces row to an offset into that subtree.
+ **/
+static unsigned child_sizes_find(TREENODE * n, unsigned *row)
 {
-	unsigned old_list_len = tree_node_children_count(root) + 1;
+	unsigned step = 1, pos = 0;
+	while (step * 2 <= n->num_children)
+		step *= 2;
+
+	for (; step; step /= 2)
+	{
+		if (pos + step <= n->num_children && n->child_sizes[pos + step] <= *row)
+		{
+			pos += step;
+			*row -= n->child_sizes[pos];
+		}
+	}
+	return pos;
+}
+
+/**
+ * Adds delta to the subtree size of n and all its ancestors, up to the
+ * first collapsed one: its children keep their sizes for when it is
+ * expanded again, but its own row count stays 1.
+ **/
+static void tree_node_propagate(TREENODE * n, long delta)
+{
+	if (n->collapsed)
+		return;
+
+	n->subtree_size += delta;
+	for (; n->parent; n = n->parent)
+	{
+		child_sizes_add(n->parent, n->index_in_parent, delta);
+		if (n->parent->collapsed)
+			break;
+		n->parent->subtree_size += delta;
+	}
+}
+
+void tree_node_set_collapsed(TREENODE * n, bool collapsed)
+{
+	if (n->collapsed == collapsed)
+		return;
+
+	long rows = collapsed ? 1 : 1 + child_sizes_prefix(n, n->num_children);
+	n->collapsed = false;
+	tree_node_propagate(n, rows - (long)n->subtree_size);
+	n->collapsed = collapsed;
+}
+
+void tree_node_reserve_children(TREENODE * root, unsigned count)
+{
+	if (count <= root->children_capacity)
+		return;
+
+	root->children = realloc(root->children, count * sizeof(TREENODE *));
+	root->child_sizes = realloc(root->child_sizes, (count + 1) * sizeof(unsigned));
+	root->children_capacity = count;
+}
+
+static void tree_node_grow_children(TREENODE * root, unsigned count)
+{
+	unsigned needed = root->num_children + count;
+	if (needed <= root->children_capacity)
+		return;
+
+	unsigned capacity = root->children_capacity ? root->children_capacity : 4;
+	while (capacity < needed)
+		capacity *= 2;
+	tree_node_reserve_children(root, capacity);
+}
+
+/*
+ * child_index is an open addressing table of the children by value
+ * (case-insensitively), built by the first lookup in a container with
+ * more than CHILD_INDEX_MIN children. Children marked removed leave a
+ * tombstone until the table is rebuilt.
+ */
+
+#define CHILD_INDEX_MIN 8
+
+static TREENODE child_index_tombstone;
+
+static unsigned value_hash(const char *value, size_t len)
+{
+	unsigned hash = 5381;
+	for (size_t i = 0; i < len; i++)
+		hash = hash * 33 + tolower((unsigned char)value[i]);
+	return hash;
+}
+
+static bool value_equals(const char *value, const char *s, size_t len)
+{
+	return value && strncasecmp(value, s, len) == 0 && value[len] == '\0';
+}
+
+static void child_index_put(TREENODE * root, TREENODE * child)
+{
+	unsigned slot = value_hash(child->value, strlen(child->value)) & root->child_index_mask;
+	while (root->child_index[slot])
+		slot = (slot + 1) & root->child_index_mask;
+	root->child_index[slot] = child;
+	root->child_index_used++;
+}
+
+static void child_index_build(TREENODE * root)
+{
+	unsigned size = 16;
+	while (size < 4 * root->num_children)
+		size *= 2;
+
+	free(root->child_index);
+	root->child_index = calloc(size, sizeof(TREENODE *));
+	root->child_index_mask = size - 1;
+	root->child_index_used = 0;
+	for (unsigned i = 0; i < root->num_children; i++)
+		if (root->children[i]->value && !root->children[i]->removed)
+			child_index_put(root, root->children[i]);
+}
+
+// keeps the table at most half full, tombstones included
+static void child_index_add(TREENODE * root, TREENODE * child)
+{
+	if (!root->child_index || !child->value)
+		return;
+	if (2 * (root->child_index_used + 1) > root->child_index_mask + 1)
+		child_index_build(root);
+	else
+		child_index_put(root, child);
+}
+
+static void child_index_remove(TREENODE * root, TREENODE * child)
+{
+	if (!root->child_index || !child->value)
+		return;
+
+	unsigned slot = value_hash(child->value, strlen(child->value)) & root->child_index_mask;
+	while (root->child_index[slot] && root->child_index[slot] != child)
+		slot = (slot + 1) & root->child_index_mask;
+	if (root->child_index[slot])
+		root->child_index[slot] = &child_index_tombstone;
+}
+
+static TREENODE *child_lookup(TREENODE * root, const char *value, size_t len)
+{
+	if (!root->child_index && root->num_children > CHILD_INDEX_MIN)
+		child_index_build(root);
+
+	if (!root->child_index)
+	{
+		for (unsigned i = 0; i < root->num_children; i++)
+		{
+			TREENODE *child = root->children[i];
+			if (!child->removed && value_equals(child->value, value, len))
+				return child;
+		}
+		return NULL;
+	}
+
+	unsigned mask = root->child_index_mask;
+	for (unsigned slot = value_hash(value, len) & mask; root->child_index[slot]; slot = (slot + 1) & mask)
+	{
+		TREENODE *child = root->child_index[slot];
+		if (child != &child_index_tombstone && value_equals(child->value, value, len))
+			return child;
+	}
+	return NULL;
+}
+
+TREENODE *tree_node_child(TREENODE * root, const char *value)
+{
+	return child_lookup(root, value, strlen(value));
+}
+
+/**
+ * Builds the DN of child below parent, in the arena of parent for arena
+ * children and on the heap otherwise, and again for the subtree below
+ * it, which may have been built before child was appended.
+ **/
+static void tree_node_set_dn(TREENODE * parent, TREENODE * child)
+{
+	const char *parent_dn = tree_node_dn(parent);
+	if (!child->in_arena)
+		free(child->dn);
+
+	if (!child->value || !parent_dn || !*parent_dn)
+		child->dn = child->in_arena ? child->value : NULL;
+	else
+	{
+		size_t value_len = strlen(child->value);
+		size_t parent_len = strlen(parent_dn);
+		child->dn = child->in_arena ? arena_malloc(parent->arena, value_len + parent_len + 2)
+		    : malloc(value_len + parent_len + 2);
+		memcpy(child->dn, child->value, value_len);
+		child->dn[value_len] = ',';
+		memcpy(child->dn + value_len + 1, parent_dn, parent_len + 1);
+	}
+
+	for (unsigned i = 0; i < child->num_children; i++)
+		tree_node_set_dn(child, child->children[i]);
+}
+
+static void tree_node_push_child(TREENODE * root, TREENODE * child)
+{
+	tree_node_set_dn(root, child);
 	child->parent = root;
-	root->children = realloc(root->children, (old_list_len + 1) * sizeof(TREENODE *));
-	root->children[old_list_len - 1] = child;
-	root->children[old_list_len] = NULL;
+	child->index_in_parent = root->num_children;
+	root->children[root->num_children++] = child;
+	child_index_add(root, child);
+
+	unsigned j = root->num_children;
+	root->child_sizes[j] = child->subtree_size + child_sizes_prefix(root, j - 1)
+	    - child_sizes_prefix(root, j - (j & -j));
+}
+
+void tree_node_append_child(TREENODE * root, TREENODE * child)
+{
+	tree_node_grow_children(root, 1);
+	tree_node_push_child(root, child);
+	tree_node_propagate(root, child->subtree_size);
+}
+
+void tree_node_append_children(TREENODE * root, TREENODE ** children, unsigned count)
+{
+	tree_node_grow_children(root, count);
+
+	long added = 0;
+	for (unsigned i = 0; i < count; i++)
+	{
+		tree_node_push_child(root, children[i]);
+		added += children[i]->subtree_size;
+	}
+	tree_node_propagate(root, added);
+}
+
+TREENODE *tree_node_alloc_child(TREENODE * root, const char *value)
+{
+	if (!root->arena)
+		root->arena = arena_alloc();
+
+	TREENODE *child = arena_malloc(root->arena, sizeof(TREENODE));
+	memset(child, 0, sizeof(TREENODE));
+	child->value = arena_strdup(root->arena, value);
+	child->in_arena = true;
+	child->subtree_size = 1;
+
+	tree_node_append_child(root, child);
+	return child;
 }
 
 void tree_node_remove_childs(TREENODE * n)
 {
-	for (unsigned i = 0; n->children && n->children[i] != NULL; i++)
+	for (unsigned i = 0; i < n->num_children; i++)
 	{
-		tree_node_free(n->children[i]);
+		TREENODE *child = n->children[i];
+		// detached, so freeing it does not update our sizes child by child
+		child->parent = NULL;
+		// arena children without children of their own need no work at all
+		if (!child->in_arena || child->children || child->arena)
+			tree_node_free(child);
 		n->children[i] = NULL;
 	}
 
-	if (n->children)
+	if (n->arena)
+		arena_reset(n->arena);
+
+	free(n->children);
+	n->children = NULL;
+	free(n->child_sizes);
+	n->child_sizes = NULL;
+	free(n->child_index);
+	n->child_index = NULL;
+	n->child_index_mask = n->child_index_used = 0;
+	n->num_children = 0;
+	n->children_capacity = 0;
+
+	tree_node_propagate(n, 1 - (long)n->subtree_size);
+}
+
+// rebuilds the Fenwick tree in place: every slot passes its sum on to its parent slot
+static void child_sizes_rebuild(TREENODE * root)
+{
+	for (unsigned j = 1; j <= root->num_children; j++)
+		root->child_sizes[j] = root->children[j - 1]->subtree_size;
+	for (unsigned j = 1; j <= root->num_children; j++)
+	{
+		unsigned up = j + (j & -j);
+		if (up <= root->num_children)
+			root->child_sizes[up] += root->child_sizes[j];
+	}
+}
+
+void tree_node_remove_child(TREENODE * root, unsigned index)
+{
+	TREENODE *child = root->children[index];
+	long size = child->subtree_size;
+	child_index_remove(root, child);
+	child->parent = NULL;
+	tree_node_free(child);
+
+	root->num_children--;
+	for (unsigned i = index; i < root->num_children; i++)
+	{
+		root->children[i] = root->children[i + 1];
+		root->children[i]->index_in_parent = i;
+	}
+
+	child_sizes_rebuild(root);
+	tree_node_propagate(root, -size);
+}
+
+void tree_node_mark_removed(TREENODE * node)
+{
+	if (node->removed)
+		return;
+	node->removed = true;
+	if (node->parent)
+		child_index_remove(node->parent, node);
+}
+
+unsigned tree_node_remove_marked(TREENODE * root)
+{
+	unsigned kept = 0;
+	long size = 0;
+	for (unsigned i = 0; i < root->num_children; i++)
+	{
+		TREENODE *child = root->children[i];
+		if (child->removed)
+		{
+			size += child->subtree_size;
+			child->parent = NULL;
+			tree_node_free(child);
+			continue;
+		}
+		child->index_in_parent = kept;
+		root->children[kept++] = child;
+	}
+
+	unsigned removed = root->num_children - kept;
+	if (removed == 0)
+		return 0;
+
+	root->num_children = kept;
+	child_sizes_rebuild(root);
+	// drops the tombstones
+	if (root->child_index)
+		child_index_build(root);
+	tree_node_propagate(root, -size);
+	return removed;
+}
+
+const char *tree_node_dn(TREENODE * node)
+{
+	return node->dn ? node->dn : node->value;
+}
+
+// whether dn is node_dn or lies below it, everything lies below the empty DN
+static bool dn_has_suffix(const char *dn, size_t len, const char *node_dn)
+{
+	size_t node_len = strlen(node_dn);
+	if (node_len == 0)
+		return true;
+	return node_len <= len && strcasecmp(dn + len - node_len, node_dn) == 0
+	    && (node_len == len || dn[len - node_len - 1] == ',');
+}
+
+/**
+ * Returns the node below node named by the first count RDNs of dn, which
+ * start at starts. A value may hold several RDNs, as below the empty DN,
+ * so every level tries the candidates from the shortest one on.
+ **/
+static TREENODE *tree_node_find_rdns(TREENODE * node, const char *dn, const size_t *starts, unsigned count)
+{
+	if (count == 0)
+		return node;
+
+	for (unsigned first = count; first-- > 0;)
+	{
+		TREENODE *child = child_lookup(node, dn + starts[first], starts[count] - 1 - starts[first]);
+		TREENODE *found = child ? tree_node_find_rdns(child, dn, starts, first) : NULL;
+		if (found)
+			return found;
+	}
+	return NULL;
+}
+
+TREENODE *tree_node_find(TREENODE * root, const char *dn)
+{
+	size_t len = strlen(dn);
+	const char *root_dn = tree_node_dn(root);
+	if (!dn_has_suffix(dn, len, root_dn))
+		return NULL;
+
+	// the part of dn below root, without the separating comma
+	size_t root_len = strlen(root_dn), end = len;
+	if (root_len > 0)
+		end = root_len == len ? 0 : len - root_len - 1;
+	if (end == 0)
+		return root;
+
+	// starts of its RDNs, with a sentinel one past the end
+	unsigned count = 1;
+	for (size_t i = 0; i < end; i++)
+		if (dn[i] == '\\')
+			i++;
+		else if (dn[i] == ',')
+			count++;
+	size_t starts[count + 1];
+	starts[0] = 0;
+	for (size_t i = 0, k = 1; i < end; i++)
+		if (dn[i] == '\\')
+			i++;
+		else if (dn[i] == ',')
+			starts[k++] = i + 1;
+	starts[count] = end + 1;
+
+	return tree_node_find_rdns(root, dn, starts, count);
+}
+
+TREENODE *tree_node_at_row(TREENODE * root, unsigned row)
+{
+	TREENODE *n = root;
+	while (n && row > 0)
+	{
+		if (row >= n->subtree_size)
+			return NULL;
+
+		row--;
+		n = n->children[child_sizes_find(n, &row)];
+	}
+	return n;
+}
+
+bool tree_node_row(TREENODE * root, TREENODE * node, unsigned *row)
+{
+	unsigned result = 0;
+	for (TREENODE * n = node; n != root; n = n->parent)
 	{
-		free(n->children);
-		n->children = NULL;
+		if (!n->parent || n->parent->collapsed)
+			return false;
+		result += 1 + child_sizes_prefix(n->parent, n->index_in_parent);
 	}
+
+	*row = result;
+	return true;
+}
+
+TREENODE *tree_node_next(TREENODE * root, TREENODE * node)
+{
+	if (node->num_children > 0 && !node->collapsed)
+		return node->children[0];
+
+	for (; node != root && node->parent; node = node->parent)
+	{
+		if (node->index_in_parent + 1 < node->parent->num_children)
+			return node->parent->children[node->index_in_parent + 1];
+	}
+	return NULL;
+}
+
+unsigned tree_node_depth(TREENODE * root, TREENODE * node)
+{
+	unsigned depth = 0;
+	for (; node && node != root; node = node->parent)
+		depth++;
+	return depth;
 }
@@ -1,9 +1,27 @@
 #pragma once
+#include <stdbool.h>
+#include "arena.h"
 
 typedef struct TREENODE_S {
 	char *value;
+	char *dn;		// full DN of children, see tree_node_dn()
+	bool is_leaf;		// server reported no subordinates
+	unsigned num_subordinates;	// as reported by the server, 0 if unknown
+	unsigned vlv_offset;	// list position of the first child if loaded through VLV, else 0
+	unsigned vlv_count;	// size of the server side list, see vlv.h
 	struct TREENODE_S *parent;
 	struct TREENODE_S **children;
+	unsigned num_children;
+	unsigned children_capacity;
+	unsigned *child_sizes;	// subtree sizes of the children, see tree.c
+	unsigned index_in_parent;
+	unsigned subtree_size;	// number of rows: this node and its visible descendants
+	bool collapsed;		// children stay loaded but are not shown
+	bool removed;		// marked for tree_node_remove_marked()
+	struct TREENODE_S **child_index;	// children by value, see tree.c
+	unsigned child_index_mask, child_index_used;
+	ARENA *arena;		// holds children created by tree_node_alloc_child()
+	bool in_arena;		// node and value live in the parent's arena
 } TREENODE;
 
 TREENODE *tree_node_alloc();
@@ -14,5 +32,94 @@ unsigned tree_node_children_count(TREENODE * root);
 
 TREENODE* tree_node_get_parent(TREENODE* root, TREENODE *node);
 
+/**
+ * Makes room for at least count children without further reallocation.
+ **/
+void tree_node_reserve_children(TREENODE * root, unsigned count);
+
 void tree_node_append_child(TREENODE * root, TREENODE * child);
+
+/**
+ * Creates a child with a copy of value, both stored in the arena of root,
+ * and appends it. Such children are released together when the children
+ * of root are removed.
+ **/
+TREENODE *tree_node_alloc_child(TREENODE * root, const char *value);
+
+/**
+ * Returns the DN of node. It is built from the parent chain when the node
+ * is appended (for a subtree appended as a whole, for all of its nodes);
+ * the tree root holds its full DN in value.
+ **/
+const char *tree_node_dn(TREENODE * node);
+
+/**
+ * Returns the loaded node with the given DN below root (as built by
+ * tree_node_dn(), compared case-insensitively), NULL if there is none or
+ * it is marked removed. Takes O(depth) once a container was indexed.
+ **/
+TREENODE *tree_node_find(TREENODE * root, const char *dn);
+
+/**
+ * Returns the child of root whose value is value (case-insensitively),
+ * NULL if there is none or it is marked removed.
+ **/
+TREENODE *tree_node_child(TREENODE * root, const char *value);
+
+/**
+ * Appends count children at once.
+ **/
+void tree_node_append_children(TREENODE * root, TREENODE ** children, unsigned count);
+
 void tree_node_remove_childs(TREENODE * node);
+
+/**
+ * Removes the child at index with its subtree, the following children
+ * move up. A child created by tree_node_alloc_child() keeps its slot in
+ * the arena until all children of root are removed. Takes O(children).
+ **/
+void tree_node_remove_child(TREENODE * root, unsigned index);
+
+/**
+ * Marks node to be removed by tree_node_remove_marked() on its parent. It
+ * keeps its row until then, but is no longer found by tree_node_find().
+ **/
+void tree_node_mark_removed(TREENODE * node);
+
+/**
+ * Removes the marked children of root with their subtrees, the others
+ * keep their order. Takes O(children) however many go; returns their
+ * number.
+ **/
+unsigned tree_node_remove_marked(TREENODE * root);
+
+/**
+ * Hides or shows the children of node. Rows only cover the children of
+ * expanded nodes; children are still added and removed below collapsed
+ * nodes and show up once they are expanded again.
+ **/
+void tree_node_set_collapsed(TREENODE * node, bool collapsed);
+
+/**
+ * Returns the node in row (pre-order, row 0 being root), NULL if the tree
+ * has fewer rows. Takes O(depth * log children).
+ **/
+TREENODE *tree_node_at_row(TREENODE * root, unsigned row);
+
+/**
+ * Stores the pre-order row of node below root in row.
+ * Returns false if node is not part of the tree or hidden by a collapsed
+ * ancestor.
+ **/
+bool tree_node_row(TREENODE * root, TREENODE * node, unsigned *row);
+
+/**
+ * Returns the row following node in pre-order, skipping the children of
+ * collapsed nodes, NULL after the last row below root.
+ **/
+TREENODE *tree_node_next(TREENODE * root, TREENODE * node);
+
+/**
+ * Returns the number of edges between node and root.
+ **/
+unsigned tree_node_depth(TREENODE * root, TREENODE * node);
@@ -1,6 +1,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <stdio.h>
 #include <menu.h>
 #include "treeview.h"
 
@@ -38,54 +39,15 @@ bool treeview_node_index(struct TREENODE_S *root, struct TREENODE_S *searchedNod
 	if (!root)
 		return false;
 
-	if (searchedNode == root)
-	{
-		return true;
-	}
-
-	(*index)++;
-
-	for (unsigned i = 0; root->children && root->children[i] != NULL; i++)
-	{
-		if (treeview_node_index(root->children[i], searchedNode, index))
-		{
-			return true;
-		}
-	}
-
-	return NULL;
+	return tree_node_row(root, searchedNode, index);
 }
 
-TREENODE *treeview_node_with_index_inner(struct TREENODE_S * node, unsigned requestedIndex,
-					 unsigned *currentIndex)
+TREENODE *treeview_node_with_index(struct TREENODE_S * node, unsigned requestedIndex)
 {
 	if (!node)
 		return NULL;
 
-	if (requestedIndex == *currentIndex)
-	{
-		return node;
-	}
-
-	(*currentIndex)++;
-
-	for (unsigned i = 0; node->children && node->children[i] != NULL; i++)
-	{
-		TREENODE *result =
-		    treeview_node_with_index_inner(node->children[i], requestedIndex, currentIndex);
-		if (result)
-		{
-			return result;
-		}
-	}
-
-	return NULL;
-}
-
-TREENODE *treeview_node_with_index(struct TREENODE_S * node, unsigned requestedIndex)
-{
-	unsigned index = 0;
-	return treeview_node_with_index_inner(node, requestedIndex, &index);
+	return tree_node_at_row(node, requestedIndex);
 }
 
 TREENODE *treeview_current_node(TREEVIEW * tv)
@@ -118,45 +80,90 @@ void treeview_set_current(TREEVIEW * tv, TREENODE * node)
 	treeview_driver(tv, 0);
 }
 
-unsigned treeview_draw(TREEVIEW * tv, struct TREENODE_S *node, unsigned indent, unsigned index)
+void treeview_rows_inserted(TREEVIEW * tv, unsigned row, unsigned count)
 {
-	unsigned oldIndex = index;
-	if (!node)
-		return 0;
+	if (row < tv->currentItemIndex)
+		tv->currentItemIndex += count;
+	if (row < tv->toprow)
+		tv->toprow += count;
+}
+
+/**
+ * Returns the mark drawn in front of node: '-' if its children are shown,
+ * '+' if it can be expanded, ' ' for leaves.
+ **/
+static char treeview_marker(TREENODE * node)
+{
+	if (node->num_children && !node->collapsed)
+		return '-';
+	return node->is_leaf ? ' ' : '+';
+}
 
-	if (index >= tv->toprow)
+/**
+ * Draws the rows from toprow on, visiting only the nodes that are visible.
+ **/
+void treeview_draw(TREEVIEW * tv)
+{
+	unsigned index = tv->toprow, row = 0;
+	TREENODE *node = treeview_node_with_index(tv->root, index);
+
+	for (; node && row < tv->height; node = tree_node_next(tv->root, node), row++, index++)
 	{
-		wattrset(tv->win, 0);
-		if (index == tv->currentItemIndex)
+		unsigned indent = 2 * tree_node_depth(tv->root, node);
+
+		wattrset(tv->win, index == tv->currentItemIndex ? A_REVERSE : 0);
+		wmove(tv->win, row, 0);
+		wprintw(tv->win, "%*s", min(indent, tv->width), "");
+		if (indent + 2 <= tv->width)
 		{
-			wattrset(tv->win, A_REVERSE);
+			waddch(tv->win, treeview_marker(node));
+			waddch(tv->win, ' ');
+			waddnstr(tv->win, node->value, tv->width - indent - 2);
 		}
 
-		for (unsigned i = 0; i < indent; i++)
+		if (node->collapsed && node->num_children)
 		{
-			waddstr(tv->win, " ");
+			int y, x;
+			getyx(tv->win, y, x);
+			if (y == row && x < tv->width)
+				waddnstr(tv->win, " [+]", tv->width - x);
 		}
-		waddstr(tv->win, node->value);
 
-		for (unsigned i = 0; i < (tv->width - strlen(node->value) - indent); i++)
+		// containers listed through VLV only hold a window of their children
+		if (node->vlv_offset && node->num_children)
 		{
-			waddstr(tv->win, " ");
+			char range[64];
+			int y, x;
+			snprintf(range, sizeof(range), " (%u-%u of %u)", node->vlv_offset,
+				 node->vlv_offset + node->num_children - 1, node->vlv_count);
+			getyx(tv->win, y, x);
+			if (y == row && x < tv->width)
+				waddnstr(tv->win, range, tv->width - x);
+		}
+
+		if (index == tv->currentItemIndex)
+		{
+			int y, x;
+			getyx(tv->win, y, x);
+			if (y == row && x < tv->width)
+				whline(tv->win, ' ' | A_REVERSE, tv->width - x);
+		} else
+		{
+			wclrtoeol(tv->win);
 		}
 	}
-	index++;
 
-	for (unsigned i = 0; node->children && node->children[i] != NULL; i++)
+	wattrset(tv->win, 0);
+	if (row < tv->height)
 	{
-		index += treeview_draw(tv, node->children[i], indent + 2, index);
+		wmove(tv->win, row, 0);
+		wclrtobot(tv->win);
 	}
-	return index - oldIndex;
 }
 
 unsigned treeview_num_nodes(TREEVIEW * tv)
 {
-	unsigned index = 0;
-	treeview_node_with_index_inner(tv->root, -1, &index);
-	return index;
+	return tv->root ? tv->root->subtree_size : 0;
 }
 
 void treeview_driver(TREEVIEW * tv, int c)
@@ -193,7 +200,49 @@ void treeview_driver(TREEVIEW * tv, int c)
 		tv->toprow = tv->currentItemIndex - tv->height + 1;
 	}
 
-	werase(tv->win);
-	treeview_draw(tv, tv->root, 0, 0);
+	treeview_draw(tv);
 	wrefresh(tv->win);
 }
+
+void treeview_move(TREEVIEW * tv, int rows)
+{
+	long index = (long)tv->currentItemIndex + rows;
+	tv->currentItemIndex = index < 0 ? 0 : index;
+	treeview_driver(tv, 0);
+}
+
+int treeview_navigation_rows(TREEVIEW * tv, int c)
+{
+	switch (c)
+	{
+	case KEY_UP:
+		return -1;
+	case KEY_DOWN:
+		return 1;
+	case KEY_PPAGE:
+		return -(int)tv->height;
+	case KEY_NPAGE:
+		return tv->height;
+	}
+	return 0;
+}
+
+int treeview_drain_navigation(TREEVIEW * tv)
+{
+	int rows = 0, c;
+
+	timeout(0);
+	while ((c = getch()) != ERR)
+	{
+		int delta = treeview_navigation_rows(tv, c);
+		if (!delta)
+		{
+			ungetch(c);
+			break;
+		}
+		rows += delta;
+	}
+	timeout(-1);
+
+	return rows;
+}
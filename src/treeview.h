@@ -31,4 +31,35 @@ TREENODE *treeview_current_node(TREEVIEW * tv);
 
 void treeview_set_current(TREEVIEW * tv, TREENODE * node);
 
+/**
+ * Keeps the selection and the scroll position on their nodes after count
+ * rows were inserted right below row (e.g. children appended to the node
+ * shown there). Does not redraw.
+ **/
+void treeview_rows_inserted(TREEVIEW * tv, unsigned row, unsigned count);
+
+/**
+ * Return the node shown in row index (counting from the tree root)
+ **/
+TREENODE *treeview_node_with_index(struct TREENODE_S *node, unsigned requestedIndex);
+
+unsigned treeview_num_nodes(TREEVIEW * tv);
+
 void treeview_driver(TREEVIEW * tv, int c);
+
+/**
+ * Moves the selection by rows (negative moves up) and redraws once
+ **/
+void treeview_move(TREEVIEW * tv, int rows);
+
+/**
+ * Returns the rows navigation key c moves the selection (negative moves
+ * up), 0 for other keys.
+ **/
+int treeview_navigation_rows(TREEVIEW * tv, int c);
+
+/**
+ * Consumes navigation keys that are already queued (e.g. by key repeat)
+ * and returns the net number of rows they move.
+ **/
+int treeview_drain_navigation(TREEVIEW * tv);
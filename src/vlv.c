@@ -0,0 +1,70 @@
+#include "vlv.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+int vlv_controls_create(LDAP * ld, const char *sort_key, int before, int after, int offset,
+			int count, const char *assertion, LDAPControl *** controlsp)
+{
+	LDAPControl **controls = calloc(3, sizeof(LDAPControl *));
+
+	LDAPSortKey **keys = NULL;
+	char *key_string = strdup(sort_key);
+	int rc = ldap_create_sort_keylist(&keys, key_string);
+	free(key_string);
+	if (rc == LDAP_SUCCESS)
+	{
+		rc = ldap_create_sort_control(ld, keys, 1, &controls[0]);
+		ldap_free_sort_keylist(keys);
+	}
+
+	if (rc == LDAP_SUCCESS)
+	{
+		struct berval value = { assertion ? strlen(assertion) : 0, (char *)assertion };
+		LDAPVLVInfo info = { 0 };
+		info.ldvlv_version = 1;
+		info.ldvlv_before_count = before;
+		info.ldvlv_after_count = after;
+		info.ldvlv_offset = offset;
+		info.ldvlv_count = count;
+		info.ldvlv_attrvalue = assertion ? &value : NULL;
+		info.ldvlv_context = NULL;
+		rc = ldap_create_vlv_control(ld, &info, &controls[1]);
+	}
+
+	if (rc != LDAP_SUCCESS)
+	{
+		vlv_controls_free(controls);
+		return rc;
+	}
+
+	*controlsp = controls;
+	return LDAP_SUCCESS;
+}
+
+void vlv_controls_free(LDAPControl ** controls)
+{
+	for (unsigned i = 0; controls[i]; i++)
+		ldap_control_free(controls[i]);
+	free(controls);
+}
+
+bool vlv_parse_response(LDAP * ld, LDAPControl ** controls, int *target_pos, int *list_count)
+{
+	LDAPControl *response = ldap_control_find(LDAP_CONTROL_VLVRESPONSE, controls, NULL);
+	if (!response)
+		return false;
+
+	ber_int_t target, count, error;
+	struct berval *context = NULL;
+	if (ldap_parse_vlvresponse_control(ld, response, &target, &count, &context, &error) !=
+	    LDAP_SUCCESS)
+		return false;
+
+	if (context)
+		ber_bvfree(context);
+
+	*target_pos = target;
+	*list_count = count;
+	return error == LDAP_SUCCESS;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <stdbool.h>
+#include <ldap.h>
+
+/**
+ * Builds server side sort (by sort_key) and virtual list view request
+ * controls for a window of before + 1 + after entries around offset
+ * (1-based), or around the first entry not less than assertion if that
+ * is given. count is the list size from an earlier response, 0 if unknown.
+ **/
+int vlv_controls_create(LDAP * ld, const char *sort_key, int before, int after, int offset,
+			int count, const char *assertion, LDAPControl *** controlsp);
+
+void vlv_controls_free(LDAPControl ** controls);
+
+/**
+ * Reads the position of the target entry and the list size from the
+ * response controls of a VLV search. Returns false if they are missing.
+ **/
+bool vlv_parse_response(LDAP * ld, LDAPControl ** controls, int *target_pos, int *list_count);
@@ -0,0 +1,546 @@
+#include "worker.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "async.h"
+#include "ldapentry.h"
+#include "spsc.h"
+
+typedef enum { REQUEST_SEARCH, REQUEST_SEARCH_EXT, REQUEST_SEARCH_PERSISTENT, REQUEST_DELETE
+} REQUEST_TYPE;
+
+struct WORKER_REQUEST_S {
+	WORKER *worker;
+
+	// set before the request is queued, read by the thread to start it
+	REQUEST_TYPE type;
+	char *base;		// or the DN to delete
+	int scope;
+	char *filter;
+	char **attrs;
+	int page_size;
+	LDAPControl **controls;
+	WORKER_ENTRY_CALLBACK on_entry;
+	WORKER_RESULT_CALLBACK on_result;
+	WORKER_DONE_CALLBACK on_done;
+	void *ctx;
+
+	// used by the thread only, NULL once the operation is over
+	ASYNC_REQUEST *async;
+
+	// used by the starting side only
+	bool completed;		// on_done ran
+	bool abandoned;		// freed once the thread let go of it
+	bool *done;
+	int *result;
+	struct WORKER_REQUEST_S *next;
+};
+
+typedef enum { COMMAND_START, COMMAND_ABANDON, COMMAND_STOP } COMMAND_TYPE;
+
+typedef struct COMMAND_S {
+	COMMAND_TYPE type;
+	WORKER_REQUEST *req;
+} COMMAND;
+
+/**
+ * Sent by the thread. Every started request gets exactly one EVENT_DONE,
+ * after all its other events; an abandoned one also gets EVENT_RELEASE
+ * once the thread no longer refers to it.
+ **/
+typedef enum { EVENT_ENTRY, EVENT_RESULT, EVENT_DONE, EVENT_RELEASE } EVENT_TYPE;
+
+typedef struct EVENT_S {
+	EVENT_TYPE type;
+	WORKER_REQUEST *req;
+	WORKER_ENTRY entry;
+	LDAPControl **controls;
+	int result;
+} EVENT;
+
+struct WORKER_S {
+	LDAP *ld;
+	ASYNC *async;
+	pthread_t thread;
+	SPSC_QUEUE commands;	// to the thread
+	SPSC_QUEUE events;	// from the thread
+	int command_pipe[2];	// wakes the thread
+	int event_pipe[2];	// wakes the caller of worker_process()
+	bool notify;		// thread side: events were queued since the last wakeup
+	WORKER_REQUEST *requests;	// starting side: not completed yet
+};
+
+static char **string_array_dup(char **strings)
+{
+	if (!strings)
+		return NULL;
+
+	unsigned len;
+	for (len = 0; strings[len]; len++)
+		;
+
+	char **result = calloc(len + 1, sizeof(char *));
+	for (unsigned i = 0; i < len; i++)
+		result[i] = strdup(strings[i]);
+	return result;
+}
+
+static void string_array_free(char **strings)
+{
+	for (unsigned i = 0; strings && strings[i]; i++)
+		free(strings[i]);
+	free(strings);
+}
+
+static void wake(int fd)
+{
+	// a full pipe already means a wakeup is pending
+	char c = 0;
+	if (write(fd, &c, 1) < 0)
+		return;
+}
+
+static void drain(int fd)
+{
+	char buffer[64];
+	while (read(fd, buffer, sizeof(buffer)) > 0)
+		;
+}
+
+static bool pipe_open(int fds[2])
+{
+	if (pipe(fds) != 0)
+		return false;
+
+	for (unsigned i = 0; i < 2; i++)
+	{
+		fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+		fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+	}
+	return true;
+}
+
+static void pipe_close(int fds[2])
+{
+	for (unsigned i = 0; i < 2; i++)
+	{
+		if (fds[i] >= 0)
+			close(fds[i]);
+		fds[i] = -1;
+	}
+}
+
+static void event_free(EVENT * event)
+{
+	if (event->entry.entry)
+		entry_free(event->entry.entry);
+	ldap_memfree(event->entry.rdn);
+	ldap_controls_free(event->controls);
+	free(event);
+}
+
+static void request_free(WORKER_REQUEST * req)
+{
+	free(req->base);
+	free(req->filter);
+	string_array_free(req->attrs);
+	ldap_controls_free(req->controls);
+	free(req);
+}
+
+/* the thread */
+
+static void post(WORKER * w, EVENT_TYPE type, WORKER_REQUEST * req, EVENT * event)
+{
+	if (!event)
+		event = calloc(1, sizeof(EVENT));
+	event->type = type;
+	event->req = req;
+	spsc_push(&w->events, event);
+	w->notify = true;
+}
+
+static void thread_entry(LDAP * ld, LDAPMessage * msg, void *ctx)
+{
+	WORKER_REQUEST *req = ctx;
+	EVENT *event = calloc(1, sizeof(EVENT));
+	WORKER_ENTRY *e = &event->entry;
+
+	if (ldap_msgtype(msg) == LDAP_RES_INTERMEDIATE)
+		e->refresh_done = sync_parse_refresh_done(ld, msg);
+	else
+	{
+		e->entry = ldap_entry_decode(ld, msg);
+		e->rdn = ldap_dn_rdn(e->entry->dn);
+		if (req->type == REQUEST_SEARCH_PERSISTENT)
+			e->has_sync_state = sync_parse_state(ld, msg, &e->sync_state, e->uuid);
+	}
+
+	post(req->worker, EVENT_ENTRY, req, event);
+}
+
+static void thread_result(LDAP * ld, LDAPControl ** controls, void *ctx)
+{
+	WORKER_REQUEST *req = ctx;
+	EVENT *event = calloc(1, sizeof(EVENT));
+	if (controls)
+		event->controls = ldap_controls_dup(controls);
+	post(req->worker, EVENT_RESULT, req, event);
+}
+
+static void thread_done(LDAP * ld, int result, void *ctx)
+{
+	WORKER_REQUEST *req = ctx;
+	req->async = NULL;
+
+	EVENT *event = calloc(1, sizeof(EVENT));
+	event->result = result;
+	post(req->worker, EVENT_DONE, req, event);
+}
+
+static void thread_start_request(WORKER * w, WORKER_REQUEST * req)
+{
+	int rc;
+	switch (req->type)
+	{
+	case REQUEST_SEARCH:
+		rc = async_search(w->async, req->base, req->scope, req->filter, req->attrs,
+				  req->page_size, thread_entry, thread_done, req, &req->async);
+		break;
+
+	case REQUEST_SEARCH_EXT:
+		rc = async_search_ext(w->async, req->base, req->scope, req->filter, req->attrs,
+				      req->controls, thread_entry,
+				      req->on_result ? thread_result : NULL, thread_done, req,
+				      &req->async);
+		break;
+
+	case REQUEST_SEARCH_PERSISTENT:
+		rc = async_search_persistent(w->async, req->base, req->scope, req->filter,
+					     req->attrs, req->controls, thread_entry, thread_done,
+					     req, &req->async);
+		break;
+
+	default:
+		rc = async_delete(w->async, req->base, req->controls, thread_done, req,
+				  &req->async);
+		break;
+	}
+
+	if (rc != LDAP_SUCCESS)
+		thread_done(w->ld, rc, req);
+}
+
+static void *worker_run(void *arg)
+{
+	WORKER *w = arg;
+	bool running = true;
+
+	while (running)
+	{
+		struct pollfd fds[] = {
+			{w->command_pipe[0], POLLIN, 0},
+			{async_pending(w->async) ? async_fd(w->async) : -1, POLLIN, 0}
+		};
+		poll(fds, 2, -1);
+		drain(w->command_pipe[0]);
+
+		COMMAND *cmd;
+		while ((cmd = spsc_pop(&w->commands)))
+		{
+			switch (cmd->type)
+			{
+			case COMMAND_START:
+				thread_start_request(w, cmd->req);
+				break;
+
+			case COMMAND_ABANDON:
+				if (cmd->req->async)
+					async_abandon(w->async, cmd->req->async);
+				post(w, EVENT_RELEASE, cmd->req, NULL);
+				break;
+
+			case COMMAND_STOP:
+				running = false;
+				break;
+			}
+			free(cmd);
+		}
+
+		if (running)
+			async_process(w->async, 0);
+
+		// one wakeup for everything decoded in this round
+		if (w->notify)
+		{
+			w->notify = false;
+			wake(w->event_pipe[1]);
+		}
+	}
+
+	async_free(w->async);
+	w->async = NULL;
+	ldap_unbind_ext(w->ld, NULL, NULL);
+	w->ld = NULL;
+	return NULL;
+}
+
+/* the starting side */
+
+static void command(WORKER * w, COMMAND_TYPE type, WORKER_REQUEST * req)
+{
+	COMMAND *cmd = malloc(sizeof(COMMAND));
+	cmd->type = type;
+	cmd->req = req;
+	spsc_push(&w->commands, cmd);
+	wake(w->command_pipe[1]);
+}
+
+static void worker_free(WORKER * w)
+{
+	spsc_destroy(&w->commands);
+	spsc_destroy(&w->events);
+	pipe_close(w->command_pipe);
+	pipe_close(w->event_pipe);
+	free(w);
+}
+
+WORKER *worker_start(LDAP * ld)
+{
+	WORKER *w = calloc(1, sizeof(WORKER));
+	w->ld = ld;
+	w->command_pipe[0] = w->command_pipe[1] = -1;
+	w->event_pipe[0] = w->event_pipe[1] = -1;
+	spsc_init(&w->commands);
+	spsc_init(&w->events);
+
+	if (!pipe_open(w->command_pipe) || !pipe_open(w->event_pipe))
+	{
+		worker_free(w);
+		return NULL;
+	}
+
+	w->async = async_init(ld);
+	if (pthread_create(&w->thread, NULL, worker_run, w) != 0)
+	{
+		async_free(w->async);
+		worker_free(w);
+		return NULL;
+	}
+
+	return w;
+}
+
+static void complete(WORKER * w, WORKER_REQUEST * req, int result)
+{
+	for (WORKER_REQUEST ** cur = &w->requests; *cur; cur = &(*cur)->next)
+	{
+		if (*cur == req)
+		{
+			*cur = req->next;
+			break;
+		}
+	}
+
+	req->completed = true;
+	if (req->done)
+		*req->done = true;
+	if (req->result)
+		*req->result = result;
+	if (req->on_done)
+		req->on_done(result, req->ctx);
+}
+
+static void dispatch(WORKER * w, EVENT * event)
+{
+	WORKER_REQUEST *req = event->req;
+
+	switch (event->type)
+	{
+	case EVENT_ENTRY:
+		if (!req->completed && req->on_entry)
+			req->on_entry(&event->entry, req->ctx);
+		break;
+
+	case EVENT_RESULT:
+		if (!req->completed && req->on_result)
+			req->on_result(event->controls, req->ctx);
+		break;
+
+	case EVENT_DONE:
+		if (!req->completed)
+			complete(w, req, event->result);
+		if (!req->abandoned)
+			request_free(req);
+		break;
+
+	case EVENT_RELEASE:
+		request_free(req);
+		break;
+	}
+
+	event_free(event);
+}
+
+void worker_stop(WORKER * w)
+{
+	while (w->requests)
+		worker_abandon(w, w->requests);
+
+	command(w, COMMAND_STOP, NULL);
+	pthread_join(w->thread, NULL);
+
+	// the thread released everything it was sent before stopping
+	EVENT *event;
+	while ((event = spsc_pop(&w->events)))
+		dispatch(w, event);
+
+	worker_free(w);
+}
+
+static WORKER_REQUEST *request_alloc(WORKER * w, REQUEST_TYPE type, const char *base,
+				     WORKER_DONE_CALLBACK on_done, void *ctx)
+{
+	WORKER_REQUEST *req = calloc(1, sizeof(WORKER_REQUEST));
+	req->worker = w;
+	req->type = type;
+	req->base = strdup(base);
+	req->on_done = on_done;
+	req->ctx = ctx;
+	return req;
+}
+
+static WORKER_REQUEST *search_alloc(WORKER * w, REQUEST_TYPE type, const char *base, int scope,
+				    const char *filter, char **attrs,
+				    WORKER_ENTRY_CALLBACK on_entry, WORKER_DONE_CALLBACK on_done,
+				    void *ctx)
+{
+	WORKER_REQUEST *req = request_alloc(w, type, base, on_done, ctx);
+	req->scope = scope;
+	req->filter = strdup(filter);
+	req->attrs = string_array_dup(attrs);
+	req->on_entry = on_entry;
+	return req;
+}
+
+static void enqueue(WORKER * w, WORKER_REQUEST * req, WORKER_REQUEST ** reqp)
+{
+	req->next = w->requests;
+	w->requests = req;
+	if (reqp)
+		*reqp = req;
+	command(w, COMMAND_START, req);
+}
+
+void worker_search(WORKER * w, const char *base, int scope, const char *filter, char **attrs,
+		   int page_size, WORKER_ENTRY_CALLBACK on_entry, WORKER_DONE_CALLBACK on_done,
+		   void *ctx, WORKER_REQUEST ** reqp)
+{
+	WORKER_REQUEST *req = search_alloc(w, REQUEST_SEARCH, base, scope, filter, attrs,
+					   on_entry, on_done, ctx);
+	req->page_size = page_size;
+	enqueue(w, req, reqp);
+}
+
+void worker_search_ext(WORKER * w, const char *base, int scope, const char *filter,
+		       char **attrs, LDAPControl ** controls, WORKER_ENTRY_CALLBACK on_entry,
+		       WORKER_RESULT_CALLBACK on_result, WORKER_DONE_CALLBACK on_done, void *ctx,
+		       WORKER_REQUEST ** reqp)
+{
+	WORKER_REQUEST *req = search_alloc(w, REQUEST_SEARCH_EXT, base, scope, filter, attrs,
+					   on_entry, on_done, ctx);
+	req->controls = controls ? ldap_controls_dup(controls) : NULL;
+	req->on_result = on_result;
+	enqueue(w, req, reqp);
+}
+
+void worker_search_persistent(WORKER * w, const char *base, int scope, const char *filter,
+			      char **attrs, LDAPControl ** controls,
+			      WORKER_ENTRY_CALLBACK on_entry, WORKER_DONE_CALLBACK on_done,
+			      void *ctx, WORKER_REQUEST ** reqp)
+{
+	WORKER_REQUEST *req = search_alloc(w, REQUEST_SEARCH_PERSISTENT, base, scope, filter,
+					   attrs, on_entry, on_done, ctx);
+	req->controls = controls ? ldap_controls_dup(controls) : NULL;
+	enqueue(w, req, reqp);
+}
+
+void worker_delete(WORKER * w, const char *dn, LDAPControl ** controls,
+		   WORKER_DONE_CALLBACK on_done, void *ctx, WORKER_REQUEST ** reqp)
+{
+	WORKER_REQUEST *req = request_alloc(w, REQUEST_DELETE, dn, on_done, ctx);
+	req->controls = controls ? ldap_controls_dup(controls) : NULL;
+	enqueue(w, req, reqp);
+}
+
+void worker_abandon(WORKER * w, WORKER_REQUEST * req)
+{
+	req->abandoned = true;
+	complete(w, req, LDAP_USER_CANCELLED);
+	command(w, COMMAND_ABANDON, req);
+}
+
+void worker_watch(WORKER_REQUEST * req, bool *done, int *result)
+{
+	req->done = done;
+	req->result = result;
+}
+
+int worker_process(WORKER * w, int timeout_ms)
+{
+	int processed = 0;
+
+	while (true)
+	{
+		// drained first: a wakeup written after this is never lost
+		drain(w->event_pipe[0]);
+
+		EVENT *event;
+		while ((event = spsc_pop(&w->events)))
+		{
+			if (event->type != EVENT_RELEASE)
+				processed++;
+			dispatch(w, event);
+		}
+
+		if (processed > 0 || timeout_ms == 0 || !w->requests)
+			break;
+
+		struct pollfd fd = { w->event_pipe[0], POLLIN, 0 };
+		if (poll(&fd, 1, timeout_ms) == 0)
+			break;
+	}
+
+	return processed;
+}
+
+int worker_wait(WORKER * w, WORKER_REQUEST * req)
+{
+	bool done = false;
+	int result = LDAP_SUCCESS;
+	worker_watch(req, &done, &result);
+
+	while (!done)
+		worker_process(w, -1);
+
+	return result;
+}
+
+bool worker_busy(WORKER * w)
+{
+	for (WORKER_REQUEST * req = w->requests; req; req = req->next)
+	{
+		if (req->type != REQUEST_SEARCH_PERSISTENT)
+			return true;
+	}
+	return false;
+}
+
+int worker_fd(WORKER * w)
+{
+	return w->event_pipe[0];
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <stdbool.h>
+#include <ldap.h>
+#include "entry.h"
+#include "syncrepl.h"
+
+/**
+ * Runs an LDAP connection on a thread of its own. Operations are handed
+ * to that thread over a lock-free queue; what the server sends back is
+ * decoded there into plain data and queued back, to be dispatched by
+ * worker_process() on the thread that started the operations. Reading,
+ * BER parsing and DN normalization thus never hold up that thread, and
+ * any number of operations can run side by side.
+ **/
+
+typedef struct WORKER_S WORKER;
+typedef struct WORKER_REQUEST_S WORKER_REQUEST;
+
+/**
+ * A search entry, or an intermediate response of a persistent search
+ * (entry is NULL then).
+ **/
+typedef struct WORKER_ENTRY_S {
+	ENTRY *entry;		// callbacks may keep it, leaving NULL behind
+	char *rdn;		// first RDN in LDAPv2 form, NULL if the DN does not parse
+	bool has_sync_state;	// the entry carried a sync state control
+	int sync_state;		// LDAP_SYNC_PRESENT, _ADD, _MODIFY or _DELETE
+	unsigned char uuid[SYNC_UUID_SIZE];
+	bool refresh_done;	// a sync info message ending the refresh phase
+} WORKER_ENTRY;
+
+typedef void (*WORKER_ENTRY_CALLBACK) (WORKER_ENTRY * entry, void *ctx);
+typedef void (*WORKER_DONE_CALLBACK) (int result, void *ctx);
+typedef void (*WORKER_RESULT_CALLBACK) (LDAPControl ** controls, void *ctx);
+
+/**
+ * Starts the thread, which owns ld from now on: the caller must not use
+ * the connection any more. Returns NULL if the thread could not start.
+ **/
+WORKER *worker_start(LDAP * ld);
+
+/**
+ * Abandons all outstanding requests (their on_done runs with
+ * LDAP_USER_CANCELLED), stops the thread and unbinds the connection.
+ **/
+void worker_stop(WORKER * w);
+
+/**
+ * Starts a search, paged with the simple paged results control unless
+ * page_size is 0. on_entry is called for every entry, on_done exactly
+ * once when the last page is complete, failed or was abandoned. Errors
+ * sending the request are reported through on_done as well.
+ **/
+void worker_search(WORKER * w, const char *base, int scope, const char *filter, char **attrs,
+		   int page_size, WORKER_ENTRY_CALLBACK on_entry, WORKER_DONE_CALLBACK on_done,
+		   void *ctx, WORKER_REQUEST ** reqp);
+
+/**
+ * Starts an unpaged search with the given server controls, which are
+ * copied. on_result receives the controls of the final result, before
+ * on_done.
+ **/
+void worker_search_ext(WORKER * w, const char *base, int scope, const char *filter,
+		       char **attrs, LDAPControl ** controls, WORKER_ENTRY_CALLBACK on_entry,
+		       WORKER_RESULT_CALLBACK on_result, WORKER_DONE_CALLBACK on_done, void *ctx,
+		       WORKER_REQUEST ** reqp);
+
+/**
+ * Starts a search that stays open on the server to report changes, like
+ * a content synchronization in refreshAndPersist mode. on_entry receives
+ * the intermediate responses as well as the entries. Such searches do not
+ * count as busy.
+ **/
+void worker_search_persistent(WORKER * w, const char *base, int scope, const char *filter,
+			      char **attrs, LDAPControl ** controls,
+			      WORKER_ENTRY_CALLBACK on_entry, WORKER_DONE_CALLBACK on_done,
+			      void *ctx, WORKER_REQUEST ** reqp);
+
+/**
+ * Deletes dn, with the given server controls (may be NULL), which are
+ * copied.
+ **/
+void worker_delete(WORKER * w, const char *dn, LDAPControl ** controls,
+		   WORKER_DONE_CALLBACK on_done, void *ctx, WORKER_REQUEST ** reqp);
+
+/**
+ * Completes req at once with LDAP_USER_CANCELLED and has the thread
+ * abandon it on the server. Whatever still arrives for req is dropped.
+ * Must not be called from a callback of req itself.
+ **/
+void worker_abandon(WORKER * w, WORKER_REQUEST * req);
+
+/**
+ * Sets done to true and result to the result code once req completes.
+ **/
+void worker_watch(WORKER_REQUEST * req, bool *done, int *result);
+
+/**
+ * Dispatches what the thread decoded so far, waiting up to timeout_ms for
+ * something to arrive if nothing has (-1 waits until something did).
+ * Returns the number of entries and results dispatched.
+ **/
+int worker_process(WORKER * w, int timeout_ms);
+
+/**
+ * Blocks until req completes and returns its result code.
+ **/
+int worker_wait(WORKER * w, WORKER_REQUEST * req);
+
+/**
+ * Returns true while requests other than persistent searches are pending.
+ **/
+bool worker_busy(WORKER * w);
+
+/**
+ * Returns a descriptor that becomes readable when worker_process() has
+ * something to dispatch, to be polled next to other input.
+ **/
+int worker_fd(WORKER * w);
@@ -0,0 +1,68 @@
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include "arena.h"
+
+void test_malloc_aligned()
+{
+	ARENA *arena = arena_alloc();
+
+	arena_strdup(arena, "x");
+	void *p = arena_malloc(arena, 24);
+	assert(((uintptr_t) p) % sizeof(void *) == 0);
+
+	arena_free(arena);
+}
+
+void test_strdup()
+{
+	ARENA *arena = arena_alloc();
+
+	char *a = arena_strdup(arena, "cn=a");
+	char *b = arena_strdup(arena, "cn=b");
+	assert(strcmp(a, "cn=a") == 0);
+	assert(strcmp(b, "cn=b") == 0);
+
+	arena_free(arena);
+}
+
+void test_many_chunks_and_reset()
+{
+	ARENA *arena = arena_alloc();
+
+	for (unsigned i = 0; i < 100000; i++)
+		memset(arena_malloc(arena, 40), 0xff, 40);
+	size_t used = arena_size(arena);
+	assert(used >= 100000 * 40);
+
+	arena_reset(arena);
+	assert(arena_size(arena) < used);
+	for (unsigned i = 0; i < 1000; i++)
+		memset(arena_malloc(arena, 40), 0, 40);
+
+	arena_free(arena);
+}
+
+void test_oversized()
+{
+	ARENA *arena = arena_alloc();
+
+	char *small = arena_strdup(arena, "small");
+	char *big = arena_malloc(arena, 1 << 20);
+	memset(big, 0, 1 << 20);
+	char *after = arena_strdup(arena, "after");
+
+	assert(strcmp(small, "small") == 0);
+	assert(strcmp(after, "after") == 0);
+
+	arena_free(arena);
+}
+
+int main()
+{
+	test_malloc_aligned();
+	test_strdup();
+	test_many_chunks_and_reset();
+	test_oversized();
+	return 0;
+}
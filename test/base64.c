@@ -0,0 +1,102 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "base64.h"
+
+void assert_encodes(const char *data, size_t len, const char *expected)
+{
+	char out[128];
+	assert(base64_encoded_size(len) == strlen(expected));
+	assert(base64_encode((const unsigned char *)data, len, out) == strlen(expected));
+	assert(memcmp(out, expected, strlen(expected)) == 0);
+}
+
+void test_rfc4648_vectors()
+{
+	assert_encodes("", 0, "");
+	assert_encodes("f", 1, "Zg==");
+	assert_encodes("fo", 2, "Zm8=");
+	assert_encodes("foo", 3, "Zm9v");
+	assert_encodes("foob", 4, "Zm9vYg==");
+	assert_encodes("fooba", 5, "Zm9vYmE=");
+	assert_encodes("foobar", 6, "Zm9vYmFy");
+}
+
+void test_binary()
+{
+	assert_encodes("\0\0\0", 3, "AAAA");
+	assert_encodes("\xff\xff\xff\xff\xff\xff\xff", 7, "/////////w==");
+	assert_encodes("\x00\x10\x83\x10\x51\x87\x20\x92\x8b\x30\xd3\x8f\x41\x14\x93\x51\x55\x97"
+		       "\x61\x96\x9b\x71\xd7\x9f\x82\x18\xa3\x92\x59\xa7\xa2\x9a\xab\xb2\xdb\xaf"
+		       "\xc3\x1c\xb3\xd3\x5d\xb7\xe3\x9e\xbb\xf3\xdf\xbf", 48,
+		       "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/");
+}
+
+void test_lengths()
+{
+	// every tail length after the 6 byte steps
+	unsigned char data[64];
+	char out[128], expected[128];
+	for (unsigned i = 0; i < sizeof(data); i++)
+		data[i] = i * 37 + 11;
+
+	base64_encode(data, sizeof(data) - 1, expected);
+	for (size_t len = 0; len < sizeof(data); len++)
+	{
+		size_t n = base64_encode(data, len, out);
+		assert(n == base64_encoded_size(len));
+		// complete groups match the longer encoding
+		assert(memcmp(out, expected, len / 3 * 4) == 0);
+	}
+}
+
+void assert_decodes(const char *in, const char *expected, size_t len)
+{
+	unsigned char out[128];
+	assert(base64_decoded_size(strlen(in)) >= len);
+	assert(base64_decode(in, strlen(in), out) == len);
+	assert(memcmp(out, expected, len) == 0);
+}
+
+void test_decode()
+{
+	assert_decodes("", "", 0);
+	assert_decodes("Zg==", "f", 1);
+	assert_decodes("Zm8=", "fo", 2);
+	assert_decodes("Zm9vYmFy", "foobar", 6);
+	// padding is optional
+	assert_decodes("Zg", "f", 1);
+	assert_decodes("Zm9vYg", "foob", 4);
+	assert_decodes("/////////w==", "\xff\xff\xff\xff\xff\xff\xff", 7);
+
+	unsigned char out[16];
+	assert(base64_decode("Zm9v YmFy", 9, out) == (size_t) - 1);
+	assert(base64_decode("Zm9vY", 5, out) == (size_t) - 1);
+	assert(base64_decode("Zm\x80" "9", 4, out) == (size_t) - 1);
+	assert(base64_decode("Z===", 4, out) == (size_t) - 1);
+}
+
+void test_round_trip()
+{
+	unsigned char data[64], decoded[64];
+	char encoded[128];
+	for (unsigned i = 0; i < sizeof(data); i++)
+		data[i] = i * 37 + 11;
+
+	for (size_t len = 0; len < sizeof(data); len++)
+	{
+		size_t n = base64_encode(data, len, encoded);
+		assert(base64_decode(encoded, n, decoded) == len);
+		assert(memcmp(decoded, data, len) == 0);
+	}
+}
+
+int main()
+{
+	test_rfc4648_vectors();
+	test_binary();
+	test_lengths();
+	test_decode();
+	test_round_trip();
+	return 0;
+}
@@ -0,0 +1,446 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <lber.h>
+#include <ldap.h>
+#include "connection.h"
+#include "deleter.h"
+
+/**
+ * A stand-in for slapd holding BRANCHES containers below BASE with LEAVES
+ * entries each, which refuses to delete entries that still have children,
+ * like a real server. Every operation is answered LATENCY_NS after it
+ * arrived, on a thread of its own. With tree_delete set the root DSE lists
+ * the Tree Delete control and deletes carrying a control remove the whole
+ * subtree.
+ **/
+#define BASE "dc=example"
+#define BRANCHES 20
+#define LEAVES 250
+#define LATENCY_NS 200000
+
+typedef struct {
+	pthread_mutex_t lock;
+	bool tree_delete;
+	bool base_deleted;
+	unsigned branches_left;
+	unsigned leaves_left[BRANCHES];
+	bool deleted[BRANCHES][LEAVES + 1];	// [LEAVES] is the branch itself
+	unsigned long refused;	// deletes of entries with children
+} DIRECTORY;
+
+DIRECTORY directory = { PTHREAD_MUTEX_INITIALIZER };
+
+double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void directory_reset(bool tree_delete)
+{
+	pthread_mutex_lock(&directory.lock);
+	directory.tree_delete = tree_delete;
+	directory.base_deleted = false;
+	directory.branches_left = BRANCHES;
+	for (unsigned i = 0; i < BRANCHES; i++)
+		directory.leaves_left[i] = LEAVES;
+	memset(directory.deleted, 0, sizeof(directory.deleted));
+	directory.refused = 0;
+	pthread_mutex_unlock(&directory.lock);
+}
+
+typedef struct {
+	int fd;
+	pthread_mutex_t lock;	// responses are written whole
+	unsigned active;	// operations still being answered
+	pthread_cond_t idle;
+} CLIENT;
+
+typedef struct {
+	CLIENT *client;
+	ber_int_t msgid;
+	ber_tag_t op;
+	char *dn;
+	int scope;
+	bool control;		// a delete carried controls
+} OPERATION;
+
+typedef struct {
+	char *data;
+	size_t len, capacity;
+} BUFFER;
+
+static void buffer_add(BUFFER * b, BerElement * ber)
+{
+	struct berval bv;
+	ber_flatten2(ber, &bv, 0);
+	if (b->len + bv.bv_len > b->capacity)
+	{
+		b->capacity = 2 * (b->len + bv.bv_len);
+		b->data = realloc(b->data, b->capacity);
+	}
+	memcpy(b->data + b->len, bv.bv_val, bv.bv_len);
+	b->len += bv.bv_len;
+	ber_free(ber, 1);
+}
+
+static void add_entry(BUFFER * b, ber_int_t msgid, const char *dn)
+{
+	BerElement *ber = ber_alloc_t(LBER_USE_DER);
+	ber_printf(ber, "{it{s{}}}", msgid, (ber_tag_t) LDAP_RES_SEARCH_ENTRY, dn);
+	buffer_add(b, ber);
+}
+
+static void add_root_dse(BUFFER * b, ber_int_t msgid)
+{
+	BerElement *ber = ber_alloc_t(LBER_USE_DER);
+	ber_printf(ber, "{it{s{{s[s", msgid, (ber_tag_t) LDAP_RES_SEARCH_ENTRY, "",
+		   "supportedControl", LDAP_CONTROL_PAGEDRESULTS);
+	if (directory.tree_delete)
+		ber_printf(ber, "s", LDAP_CONTROL_X_TREE_DELETE);
+	ber_printf(ber, "]}}}}");
+	buffer_add(b, ber);
+}
+
+static int search(BUFFER * b, OPERATION * op)
+{
+	if (op->scope == LDAP_SCOPE_BASE && op->dn[0] == '\0')
+	{
+		add_root_dse(b, op->msgid);
+		return LDAP_SUCCESS;
+	}
+	if (strcasecmp(op->dn, BASE) != 0 || op->scope != LDAP_SCOPE_SUB)
+		return LDAP_UNWILLING_TO_PERFORM;
+	if (directory.base_deleted)
+		return LDAP_NO_SUCH_OBJECT;
+
+	char dn[128];
+	add_entry(b, op->msgid, BASE);
+	for (int i = 0; i < BRANCHES; i++)
+	{
+		if (directory.deleted[i][LEAVES])
+			continue;
+		snprintf(dn, sizeof(dn), "ou=b%d," BASE, i);
+		add_entry(b, op->msgid, dn);
+		for (int j = 0; j < LEAVES; j++)
+		{
+			snprintf(dn, sizeof(dn), "uid=u%d,ou=b%d," BASE, j, i);
+			if (!directory.deleted[i][j])
+				add_entry(b, op->msgid, dn);
+		}
+	}
+	return LDAP_SUCCESS;
+}
+
+static int delete(OPERATION * op)
+{
+	bool subtree = op->control && directory.tree_delete;
+	int branch, leaf;
+	if (sscanf(op->dn, "uid=u%d,ou=b%d,", &leaf, &branch) == 2)
+	{
+		if (directory.deleted[branch][leaf])
+			return LDAP_NO_SUCH_OBJECT;
+		directory.deleted[branch][leaf] = true;
+		directory.leaves_left[branch]--;
+	} else if (sscanf(op->dn, "ou=b%d,", &branch) == 1)
+	{
+		if (directory.deleted[branch][LEAVES])
+			return LDAP_NO_SUCH_OBJECT;
+		if (directory.leaves_left[branch] > 0 && !subtree)
+		{
+			directory.refused++;
+			return LDAP_NOT_ALLOWED_ON_NONLEAF;
+		}
+		memset(directory.deleted[branch], 1, sizeof(directory.deleted[branch]));
+		directory.leaves_left[branch] = 0;
+		directory.branches_left--;
+	} else
+	{
+		if (directory.base_deleted)
+			return LDAP_NO_SUCH_OBJECT;
+		if (directory.branches_left > 0 && !subtree)
+		{
+			directory.refused++;
+			return LDAP_NOT_ALLOWED_ON_NONLEAF;
+		}
+		memset(directory.deleted, 1, sizeof(directory.deleted));
+		directory.branches_left = 0;
+		directory.base_deleted = true;
+	}
+	return LDAP_SUCCESS;
+}
+
+static void *answer(void *arg)
+{
+	OPERATION *op = arg;
+	struct timespec latency = { 0, LATENCY_NS };
+	nanosleep(&latency, NULL);
+
+	BUFFER b = { 0 };
+	ber_tag_t result_tag;
+	int rc;
+	pthread_mutex_lock(&directory.lock);
+	if (op->op == LDAP_REQ_SEARCH)
+	{
+		result_tag = LDAP_RES_SEARCH_RESULT;
+		rc = search(&b, op);
+	} else
+	{
+		result_tag = LDAP_RES_DELETE;
+		rc = delete(op);
+	}
+	pthread_mutex_unlock(&directory.lock);
+
+	BerElement *ber = ber_alloc_t(LBER_USE_DER);
+	ber_printf(ber, "{it{ess}}", op->msgid, result_tag, rc, "", "");
+	buffer_add(&b, ber);
+
+	CLIENT *c = op->client;
+	pthread_mutex_lock(&c->lock);
+	for (size_t off = 0; off < b.len;)
+	{
+		ssize_t n = write(c->fd, b.data + off, b.len - off);
+		if (n <= 0)
+			break;
+		off += n;
+	}
+	c->active--;
+	pthread_cond_signal(&c->idle);
+	pthread_mutex_unlock(&c->lock);
+
+	free(b.data);
+	free(op->dn);
+	free(op);
+	return NULL;
+}
+
+static bool read_full(int fd, unsigned char *buf, size_t len)
+{
+	for (size_t off = 0; off < len;)
+	{
+		ssize_t n = read(fd, buf + off, len - off);
+		if (n <= 0)
+			return false;
+		off += n;
+	}
+	return true;
+}
+
+static void send_bind_result(CLIENT * c, ber_int_t msgid)
+{
+	BUFFER b = { 0 };
+	BerElement *ber = ber_alloc_t(LBER_USE_DER);
+	ber_printf(ber, "{it{ess}}", msgid, (ber_tag_t) LDAP_RES_BIND, 0, "", "");
+	buffer_add(&b, ber);
+	pthread_mutex_lock(&c->lock);
+	if (write(c->fd, b.data, b.len) < 0)
+		perror("stand-in server");
+	pthread_mutex_unlock(&c->lock);
+	free(b.data);
+}
+
+static void *serve(void *arg)
+{
+	CLIENT *c = arg;
+	unsigned char header[6];
+
+	while (read_full(c->fd, header, 2))
+	{
+		// LDAPMessage: SEQUENCE tag, then short or long form length
+		size_t len = header[1], header_len = 2;
+		if (len & 0x80)
+		{
+			unsigned n = len & 0x7f;
+			if (n > 4 || !read_full(c->fd, header + 2, n))
+				break;
+			len = 0;
+			for (unsigned i = 0; i < n; i++)
+				len = (len << 8) | header[2 + i];
+			header_len += n;
+		}
+
+		char *message = malloc(header_len + len);
+		memcpy(message, header, header_len);
+		if (!read_full(c->fd, (unsigned char *)message + header_len, len))
+		{
+			free(message);
+			break;
+		}
+
+		struct berval bv = { header_len + len, message };
+		BerElement *ber = ber_init(&bv);
+		ber_int_t msgid, scope = 0;
+		ber_len_t tag_len;
+		struct berval dn = { 0, NULL };
+		ber_scanf(ber, "{i", &msgid);
+		ber_tag_t op = ber_peek_tag(ber, &tag_len);
+
+		bool quit = op == LDAP_REQ_UNBIND;
+		bool answered = op == LDAP_REQ_SEARCH
+		    && ber_scanf(ber, "{me", &dn, &scope) != LBER_ERROR;
+		if (op == LDAP_REQ_DELETE && ber_scanf(ber, "m", &dn) != LBER_ERROR)
+			answered = true;
+
+		if (op == LDAP_REQ_BIND)
+			send_bind_result(c, msgid);
+		else if (answered)
+		{
+			OPERATION *o = calloc(1, sizeof(OPERATION));
+			o->client = c;
+			o->msgid = msgid;
+			o->op = op;
+			o->dn = strndup(dn.bv_val, dn.bv_len);
+			o->scope = scope;
+			o->control = op == LDAP_REQ_DELETE
+			    && ber_peek_tag(ber, &tag_len) == LDAP_TAG_CONTROLS;
+
+			pthread_mutex_lock(&c->lock);
+			c->active++;
+			pthread_mutex_unlock(&c->lock);
+
+			pthread_t thread;
+			pthread_create(&thread, NULL, answer, o);
+			pthread_detach(thread);
+		}
+
+		ber_free(ber, 1);
+		free(message);
+		if (quit)
+			break;
+	}
+
+	pthread_mutex_lock(&c->lock);
+	while (c->active > 0)
+		pthread_cond_wait(&c->idle, &c->lock);
+	pthread_mutex_unlock(&c->lock);
+
+	close(c->fd);
+	free(c);
+	return NULL;
+}
+
+static void *accept_loop(void *arg)
+{
+	int server = *(int *)arg;
+	int fd;
+	while ((fd = accept(server, NULL, NULL)) >= 0)
+	{
+		CLIENT *c = calloc(1, sizeof(CLIENT));
+		c->fd = fd;
+		pthread_mutex_init(&c->lock, NULL);
+		pthread_cond_init(&c->idle, NULL);
+		pthread_t thread;
+		pthread_create(&thread, NULL, serve, c);
+		pthread_detach(thread);
+	}
+	return NULL;
+}
+
+static int server_start()
+{
+	static int server;
+	server = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr = { 0 };
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(server, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(server, 16) != 0)
+	{
+		perror("stand-in server");
+		exit(EXIT_FAILURE);
+	}
+
+	socklen_t len = sizeof(addr);
+	getsockname(server, (struct sockaddr *)&addr, &len);
+
+	pthread_t thread;
+	pthread_create(&thread, NULL, accept_loop, &server);
+	pthread_detach(thread);
+	return ntohs(addr.sin_port);
+}
+
+static void count_deleted(const char *dn, void *ctx)
+{
+	(*(unsigned long *)ctx)++;
+}
+
+/**
+ * Deletes the whole directory with up to window deletes in flight and
+ * returns the seconds it took, or a negative number if it failed.
+ **/
+static double run(CONNECTION_PARAMS * params, unsigned window, bool tree_delete,
+		  unsigned long expected)
+{
+	directory_reset(tree_delete);
+
+	LDAP *ld;
+	int rc = connection_open(params, &ld);
+	WORKER *w = rc == LDAP_SUCCESS ? worker_start(ld) : NULL;
+	if (!w)
+	{
+		fprintf(stderr, "connect failed: %s\n", ldap_err2string(rc));
+		return -1;
+	}
+
+	unsigned long callbacks = 0;
+	double start = now();
+	DELETER *d = deleter_start(w, BASE, window, 0, count_deleted, &callbacks);
+	while (!deleter_finished(d))
+		worker_process(w, -1);
+	double time = now() - start;
+
+	DELETER_PROGRESS progress;
+	deleter_progress(d, &progress);
+	const char *failed_dn;
+	rc = deleter_result(d, &failed_dn);
+	if (rc != LDAP_SUCCESS)
+		fprintf(stderr, "delete failed: %s: %s\n", failed_dn, ldap_err2string(rc));
+	deleter_free(d);
+	worker_stop(w);
+
+	if (rc != LDAP_SUCCESS || !directory.base_deleted || directory.refused > 0
+	    || progress.deleted != expected || callbacks != expected)
+	{
+		fprintf(stderr, "delete failed: %lu of %lu entries deleted, %lu refused\n",
+			progress.deleted, expected, directory.refused);
+		return -1;
+	}
+	return time;
+}
+
+int main()
+{
+	char uri[64];
+	snprintf(uri, sizeof(uri), "ldap://127.0.0.1:%d", server_start());
+	CONNECTION_PARAMS params = { uri, NULL, {0, NULL}, LDAP_DEREF_NEVER };
+
+	const unsigned long entries = 1 + BRANCHES + BRANCHES * LEAVES;
+	double serial = 0;
+
+	for (unsigned window = 1; window <= 32; window *= 2)
+	{
+		double time = run(&params, window, false, entries);
+		if (time < 0)
+			return EXIT_FAILURE;
+		if (window == 1)
+			serial = time;
+
+		printf("delete %lu entries, %2u deletes in flight: %7.1f ms, %6.0f deletes/s, %5.2fx\n",
+		       entries, window, time * 1e3, entries / time, serial / time);
+	}
+
+	double time = run(&params, 16, true, 1);
+	if (time < 0)
+		return EXIT_FAILURE;
+	printf("delete %lu entries with the Tree Delete control: %7.1f ms\n", entries, time * 1e3);
+
+	return 0;
+}
@@ -0,0 +1,319 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <lber.h>
+#include <ldap.h>
+#include "connection.h"
+#include "expander.h"
+
+/**
+ * A stand-in for slapd serving BRANCHES containers below BASE, each with
+ * CONTAINERS containers of LEAVES entries: 1 + BRANCHES + BRANCHES *
+ * CONTAINERS containers to list when expanding BASE three levels deep.
+ * Every search is answered LATENCY_NS after it arrived, on a thread of its
+ * own, to model the round trip to a real server that works on several
+ * operations at once.
+ **/
+#define BASE "dc=example"
+#define BRANCHES 100
+#define CONTAINERS 100
+#define LEAVES 5
+#define LATENCY_NS 200000
+
+double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef struct {
+	int fd;
+	pthread_mutex_t lock;	// responses are written whole
+	unsigned active;	// searches still being answered
+	pthread_cond_t idle;
+} CLIENT;
+
+typedef struct {
+	CLIENT *client;
+	ber_int_t msgid;
+	char *base;
+	int scope;
+} SEARCH;
+
+typedef struct {
+	char *data;
+	size_t len, capacity;
+} BUFFER;
+
+static void buffer_add(BUFFER * b, BerElement * ber)
+{
+	struct berval bv;
+	ber_flatten2(ber, &bv, 0);
+	if (b->len + bv.bv_len > b->capacity)
+	{
+		b->capacity = 2 * (b->len + bv.bv_len);
+		b->data = realloc(b->data, b->capacity);
+	}
+	memcpy(b->data + b->len, bv.bv_val, bv.bv_len);
+	b->len += bv.bv_len;
+	ber_free(ber, 1);
+}
+
+static void add_entry(BUFFER * b, ber_int_t msgid, const char *dn, bool container)
+{
+	BerElement *ber = ber_alloc_t(LBER_USE_DER);
+	ber_printf(ber, "{it{s{", msgid, (ber_tag_t) LDAP_RES_SEARCH_ENTRY, dn);
+	ber_printf(ber, "{s[s]}", "hasSubordinates", container ? "TRUE" : "FALSE");
+	ber_printf(ber, "}}}");
+	buffer_add(b, ber);
+}
+
+static void *answer(void *arg)
+{
+	SEARCH *s = arg;
+	struct timespec latency = { 0, LATENCY_NS };
+	nanosleep(&latency, NULL);
+
+	BUFFER b = { 0 };
+	char dn[128];
+	int branch, container;
+	if (s->scope == LDAP_SCOPE_ONE && strcasecmp(s->base, BASE) == 0)
+	{
+		for (int i = 0; i < BRANCHES; i++)
+		{
+			snprintf(dn, sizeof(dn), "ou=b%d," BASE, i);
+			add_entry(&b, s->msgid, dn, true);
+		}
+	} else if (s->scope == LDAP_SCOPE_ONE
+		   && sscanf(s->base, "ou=c%d,ou=b%d,", &container, &branch) == 2)
+	{
+		for (int i = 0; i < LEAVES; i++)
+		{
+			snprintf(dn, sizeof(dn), "uid=u%d,%s", i, s->base);
+			add_entry(&b, s->msgid, dn, false);
+		}
+	} else if (s->scope == LDAP_SCOPE_ONE && sscanf(s->base, "ou=b%d,", &branch) == 1)
+	{
+		for (int i = 0; i < CONTAINERS; i++)
+		{
+			snprintf(dn, sizeof(dn), "ou=c%d,%s", i, s->base);
+			add_entry(&b, s->msgid, dn, true);
+		}
+	}
+
+	BerElement *ber = ber_alloc_t(LBER_USE_DER);
+	ber_printf(ber, "{it{ess}}", s->msgid, (ber_tag_t) LDAP_RES_SEARCH_RESULT, 0, "", "");
+	buffer_add(&b, ber);
+
+	CLIENT *c = s->client;
+	pthread_mutex_lock(&c->lock);
+	for (size_t off = 0; off < b.len;)
+	{
+		ssize_t n = write(c->fd, b.data + off, b.len - off);
+		if (n <= 0)
+			break;
+		off += n;
+	}
+	c->active--;
+	pthread_cond_signal(&c->idle);
+	pthread_mutex_unlock(&c->lock);
+
+	free(b.data);
+	free(s->base);
+	free(s);
+	return NULL;
+}
+
+static bool read_full(int fd, unsigned char *buf, size_t len)
+{
+	for (size_t off = 0; off < len;)
+	{
+		ssize_t n = read(fd, buf + off, len - off);
+		if (n <= 0)
+			return false;
+		off += n;
+	}
+	return true;
+}
+
+static void send_bind_result(CLIENT * c, ber_int_t msgid)
+{
+	BUFFER b = { 0 };
+	BerElement *ber = ber_alloc_t(LBER_USE_DER);
+	ber_printf(ber, "{it{ess}}", msgid, (ber_tag_t) LDAP_RES_BIND, 0, "", "");
+	buffer_add(&b, ber);
+	pthread_mutex_lock(&c->lock);
+	if (write(c->fd, b.data, b.len) < 0)
+		perror("stand-in server");
+	pthread_mutex_unlock(&c->lock);
+	free(b.data);
+}
+
+static void *serve(void *arg)
+{
+	CLIENT *c = arg;
+	unsigned char header[6];
+
+	while (read_full(c->fd, header, 2))
+	{
+		// LDAPMessage: SEQUENCE tag, then short or long form length
+		size_t len = header[1], header_len = 2;
+		if (len & 0x80)
+		{
+			unsigned n = len & 0x7f;
+			if (n > 4 || !read_full(c->fd, header + 2, n))
+				break;
+			len = 0;
+			for (unsigned i = 0; i < n; i++)
+				len = (len << 8) | header[2 + i];
+			header_len += n;
+		}
+
+		char *message = malloc(header_len + len);
+		memcpy(message, header, header_len);
+		if (!read_full(c->fd, (unsigned char *)message + header_len, len))
+		{
+			free(message);
+			break;
+		}
+
+		struct berval bv = { header_len + len, message };
+		BerElement *ber = ber_init(&bv);
+		ber_int_t msgid, scope;
+		ber_tag_t op;
+		struct berval dn;
+		ber_scanf(ber, "{it", &msgid, &op);
+
+		bool quit = op == LDAP_REQ_UNBIND;
+		if (op == LDAP_REQ_BIND)
+			send_bind_result(c, msgid);
+		else if (op == LDAP_REQ_SEARCH && ber_scanf(ber, "{me", &dn, &scope) != LBER_ERROR)
+		{
+			SEARCH *s = calloc(1, sizeof(SEARCH));
+			s->client = c;
+			s->msgid = msgid;
+			s->base = strndup(dn.bv_val, dn.bv_len);
+			s->scope = scope;
+
+			pthread_mutex_lock(&c->lock);
+			c->active++;
+			pthread_mutex_unlock(&c->lock);
+
+			pthread_t thread;
+			pthread_create(&thread, NULL, answer, s);
+			pthread_detach(thread);
+		}
+
+		ber_free(ber, 1);
+		free(message);
+		if (quit)
+			break;
+	}
+
+	pthread_mutex_lock(&c->lock);
+	while (c->active > 0)
+		pthread_cond_wait(&c->idle, &c->lock);
+	pthread_mutex_unlock(&c->lock);
+
+	close(c->fd);
+	free(c);
+	return NULL;
+}
+
+static void *accept_loop(void *arg)
+{
+	int server = *(int *)arg;
+	int fd;
+	while ((fd = accept(server, NULL, NULL)) >= 0)
+	{
+		CLIENT *c = calloc(1, sizeof(CLIENT));
+		c->fd = fd;
+		pthread_mutex_init(&c->lock, NULL);
+		pthread_cond_init(&c->idle, NULL);
+		pthread_t thread;
+		pthread_create(&thread, NULL, serve, c);
+		pthread_detach(thread);
+	}
+	return NULL;
+}
+
+static int server_start()
+{
+	static int server;
+	server = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr = { 0 };
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(server, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(server, 16) != 0)
+	{
+		perror("stand-in server");
+		exit(EXIT_FAILURE);
+	}
+
+	socklen_t len = sizeof(addr);
+	getsockname(server, (struct sockaddr *)&addr, &len);
+
+	pthread_t thread;
+	pthread_create(&thread, NULL, accept_loop, &server);
+	pthread_detach(thread);
+	return ntohs(addr.sin_port);
+}
+
+int main()
+{
+	char uri[64];
+	snprintf(uri, sizeof(uri), "ldap://127.0.0.1:%d", server_start());
+	CONNECTION_PARAMS params = { uri, NULL, {0, NULL}, LDAP_DEREF_NEVER };
+
+	const unsigned long expected = 1 + BRANCHES + BRANCHES * CONTAINERS;
+	double serial = 0;
+
+	for (unsigned concurrency = 1; concurrency <= 32; concurrency *= 2)
+	{
+		LDAP *ld;
+		int rc = connection_open(&params, &ld);
+		WORKER *w = rc == LDAP_SUCCESS ? worker_start(ld) : NULL;
+		if (!w)
+		{
+			fprintf(stderr, "connect failed: %s\n", ldap_err2string(rc));
+			return EXIT_FAILURE;
+		}
+
+		TREENODE *root = tree_node_alloc();
+		root->value = strdup(BASE);
+
+		double start = now();
+		EXPANDER *e = expander_start(w, root, root, 3, concurrency, 0, 0, NULL, NULL);
+		while (!expander_finished(e))
+			worker_process(w, -1);
+		double time = now() - start;
+		if (concurrency == 1)
+			serial = time;
+
+		unsigned long listed;
+		unsigned pending;
+		expander_progress(e, &listed, &pending);
+		expander_free(e);
+		worker_stop(w);
+		tree_node_free(root);
+
+		if (listed != expected)
+		{
+			fprintf(stderr, "expand failed: %lu of %lu containers listed\n", listed, expected);
+			return EXIT_FAILURE;
+		}
+
+		printf("expand %lu containers, %2u searches in flight: %7.1f ms, %6.0f containers/s,"
+		       " %5.2fx\n", expected, concurrency, time * 1e3, expected / time, serial / time);
+	}
+
+	return 0;
+}
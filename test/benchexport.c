@@ -0,0 +1,275 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <lber.h>
+#include <ldap.h>
+#include "ldifexport.h"
+
+/**
+ * A stand-in for slapd: answers binds and searches on a fixed directory
+ * of BRANCHES containers below BASE with LEAVES entries each. Every
+ * connection is served by its own thread, which sleeps ENTRY_COST_NS per
+ * entry sent to model the per-entry work of a real server.
+ **/
+#define BASE "dc=example"
+#define BRANCHES 32
+#define LEAVES 2000
+#define ENTRY_COST_NS 15000
+#define OUT_BUFFER (64 << 10)
+
+double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef struct {
+	int fd;
+	char buffer[OUT_BUFFER];
+	size_t len;
+	unsigned unpaid;	// entries sent since the last sleep
+} CLIENT;
+
+static void client_flush(CLIENT * c)
+{
+	for (size_t off = 0; off < c->len;)
+	{
+		ssize_t n = write(c->fd, c->buffer + off, c->len - off);
+		if (n <= 0)
+			break;
+		off += n;
+	}
+	c->len = 0;
+}
+
+static void client_send(CLIENT * c, BerElement * ber)
+{
+	struct berval bv;
+	ber_flatten2(ber, &bv, 0);
+	if (c->len + bv.bv_len > sizeof(c->buffer))
+		client_flush(c);
+	memcpy(c->buffer + c->len, bv.bv_val, bv.bv_len);
+	c->len += bv.bv_len;
+	ber_free(ber, 1);
+}
+
+static void send_result(CLIENT * c, ber_int_t msgid, ber_tag_t tag)
+{
+	BerElement *ber = ber_alloc_t(LBER_USE_DER);
+	ber_printf(ber, "{it{ess}}", msgid, tag, 0, "", "");
+	client_send(c, ber);
+	client_flush(c);
+}
+
+static void send_entry(CLIENT * c, ber_int_t msgid, const char *dn, const char *cn)
+{
+	char mail[128];
+	snprintf(mail, sizeof(mail), "%s@example.com", cn);
+
+	BerElement *ber = ber_alloc_t(LBER_USE_DER);
+	ber_printf(ber, "{it{s{", msgid, (ber_tag_t) LDAP_RES_SEARCH_ENTRY, dn);
+	ber_printf(ber, "{s[ss]}", "objectClass", "top", "inetOrgPerson");
+	ber_printf(ber, "{s[s]}{s[s]}{s[s]}", "cn", cn, "sn", cn, "mail", mail);
+	ber_printf(ber, "{s[s]}", "description",
+		   "an entry of the export benchmark, long enough to look like real data");
+	ber_printf(ber, "}}}");
+	client_send(c, ber);
+
+	if (++c->unpaid == 64)
+	{
+		struct timespec cost = { 0, 64L * ENTRY_COST_NS };
+		nanosleep(&cost, NULL);
+		c->unpaid = 0;
+	}
+}
+
+static void send_branch(CLIENT * c, ber_int_t msgid, int branch)
+{
+	char dn[64], cn[16];
+	snprintf(cn, sizeof(cn), "b%d", branch);
+	snprintf(dn, sizeof(dn), "ou=%s," BASE, cn);
+	send_entry(c, msgid, dn, cn);
+}
+
+static void send_leaf(CLIENT * c, ber_int_t msgid, int branch, int leaf)
+{
+	char dn[64], cn[16];
+	snprintf(cn, sizeof(cn), "u%d", leaf);
+	snprintf(dn, sizeof(dn), "uid=%s,ou=b%d," BASE, cn, branch);
+	send_entry(c, msgid, dn, cn);
+}
+
+static void search(CLIENT * c, ber_int_t msgid, const char *base, int scope)
+{
+	int branch, leaf;
+	if (strcasecmp(base, BASE) == 0)
+	{
+		if (scope != LDAP_SCOPE_ONE)
+			send_entry(c, msgid, BASE, "example");
+		for (int b = 0; b < BRANCHES && scope != LDAP_SCOPE_BASE; b++)
+		{
+			send_branch(c, msgid, b);
+			for (int l = 0; l < LEAVES && scope == LDAP_SCOPE_SUB; l++)
+				send_leaf(c, msgid, b, l);
+		}
+	} else if (sscanf(base, "uid=u%d,ou=b%d,", &leaf, &branch) == 2)
+	{
+		if (scope != LDAP_SCOPE_ONE)
+			send_leaf(c, msgid, branch, leaf);
+	} else if (sscanf(base, "ou=b%d,", &branch) == 1)
+	{
+		if (scope != LDAP_SCOPE_ONE)
+			send_branch(c, msgid, branch);
+		for (int l = 0; l < LEAVES && scope != LDAP_SCOPE_BASE; l++)
+			send_leaf(c, msgid, branch, l);
+	}
+	send_result(c, msgid, LDAP_RES_SEARCH_RESULT);
+}
+
+static bool read_full(int fd, unsigned char *buf, size_t len)
+{
+	for (size_t off = 0; off < len;)
+	{
+		ssize_t n = read(fd, buf + off, len - off);
+		if (n <= 0)
+			return false;
+		off += n;
+	}
+	return true;
+}
+
+static void *serve(void *arg)
+{
+	CLIENT *c = arg;
+	unsigned char header[6];
+
+	while (read_full(c->fd, header, 2))
+	{
+		// LDAPMessage: SEQUENCE tag, then short or long form length
+		size_t len = header[1], header_len = 2;
+		if (len & 0x80)
+		{
+			unsigned n = len & 0x7f;
+			if (n > 4 || !read_full(c->fd, header + 2, n))
+				break;
+			len = 0;
+			for (unsigned i = 0; i < n; i++)
+				len = (len << 8) | header[2 + i];
+			header_len += n;
+		}
+
+		char *message = malloc(header_len + len);
+		memcpy(message, header, header_len);
+		if (!read_full(c->fd, (unsigned char *)message + header_len, len))
+		{
+			free(message);
+			break;
+		}
+
+		struct berval bv = { header_len + len, message };
+		BerElement *ber = ber_init(&bv);
+		ber_int_t msgid, scope;
+		ber_tag_t op;
+		struct berval dn;
+		ber_scanf(ber, "{it", &msgid, &op);
+
+		bool quit = op == LDAP_REQ_UNBIND;
+		if (op == LDAP_REQ_BIND)
+			send_result(c, msgid, LDAP_RES_BIND);
+		else if (op == LDAP_REQ_SEARCH && ber_scanf(ber, "{me", &dn, &scope) != LBER_ERROR)
+		{
+			char *base = strndup(dn.bv_val, dn.bv_len);
+			search(c, msgid, base, scope);
+			free(base);
+		}
+
+		ber_free(ber, 1);
+		free(message);
+		if (quit)
+			break;
+	}
+
+	close(c->fd);
+	free(c);
+	return NULL;
+}
+
+static void *accept_loop(void *arg)
+{
+	int server = *(int *)arg;
+	int fd;
+	while ((fd = accept(server, NULL, NULL)) >= 0)
+	{
+		CLIENT *c = calloc(1, sizeof(CLIENT));
+		c->fd = fd;
+		pthread_t thread;
+		pthread_create(&thread, NULL, serve, c);
+		pthread_detach(thread);
+	}
+	return NULL;
+}
+
+static int server_start()
+{
+	static int server;
+	server = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr = { 0 };
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(server, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(server, 16) != 0)
+	{
+		perror("stand-in server");
+		exit(EXIT_FAILURE);
+	}
+
+	socklen_t len = sizeof(addr);
+	getsockname(server, (struct sockaddr *)&addr, &len);
+
+	pthread_t thread;
+	pthread_create(&thread, NULL, accept_loop, &server);
+	pthread_detach(thread);
+	return ntohs(addr.sin_port);
+}
+
+int main()
+{
+	char uri[64];
+	snprintf(uri, sizeof(uri), "ldap://127.0.0.1:%d", server_start());
+	CONNECTION_PARAMS params = { uri, NULL, {0, NULL}, LDAP_DEREF_NEVER };
+
+	const unsigned expected = 1 + BRANCHES + BRANCHES * LEAVES;
+	char filename[] = "/tmp/benchexport.ldif";
+	double single = 0;
+
+	for (unsigned connections = 1; connections <= 8; connections *= 2)
+	{
+		LDIF_STATS stats;
+		double start = now();
+		LDIF_EXPORT *export = ldif_export_start(&params, connections, filename, false, BASE,
+							NULL, 0, &stats);
+		int rc = export ? ldif_export_join(export) : LDAP_LOCAL_ERROR;
+		double time = now() - start;
+		if (connections == 1)
+			single = time;
+
+		if (rc != LDAP_SUCCESS || stats.entries != expected)
+		{
+			fprintf(stderr, "export failed: %s, %lu of %u entries\n", ldap_err2string(rc),
+				stats.entries, expected);
+			return EXIT_FAILURE;
+		}
+
+		printf("export %u entries over %u connections: %7.1f ms, %7.0f entries/s, %.2fx\n",
+		       expected, connections, time * 1e3, expected / time, single / time);
+	}
+
+	unlink(filename);
+	return 0;
+}
@@ -0,0 +1,397 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <lber.h>
+#include <ldap.h>
+#include "ldifimport.h"
+
+/**
+ * A stand-in for slapd holding BASE, below which the generated LDIF adds
+ * containers of LEAVES entries each. Like a real server it refuses entries
+ * whose parent does not exist yet, and it checks that the values of each
+ * entry arrive grouped into the expected number of attributes. Every add
+ * is answered LATENCY_NS after it arrived, in arrival order, by a
+ * responder thread per connection.
+ **/
+#define BASE "dc=example"
+#define LEAVES 1000
+#define LATENCY_NS 200000
+
+typedef struct {
+	pthread_mutex_t lock;
+	unsigned branches;
+	bool *added;		// [branch * (LEAVES + 1) + LEAVES] is the branch itself
+	unsigned long malformed;	// entries with unexpected attributes
+} DIRECTORY;
+
+DIRECTORY directory = { PTHREAD_MUTEX_INITIALIZER };
+
+double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void directory_reset(unsigned branches)
+{
+	pthread_mutex_lock(&directory.lock);
+	free(directory.added);
+	directory.branches = branches;
+	directory.added = calloc(branches * (LEAVES + 1), sizeof(bool));
+	directory.malformed = 0;
+	pthread_mutex_unlock(&directory.lock);
+}
+
+static int add(const char *dn, unsigned attributes)
+{
+	unsigned branch, leaf;
+	bool *added;
+	if (sscanf(dn, "uid=u%u,ou=b%u,", &leaf, &branch) == 2 && branch < directory.branches
+	    && leaf < LEAVES)
+	{
+		if (!directory.added[branch * (LEAVES + 1) + LEAVES])
+			return LDAP_NO_SUCH_OBJECT;
+		added = &directory.added[branch * (LEAVES + 1) + leaf];
+		if (attributes != 5)
+			directory.malformed++;
+	} else if (sscanf(dn, "ou=b%u,", &branch) == 1 && branch < directory.branches)
+	{
+		added = &directory.added[branch * (LEAVES + 1) + LEAVES];
+		if (attributes != 2)
+			directory.malformed++;
+	} else
+		return LDAP_NO_SUCH_OBJECT;
+
+	if (*added)
+		return LDAP_ALREADY_EXISTS;
+	*added = true;
+	return LDAP_SUCCESS;
+}
+
+typedef struct OPERATION_S {
+	ber_int_t msgid;
+	char *dn;
+	unsigned attributes;
+	double due;
+	struct OPERATION_S *next;
+} OPERATION;
+
+typedef struct {
+	int fd;
+	pthread_mutex_t lock;
+	pthread_cond_t queued;
+	OPERATION *head, *tail;	// in arrival order, so also by due time
+	bool closed;
+} CLIENT;
+
+static void send_result(int fd, ber_int_t msgid, ber_tag_t tag, int rc)
+{
+	BerElement *ber = ber_alloc_t(LBER_USE_DER);
+	ber_printf(ber, "{it{ess}}", msgid, tag, rc, "", "");
+	struct berval bv;
+	ber_flatten2(ber, &bv, 0);
+	for (size_t off = 0; off < bv.bv_len;)
+	{
+		ssize_t n = write(fd, bv.bv_val + off, bv.bv_len - off);
+		if (n <= 0)
+			break;
+		off += n;
+	}
+	ber_free(ber, 1);
+}
+
+static void *respond(void *arg)
+{
+	CLIENT *c = arg;
+
+	pthread_mutex_lock(&c->lock);
+	while (true)
+	{
+		while (!c->head && !c->closed)
+			pthread_cond_wait(&c->queued, &c->lock);
+		OPERATION *op = c->head;
+		if (!op)
+			break;
+		c->head = op->next;
+		if (!c->head)
+			c->tail = NULL;
+		pthread_mutex_unlock(&c->lock);
+
+		double wait = op->due - now();
+		if (wait > 0)
+		{
+			struct timespec ts = { 0, (long)(wait * 1e9) };
+			nanosleep(&ts, NULL);
+		}
+
+		pthread_mutex_lock(&directory.lock);
+		int rc = add(op->dn, op->attributes);
+		pthread_mutex_unlock(&directory.lock);
+		send_result(c->fd, op->msgid, LDAP_RES_ADD, rc);
+
+		free(op->dn);
+		free(op);
+		pthread_mutex_lock(&c->lock);
+	}
+	pthread_mutex_unlock(&c->lock);
+	return NULL;
+}
+
+static bool read_full(int fd, unsigned char *buf, size_t len)
+{
+	for (size_t off = 0; off < len;)
+	{
+		ssize_t n = read(fd, buf + off, len - off);
+		if (n <= 0)
+			return false;
+		off += n;
+	}
+	return true;
+}
+
+/**
+ * Reads the attribute list of an add request, returns the number of
+ * attributes in it.
+ **/
+static unsigned count_attributes(BerElement * ber)
+{
+	unsigned count = 0;
+	ber_len_t len;
+	char *last;
+	for (ber_tag_t tag = ber_first_element(ber, &len, &last); tag != LBER_DEFAULT;
+	     tag = ber_next_element(ber, &len, last))
+	{
+		struct berval type;
+		if (ber_scanf(ber, "{mx}", &type) == LBER_ERROR)
+			break;
+		count++;
+	}
+	return count;
+}
+
+static void *serve(void *arg)
+{
+	CLIENT *c = arg;
+	unsigned char header[6];
+
+	pthread_t responder;
+	pthread_create(&responder, NULL, respond, c);
+
+	while (read_full(c->fd, header, 2))
+	{
+		// LDAPMessage: SEQUENCE tag, then short or long form length
+		size_t len = header[1], header_len = 2;
+		if (len & 0x80)
+		{
+			unsigned n = len & 0x7f;
+			if (n > 4 || !read_full(c->fd, header + 2, n))
+				break;
+			len = 0;
+			for (unsigned i = 0; i < n; i++)
+				len = (len << 8) | header[2 + i];
+			header_len += n;
+		}
+
+		char *message = malloc(header_len + len);
+		memcpy(message, header, header_len);
+		if (!read_full(c->fd, (unsigned char *)message + header_len, len))
+		{
+			free(message);
+			break;
+		}
+
+		struct berval bv = { header_len + len, message };
+		BerElement *ber = ber_init(&bv);
+		ber_int_t msgid;
+		ber_len_t tag_len;
+		struct berval dn = { 0, NULL };
+		ber_scanf(ber, "{i", &msgid);
+		ber_tag_t op = ber_peek_tag(ber, &tag_len);
+
+		bool quit = op == LDAP_REQ_UNBIND;
+		if (op == LDAP_REQ_BIND)
+		{
+			// before any add, the responder does not write yet
+			send_result(c->fd, msgid, LDAP_RES_BIND, LDAP_SUCCESS);
+		} else if (op == LDAP_REQ_ADD && ber_scanf(ber, "{m", &dn) != LBER_ERROR)
+		{
+			OPERATION *o = calloc(1, sizeof(OPERATION));
+			o->msgid = msgid;
+			o->dn = strndup(dn.bv_val, dn.bv_len);
+			o->attributes = count_attributes(ber);
+			o->due = now() + LATENCY_NS / 1e9;
+
+			pthread_mutex_lock(&c->lock);
+			if (c->tail)
+				c->tail->next = o;
+			else
+				c->head = o;
+			c->tail = o;
+			pthread_cond_signal(&c->queued);
+			pthread_mutex_unlock(&c->lock);
+		}
+
+		ber_free(ber, 1);
+		free(message);
+		if (quit)
+			break;
+	}
+
+	pthread_mutex_lock(&c->lock);
+	c->closed = true;
+	pthread_cond_signal(&c->queued);
+	pthread_mutex_unlock(&c->lock);
+	pthread_join(responder, NULL);
+
+	close(c->fd);
+	free(c);
+	return NULL;
+}
+
+static void *accept_loop(void *arg)
+{
+	int server = *(int *)arg;
+	int fd;
+	while ((fd = accept(server, NULL, NULL)) >= 0)
+	{
+		CLIENT *c = calloc(1, sizeof(CLIENT));
+		c->fd = fd;
+		pthread_mutex_init(&c->lock, NULL);
+		pthread_cond_init(&c->queued, NULL);
+		pthread_t thread;
+		pthread_create(&thread, NULL, serve, c);
+		pthread_detach(thread);
+	}
+	return NULL;
+}
+
+static int server_start()
+{
+	static int server;
+	server = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr = { 0 };
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(server, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(server, 16) != 0)
+	{
+		perror("stand-in server");
+		exit(EXIT_FAILURE);
+	}
+
+	socklen_t len = sizeof(addr);
+	getsockname(server, (struct sockaddr *)&addr, &len);
+
+	pthread_t thread;
+	pthread_create(&thread, NULL, accept_loop, &server);
+	pthread_detach(thread);
+	return ntohs(addr.sin_port);
+}
+
+/**
+ * Writes branches containers of LEAVES person entries each, every
+ * container before its children, and one entry the server has to refuse.
+ * Returns the size of the file in bytes.
+ **/
+static size_t generate(const char *filename, unsigned branches)
+{
+	FILE *f = fopen(filename, "w");
+	if (!f)
+	{
+		perror(filename);
+		exit(EXIT_FAILURE);
+	}
+
+	fprintf(f, "version: 1\n\n");
+	for (unsigned i = 0; i < branches; i++)
+	{
+		fprintf(f, "dn: ou=b%u," BASE "\nobjectClass: organizationalUnit\nou: b%u\n\n", i, i);
+		for (unsigned j = 0; j < LEAVES; j++)
+			fprintf(f, "# person %u of b%u\ndn: uid=u%u,ou=b%u," BASE "\n"
+				"objectClass: top\nobjectClass: person\n"
+				"objectClass: organizationalPerson\nobjectClass: inetOrgPerson\n"
+				"uid: u%u\ncn: User %u\nsn: %u\n"
+				"description:: VGhpcyBkZXNjcmlwdGlvbiBpcyBiYXNlNjQgZW5jb2RlZCBhbmQgbG9uZ2Vy\n"
+				" IHRoYW4gb25lIGxpbmUu\n\n", j, i, j, i, j, j, j);
+	}
+	fprintf(f, "dn: uid=lost,ou=missing," BASE "\nobjectClass: person\ncn: lost\nsn: lost\n");
+
+	size_t size = ftell(f);
+	fclose(f);
+	return size;
+}
+
+/**
+ * Imports filename with up to window adds in flight and returns the
+ * seconds it took, or a negative number if it failed.
+ **/
+static double run(CONNECTION_PARAMS * params, const char *filename, unsigned branches,
+		  unsigned window)
+{
+	directory_reset(branches);
+	const char *reject_filename = "/tmp/benchimport.ldif.rej";
+	unlink(reject_filename);
+
+	LDIF_STATS stats;
+	double start = now();
+	LDIF_IMPORT *import = ldif_import_start(params, filename, reject_filename, window, false,
+						&stats);
+	int rc = import ? ldif_import_join(import) : LDAP_LOCAL_ERROR;
+	double time = now() - start;
+
+	const unsigned long expected = branches * (LEAVES + 1UL);
+	bool rejects_written = access(reject_filename, R_OK) == 0;
+	unlink(reject_filename);
+	if (rc != LDAP_SUCCESS || stats.entries != expected || stats.rejected != 1
+	    || !rejects_written || directory.malformed > 0)
+	{
+		fprintf(stderr, "import failed: %s, %lu of %lu entries, %lu rejected, %lu malformed\n",
+			ldap_err2string(rc), stats.entries, expected, stats.rejected,
+			directory.malformed);
+		return -1;
+	}
+	return time;
+}
+
+/**
+ * Usage: benchImport [entries], 1000000 for the full size run.
+ **/
+int main(int argc, char *argv[])
+{
+	unsigned long requested = argc > 1 ? strtoul(argv[1], NULL, 10) : 20000;
+	unsigned branches = requested / (LEAVES + 1) > 0 ? requested / (LEAVES + 1) : 1;
+	const unsigned long entries = branches * (LEAVES + 1UL);
+
+	char filename[] = "/tmp/benchimport.ldif";
+	size_t size = generate(filename, branches);
+
+	char uri[64];
+	snprintf(uri, sizeof(uri), "ldap://127.0.0.1:%d", server_start());
+	CONNECTION_PARAMS params = { uri, NULL, {0, NULL}, LDAP_DEREF_NEVER };
+	double serial = 0;
+
+	for (unsigned window = 1; window <= 64; window *= 2)
+	{
+		double time = run(&params, filename, branches, window);
+		if (time < 0)
+		{
+			unlink(filename);
+			return EXIT_FAILURE;
+		}
+		if (window == 1)
+			serial = time;
+
+		printf("import %lu entries (%.1f MB), %2u adds in flight: %8.1f ms, %7.0f adds/s, %5.2fx\n",
+		       entries, size / 1048576.0, window, time * 1e3, entries / time, serial / time);
+	}
+
+	unlink(filename);
+	return 0;
+}
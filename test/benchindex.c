@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "ldifindex.h"
+
+/**
+ * Generates a dump like slapcat writes one: containers of LEAVES person
+ * entries below BASE, parents first, with a base64 encoded value per
+ * entry. Opens it with ldif_index_open() and reports the time taken and
+ * the memory held, then looks entries up the way browsing does.
+ **/
+#define BASE "dc=example,dc=com"
+#define LEAVES 1000
+#define LOOKUPS 100000
+
+double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long max_rss_kb()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+static size_t generate(const char *filename, unsigned branches)
+{
+	FILE *f = fopen(filename, "w");
+	if (!f)
+	{
+		perror(filename);
+		exit(EXIT_FAILURE);
+	}
+
+	fprintf(f, "version: 1\n\ndn: " BASE "\nobjectClass: domain\ndc: example\n\n");
+	for (unsigned i = 0; i < branches; i++)
+	{
+		fprintf(f, "dn: ou=b%u," BASE "\nobjectClass: organizationalUnit\nou: b%u\n\n", i, i);
+		for (unsigned j = 0; j < LEAVES; j++)
+			fprintf(f, "dn: uid=u%u,ou=b%u," BASE "\n"
+				"objectClass: top\nobjectClass: person\n"
+				"objectClass: organizationalPerson\nobjectClass: inetOrgPerson\n"
+				"uid: u%u\ncn: User %u\nsn: %u\nmail: u%u@example.com\n"
+				"description:: VGhpcyBkZXNjcmlwdGlvbiBpcyBiYXNlNjQgZW5jb2RlZCBhbmQgbG9uZ2Vy\n"
+				" IHRoYW4gb25lIGxpbmUu\n"
+				"entryUUID: %08x-0000-4000-8000-%012x\n"
+				"createTimestamp: 20240101000000Z\n\n", j, i, j, j, j, j, i, j);
+	}
+
+	size_t size = ftell(f);
+	fclose(f);
+	return size;
+}
+
+/**
+ * Usage: benchIndex [entries], the default makes a file of about 170 MB.
+ **/
+int main(int argc, char *argv[])
+{
+	unsigned long requested = argc > 1 ? strtoul(argv[1], NULL, 10) : 500000;
+	unsigned branches = requested / (LEAVES + 1) > 0 ? requested / (LEAVES + 1) : 1;
+	const unsigned long entries = 1 + branches * (LEAVES + 1UL);
+
+	char filename[] = "/tmp/benchindex.ldif";
+	size_t size = generate(filename, branches);
+	long rss_before = max_rss_kb();
+
+	double start = now();
+	LDIF_INDEX *index = ldif_index_open(filename);
+	double open_time = now() - start;
+	long open_rss = max_rss_kb() - rss_before;
+	if (!index || ldif_index_count(index) != entries || ldif_index_skipped(index) != 0)
+	{
+		fprintf(stderr, "indexing failed\n");
+		unlink(filename);
+		return EXIT_FAILURE;
+	}
+
+	// what expanding and selecting does: find a container, list it, read an entry
+	char dn[128];
+	unsigned found = 0;
+	start = now();
+	for (unsigned i = 0; i < LOOKUPS; i++)
+	{
+		snprintf(dn, sizeof(dn), "uid=u%u,ou=b%u," BASE, (i * 7919) % LEAVES, i % branches);
+		LDIF_RECORD record;
+		unsigned count;
+		ldif_index_children(index, ldif_index_find(index, dn + strcspn(dn, ",") + 1), &count);
+		found += ldif_index_record(index, ldif_index_find(index, dn), &record) && count == LEAVES;
+	}
+	double lookup_time = now() - start;
+	if (found != LOOKUPS)
+	{
+		fprintf(stderr, "lookups failed: %u of %u\n", found, LOOKUPS);
+		unlink(filename);
+		return EXIT_FAILURE;
+	}
+
+	size_t index_size = ldif_index_size(index);
+	printf("index %lu entries (%.1f MB): %7.1f ms, %6.0f MB/s, %8.0f entries/s\n", entries,
+	       size / 1048576.0, open_time * 1e3, size / 1048576.0 / open_time,
+	       entries / open_time);
+	printf("index size %.1f MB, %.1f bytes per entry, %.1f%% of the file, max rss %+ld kB\n",
+	       index_size / 1048576.0, (double)index_size / entries, 100.0 * index_size / size,
+	       open_rss);
+	printf("%u lookups of a container and an entry: %.2f us each\n", LOOKUPS,
+	       lookup_time * 1e6 / LOOKUPS);
+
+	ldif_index_close(index);
+	unlink(filename);
+	return 0;
+}
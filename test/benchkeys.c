@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <curses.h>
+#include <term.h>
+#include "treeview.h"
+
+/**
+ * Holds KEY_DOWN the way auto-repeat does: a thread writes the key into
+ * the input of curses at a fixed rate while the loop of render() handles
+ * it, and the time from writing each key to the redraw showing its move
+ * is recorded. The coalescing loop is compared with the former one that
+ * redrew and looked up the entry (simulated by a sleep) for every key.
+ **/
+#define CHILDREN 100000
+#define KEYS 200
+#define LOOKUP_MS 30
+
+double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef struct {
+	int fd;
+	const char *key;
+	unsigned rate;		// keys per second, 0 writes them all at once
+	double sent[KEYS];
+} REPEATER;
+
+void *repeat_key(void *arg)
+{
+	REPEATER *r = arg;
+	for (unsigned i = 0; i < KEYS; i++)
+	{
+		r->sent[i] = now();
+		if (write(r->fd, r->key, strlen(r->key)) < 0)
+			break;
+		if (r->rate)
+			usleep(1000000 / r->rate);
+	}
+	return NULL;
+}
+
+void bench(TREEVIEW * tv, int input, const char *key, unsigned rate, bool coalesce)
+{
+	REPEATER r = { input, key, rate };
+	pthread_t thread;
+	treeview_set_tree(tv, tv->root);
+	tv->toprow = 0;
+	pthread_create(&thread, NULL, repeat_key, &r);
+
+	unsigned handled = 0, redraws = 0;
+	double total = 0, worst = 0;
+	while (handled < KEYS)
+	{
+		int c = getch();
+		int rows = treeview_navigation_rows(tv, c);
+		if (coalesce)
+			rows += treeview_drain_navigation(tv);
+		treeview_move(tv, rows);
+		if (!coalesce)
+			usleep(LOOKUP_MS * 1000);
+		redraws++;
+
+		double shown = now();
+		for (unsigned end = handled + rows; handled < end && handled < KEYS; handled++)
+		{
+			double latency = shown - r.sent[handled];
+			total += latency;
+			worst = latency > worst ? latency : worst;
+		}
+	}
+	pthread_join(thread, NULL);
+
+	char repeat[32];
+	snprintf(repeat, sizeof(repeat), rate ? "%u keys/s" : "all at once", rate);
+	printf("%-27s %-11s: %3u redraws, latency mean %7.2f ms, max %7.2f ms\n",
+	       coalesce ? "coalesced, debounced lookup" : "redraw and lookup per key", repeat,
+	       redraws, total * 1e3 / KEYS, worst * 1e3);
+}
+
+int main()
+{
+	int fds[2];
+	if (pipe(fds) != 0)
+	{
+		perror("pipe");
+		return EXIT_FAILURE;
+	}
+
+	FILE *in = fdopen(fds[0], "r"), *out = fopen("/dev/null", "w");
+	SCREEN *screen = newterm(getenv("TERM") ? NULL : "xterm", out, in);
+	if (!screen)
+	{
+		fprintf(stderr, "no terminal description\n");
+		return EXIT_FAILURE;
+	}
+	cbreak();
+	noecho();
+	keypad(stdscr, TRUE);
+	const char *key = tigetstr("kcud1");
+
+	TREENODE *root = tree_node_alloc();
+	root->value = strdup("dc=example,dc=com");
+	tree_node_reserve_children(root, CHILDREN);
+	for (unsigned i = 0; i < CHILDREN; i++)
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "uid=user%u", i);
+		tree_node_alloc_child(root, name)->is_leaf = true;
+	}
+
+	TREEVIEW *tv = treeview_init(LINES / 2, COLS);
+	tv->root = root;
+	bench(tv, fds[1], key, 40, true);
+	bench(tv, fds[1], key, 0, true);
+	bench(tv, fds[1], key, 40, false);
+
+	treeview_free(tv);
+	tree_node_free(root);
+	endwin();
+	delscreen(screen);
+	fclose(out);
+	return 0;
+}
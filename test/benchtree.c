@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "tree.h"
+
+double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * The NULL terminated, grow-by-one child list tree_node_append_child()
+ * used to maintain, kept here as the baseline.
+ **/
+void legacy_append_child(TREENODE *** children, TREENODE * child)
+{
+	unsigned len;
+	for (len = 0; *children && (*children)[len] != NULL; len++)
+		;
+	*children = realloc(*children, (len + 2) * sizeof(TREENODE *));
+	(*children)[len] = child;
+	(*children)[len + 1] = NULL;
+}
+
+void bench_append(unsigned n)
+{
+	TREENODE **nodes = malloc(n * sizeof(TREENODE *));
+	for (unsigned i = 0; i < n; i++)
+		nodes[i] = tree_node_alloc();
+
+	double start = now();
+	TREENODE **legacy = NULL;
+	for (unsigned i = 0; i < n; i++)
+		legacy_append_child(&legacy, nodes[i]);
+	double legacy_time = now() - start;
+	free(legacy);
+
+	TREENODE *root = tree_node_alloc();
+	start = now();
+	for (unsigned i = 0; i < n; i++)
+		tree_node_append_child(root, nodes[i]);
+	double append_time = now() - start;
+	root->num_children = 0;
+
+	start = now();
+	tree_node_reserve_children(root, n);
+	tree_node_append_children(root, nodes, n);
+	double bulk_time = now() - start;
+
+	printf("%8u children: legacy %9.3f ms, append %7.3f ms, bulk %7.3f ms\n", n,
+	       legacy_time * 1e3, append_time * 1e3, bulk_time * 1e3);
+
+	tree_node_free(root);
+	free(nodes);
+}
+
+long resident_kb()
+{
+	long pages = 0, resident = 0;
+	FILE *statm = fopen("/proc/self/statm", "r");
+	if (statm)
+	{
+		if (fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+			resident = 0;
+		fclose(statm);
+	}
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * Loads containers x leaves nodes below a root, either with one heap
+ * allocation per node and value or from the per-container arenas, and
+ * collapses it again.
+ **/
+void bench_load_collapse(unsigned containers, unsigned leaves, bool use_arena)
+{
+	char value[32];
+	long rss_before = resident_kb();
+	double start = now();
+
+	TREENODE *root = tree_node_alloc();
+	for (unsigned i = 0; i < containers; i++)
+	{
+		sprintf(value, "ou=container%u", i);
+		TREENODE *container;
+		if (use_arena)
+		{
+			container = tree_node_alloc_child(root, value);
+		} else
+		{
+			container = tree_node_alloc();
+			container->value = strdup(value);
+			tree_node_append_child(root, container);
+		}
+
+		for (unsigned j = 0; j < leaves; j++)
+		{
+			sprintf(value, "cn=user%u", j);
+			if (use_arena)
+			{
+				tree_node_alloc_child(container, value);
+			} else
+			{
+				TREENODE *leaf = tree_node_alloc();
+				leaf->value = strdup(value);
+				tree_node_append_child(container, leaf);
+			}
+		}
+	}
+	double load_time = now() - start;
+	long rss = resident_kb() - rss_before;
+
+	start = now();
+	tree_node_remove_childs(root);
+	double collapse_time = now() - start;
+	tree_node_free(root);
+
+	printf("%8u nodes %-5s: load %8.1f ms, collapse %7.1f ms, RSS %7ld kB\n",
+	       containers * leaves, use_arena ? "arena" : "heap", load_time * 1e3,
+	       collapse_time * 1e3, rss);
+}
+
+/**
+ * Runs bench_load_collapse() in a child process so the RSS of one run
+ * does not reuse memory freed by the other.
+ **/
+void bench_load_collapse_isolated(unsigned containers, unsigned leaves, bool use_arena)
+{
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		bench_load_collapse(containers, leaves, use_arena);
+		exit(0);
+	}
+	waitpid(pid, NULL, 0);
+}
+
+/**
+ * Pre-order walk the tree view used to do for every row lookup.
+ **/
+TREENODE *legacy_node_with_index(TREENODE * node, unsigned requested, unsigned *current)
+{
+	if (requested == (*current)++)
+		return node;
+
+	for (unsigned i = 0; i < node->num_children; i++)
+	{
+		TREENODE *result = legacy_node_with_index(node->children[i], requested, current);
+		if (result)
+			return result;
+	}
+	return NULL;
+}
+
+void bench_rows(unsigned containers, unsigned leaves, unsigned lookups)
+{
+	TREENODE *root = tree_node_alloc();
+	for (unsigned i = 0; i < containers; i++)
+	{
+		TREENODE *container = tree_node_alloc_child(root, "ou=container");
+		for (unsigned j = 0; j < leaves; j++)
+			tree_node_alloc_child(container, "cn=user");
+	}
+
+	unsigned rows = root->subtree_size;
+	srand(1);
+
+	double start = now();
+	for (unsigned i = 0; i < lookups; i++)
+	{
+		unsigned current = 0;
+		legacy_node_with_index(root, rand() % rows, &current);
+	}
+	double legacy_time = now() - start;
+
+	start = now();
+	for (unsigned i = 0; i < lookups; i++)
+	{
+		unsigned row;
+		tree_node_row(root, tree_node_at_row(root, rand() % rows), &row);
+	}
+	double indexed_time = now() - start;
+
+	printf("%8u rows: %u row lookups legacy %9.3f ms, indexed row+node %7.3f ms\n", rows,
+	       lookups, legacy_time * 1e3, indexed_time * 1e3);
+
+	tree_node_free(root);
+}
+
+int main()
+{
+	for (unsigned n = 1000; n <= 100000; n *= 10)
+		bench_append(n);
+
+	bench_load_collapse_isolated(1000, 1000, false);
+	bench_load_collapse_isolated(1000, 1000, true);
+
+	bench_rows(500, 1000, 1000);
+	return 0;
+}
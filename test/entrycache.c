@@ -0,0 +1,161 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include "entrycache.h"
+
+ENTRY *test_entry(const char *dn)
+{
+	ENTRY *e = entry_alloc(dn);
+	entry_add_attribute(e, "cn");
+	entry_add_value(e, "foo", 3);
+	return e;
+}
+
+void test_put_get()
+{
+	ENTRY_CACHE *c = entry_cache_init(1 << 20, 0);
+	entry_cache_put(c, "cn=foo,dc=root", test_entry("cn=foo,dc=root"));
+
+	ENTRY *e = entry_cache_get(c, "CN=Foo,dc=root");
+	assert(e != NULL);
+	assert(strcmp(e->attributes[0].values[0].data, "foo") == 0);
+	assert(entry_cache_get(c, "cn=bar,dc=root") == NULL);
+
+	entry_cache_free(c);
+}
+
+void test_get_attribute()
+{
+	ENTRY *e = test_entry("cn=foo,dc=root");
+	ENTRY_ATTRIBUTE *attr = entry_get_attribute(e, "CN");
+	assert(attr == &e->attributes[0]);
+	assert(entry_get_attribute(e, "sn") == NULL);
+	entry_free(e);
+}
+
+void test_replace()
+{
+	ENTRY_CACHE *c = entry_cache_init(1 << 20, 0);
+	entry_cache_put(c, "cn=foo,dc=root", test_entry("cn=foo,dc=root"));
+	entry_cache_put(c, "cn=foo,dc=root", test_entry("cn=foo,dc=root"));
+	assert(c->count == 1);
+	entry_cache_free(c);
+}
+
+void test_lru_eviction()
+{
+	ENTRY *probe = test_entry("cn=a,dc=root");
+	size_t entry_size = probe->size;
+	entry_free(probe);
+
+	ENTRY_CACHE *c = entry_cache_init(2 * entry_size, 0);
+	entry_cache_put(c, "cn=a,dc=root", test_entry("cn=a,dc=root"));
+	entry_cache_put(c, "cn=b,dc=root", test_entry("cn=b,dc=root"));
+	assert(entry_cache_get(c, "cn=a,dc=root"));	// b is least recently used now
+	entry_cache_put(c, "cn=c,dc=root", test_entry("cn=c,dc=root"));
+
+	assert(c->count == 2);
+	assert(entry_cache_get(c, "cn=a,dc=root"));
+	assert(!entry_cache_get(c, "cn=b,dc=root"));
+	assert(entry_cache_get(c, "cn=c,dc=root"));
+
+	entry_cache_free(c);
+}
+
+void test_expiry()
+{
+	ENTRY_CACHE *c = entry_cache_init(1 << 20, 10);
+	entry_cache_put(c, "cn=a,dc=root", test_entry("cn=a,dc=root"));
+	c->lru_head->stored -= 11;
+
+	assert(!entry_cache_get(c, "cn=a,dc=root"));
+	assert(c->count == 0 && c->size == 0);
+
+	entry_cache_free(c);
+}
+
+void test_stale()
+{
+	ENTRY_CACHE *c = entry_cache_init(1 << 20, 10);
+	entry_cache_put_stale(c, "cn=a,dc=root", test_entry("cn=a,dc=root"));
+	c->lru_head->stored -= 11;
+
+	// kept past the ttl, but only handed out to callers asking for stale entries
+	bool stale = false;
+	assert(!entry_cache_get(c, "cn=a,dc=root"));
+	assert(entry_cache_lookup(c, "cn=a,dc=root", &stale) && stale);
+
+	entry_cache_put(c, "cn=a,dc=root", test_entry("cn=a,dc=root"));
+	assert(entry_cache_lookup(c, "cn=a,dc=root", &stale) && !stale);
+	assert(entry_cache_get(c, "cn=a,dc=root"));
+
+	entry_cache_free(c);
+}
+
+void count_entry(const char *dn, ENTRY * e, bool stale, void *ctx)
+{
+	char *order = ctx;
+	strcat(order, dn + 3);
+	strcat(order, stale ? "!" : "");
+}
+
+void test_foreach()
+{
+	ENTRY_CACHE *c = entry_cache_init(1 << 20, 0);
+	entry_cache_put(c, "cn=a,dc=root", test_entry("cn=a,dc=root"));
+	entry_cache_put_stale(c, "cn=b,dc=root", test_entry("cn=b,dc=root"));
+	entry_cache_put(c, "cn=c,dc=root", test_entry("cn=c,dc=root"));
+	assert(entry_cache_get(c, "cn=a,dc=root"));
+
+	char order[64] = "";
+	entry_cache_foreach(c, count_entry, order);
+	assert(strcmp(order, "b,dc=root!c,dc=roota,dc=root") == 0);
+
+	entry_cache_free(c);
+}
+
+void test_remove_subtree()
+{
+	ENTRY_CACHE *c = entry_cache_init(1 << 20, 0);
+	entry_cache_put(c, "dc=root", test_entry("dc=root"));
+	entry_cache_put(c, "o=bar,dc=root", test_entry("o=bar,dc=root"));
+	entry_cache_put(c, "cn=a,o=bar,dc=root", test_entry("cn=a,o=bar,dc=root"));
+	entry_cache_put(c, "cn=a,o=foobar,dc=root", test_entry("cn=a,o=foobar,dc=root"));
+
+	entry_cache_remove_subtree(c, "o=bar,dc=root");
+
+	assert(entry_cache_get(c, "dc=root"));
+	assert(!entry_cache_get(c, "o=bar,dc=root"));
+	assert(!entry_cache_get(c, "cn=a,o=bar,dc=root"));
+	assert(entry_cache_get(c, "cn=a,o=foobar,dc=root"));
+
+	entry_cache_free(c);
+}
+
+void test_many()
+{
+	ENTRY_CACHE *c = entry_cache_init(1 << 30, 0);
+	char dn[32];
+	for (unsigned i = 0; i < 2000; i++)
+	{
+		sprintf(dn, "cn=%u,dc=root", i);
+		entry_cache_put(c, dn, test_entry(dn));
+	}
+	assert(c->count == 2000);
+	assert(entry_cache_get(c, "cn=1234,dc=root"));
+	entry_cache_free(c);
+}
+
+int main()
+{
+	test_put_get();
+	test_get_attribute();
+	test_replace();
+	test_lru_eviction();
+	test_expiry();
+	test_stale();
+	test_foreach();
+	test_remove_subtree();
+	test_many();
+	return 0;
+}
@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include "ldifindex.h"
+
+LDIF_INDEX *open_text(const char *text)
+{
+	char filename[] = "/tmp/ldifindextest.ldif";
+	FILE *f = fopen(filename, "w");
+	assert(f);
+	fputs(text, f);
+	fclose(f);
+
+	LDIF_INDEX *index = ldif_index_open(filename);
+	assert(index);
+	unlink(filename);
+	return index;
+}
+
+void assert_name(LDIF_INDEX * index, unsigned id, const char *expected)
+{
+	ARENA *arena = arena_alloc();
+	char *name = ldif_index_name(index, id, arena);
+	assert(name && strcmp(name, expected) == 0);
+	arena_free(arena);
+}
+
+void test_tree()
+{
+	LDIF_INDEX *index = open_text("version: 1\n\n"
+				      "dn: dc=example,dc=com\ndc: example\n\n"
+				      "dn: ou=people,dc=example,dc=com\nou: people\n\n"
+				      "dn: uid=a,ou=people,dc=example,dc=com\nuid: a\n\n"
+				      "dn: ou=groups, dc=example, dc=com\nou: groups\n\n"
+				      "dn: uid=b,ou=people,dc=example,dc=com\nuid: b\n");
+	assert(ldif_index_count(index) == 5);
+	assert(ldif_index_skipped(index) == 0);
+
+	unsigned count;
+	const unsigned *top = ldif_index_children(index, ldif_index_find(index, ""), &count);
+	assert(count == 1 && top[0] == 0);
+	assert_name(index, 0, "dc=example,dc=com");
+
+	const unsigned *children = ldif_index_children(index, 0, &count);
+	assert(count == 2 && children[0] == 1 && children[1] == 3);
+	assert_name(index, 3, "ou=groups");
+
+	unsigned people = ldif_index_find(index, "OU=People,DC=example,DC=com");
+	assert(people == 1);
+	children = ldif_index_children(index, people, &count);
+	assert(count == 2 && children[0] == 2 && children[1] == 4);
+	assert_name(index, 4, "uid=b");
+
+	assert(ldif_index_find(index, "ou=groups,dc=example,dc=com") == 3);
+	assert(ldif_index_find(index, "ou=missing,dc=example,dc=com") == LDIF_INDEX_NONE);
+	ldif_index_children(index, 2, &count);
+	assert(count == 0);
+
+	LDIF_RECORD record;
+	assert(ldif_index_record(index, 2, &record));
+	assert(record.len == strlen("dn: uid=a,ou=people,dc=example,dc=com\nuid: a\n"));
+	assert(memcmp(record.text, "dn: uid=a,", 10) == 0);
+	assert(!ldif_index_record(index, ldif_index_count(index), &record));
+
+	ldif_index_close(index);
+}
+
+void test_children_before_parents()
+{
+	LDIF_INDEX *index = open_text("dn: cn=child,cn=parent,o=x\n\n"
+				      "dn: cn=parent,o=x\n\n"
+				      "dn: cn=other\\,escaped,o=x\n\n"
+				      "dn: o=x\n");
+	unsigned count;
+	const unsigned *children = ldif_index_children(index, ldif_index_find(index, "o=x"), &count);
+	assert(count == 2 && children[0] == 1 && children[1] == 2);
+	children = ldif_index_children(index, 1, &count);
+	assert(count == 1 && children[0] == 0);
+	assert_name(index, 2, "cn=other\\,escaped");
+	assert(ldif_index_find(index, "cn=other\\,escaped,o=x") == 2);
+
+	ldif_index_close(index);
+}
+
+void test_encoded_dn()
+{
+	// "cn=Müller,o=x"
+	LDIF_INDEX *index = open_text("dn: o=x\n\ndn:: Y249TcO8bGxlcixvPXg=\ncn:: TcO8bGxlcg==\n\n"
+				      "dn: cn=folded\n ,o=x\n");
+	assert(ldif_index_find(index, "cn=M\xc3\xbcller,o=x") == 1);
+	assert(ldif_index_find(index, "cn=folded,o=x") == 2);
+	assert_name(index, 1, "cn=M\xc3\xbcller");
+
+	ldif_index_close(index);
+}
+
+void test_skipped()
+{
+	LDIF_INDEX *index = open_text("dn: o=x\n\ncn: no dn\n\ndn: O=X\ndescription: again\n\n"
+				      "# only a comment\n");
+	assert(ldif_index_count(index) == 1);
+	assert(ldif_index_skipped(index) == 2);
+
+	ldif_index_close(index);
+}
+
+void test_many()
+{
+	// enough entries to grow the hash table several times
+	char filename[] = "/tmp/ldifindextest.ldif";
+	FILE *f = fopen(filename, "w");
+	assert(f);
+	fprintf(f, "dn: o=x\n\n");
+	for (unsigned i = 0; i < 20000; i++)
+		fprintf(f, "dn: cn=e%u,o=x\ncn: e%u\n\n", i, i);
+	fclose(f);
+	LDIF_INDEX *index = ldif_index_open(filename);
+	assert(index);
+	unlink(filename);
+
+	unsigned count;
+	ldif_index_children(index, 0, &count);
+	assert(count == 20000);
+	assert(ldif_index_find(index, "cn=e12345,o=x") == 12346);
+	assert(ldif_index_size(index) < 100 * ldif_index_count(index));
+
+	ldif_index_close(index);
+}
+
+void test_empty()
+{
+	LDIF_INDEX *index = open_text("");
+	unsigned count;
+	assert(ldif_index_count(index) == 0);
+	ldif_index_children(index, ldif_index_find(index, ""), &count);
+	assert(count == 0);
+	assert(ldif_index_find(index, "o=x") == LDIF_INDEX_NONE);
+
+	ldif_index_close(index);
+}
+
+int main()
+{
+	test_tree();
+	test_children_before_parents();
+	test_encoded_dn();
+	test_skipped();
+	test_many();
+	test_empty();
+	assert(ldif_index_open("/nonexistent/file.ldif") == NULL);
+	return 0;
+}
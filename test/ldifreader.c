@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include "ldifreader.h"
+
+LDIF_READER *open_text(const char *text)
+{
+	char filename[] = "/tmp/ldifreadertest.ldif";
+	FILE *f = fopen(filename, "w");
+	assert(f);
+	fputs(text, f);
+	fclose(f);
+
+	LDIF_READER *r = ldif_reader_open(filename);
+	assert(r);
+	unlink(filename);
+	return r;
+}
+
+void assert_line(LDIF_CURSOR * c, ARENA * arena, const char *name, const char *value,
+		 size_t value_len)
+{
+	LDIF_LINE line;
+	assert(ldif_cursor_next(c, arena, &line));
+	assert(ldif_line_is(&line, name));
+	assert(line.value_len == value_len);
+	assert(memcmp(line.value, value, value_len) == 0);
+}
+
+void test_records()
+{
+	LDIF_READER *r = open_text("version: 1\n\n# a comment\n\n"
+				   "dn: dc=example\ndc: example\n\n\n"
+				   "# before the entry\ndn: cn=a,dc=example\ncn: a\n");
+	LDIF_RECORD record;
+
+	assert(ldif_reader_next(r, &record));
+	assert(record.line == 5);
+	assert(record.len == strlen("dn: dc=example\ndc: example\n"));
+	assert(memcmp(record.text, "dn: dc=example\n", 15) == 0);
+
+	assert(ldif_reader_next(r, &record));
+	assert(record.line == 9);
+	assert(memcmp(record.text, "# before", 8) == 0);
+
+	assert(!ldif_reader_next(r, &record));
+	size_t size;
+	ldif_reader_data(r, &size);
+	assert(ldif_reader_offset(r) == size);
+	ldif_reader_close(r);
+}
+
+void test_version_in_first_record()
+{
+	LDIF_READER *r = open_text("version: 1\ndn: dc=example\n");
+	LDIF_RECORD record;
+
+	assert(ldif_reader_next(r, &record));
+	assert(record.line == 2);
+	assert(record.len == strlen("dn: dc=example\n"));
+	assert(!ldif_reader_next(r, &record));
+	ldif_reader_close(r);
+}
+
+void test_lines()
+{
+	LDIF_READER *r = open_text("dn: cn=a,dc=example\r\n"
+				   "# skipped\r\n"
+				   "description: folded\r\n  over\r\n  two lines\r\n"
+				   "userPassword:: c2VjcmV0\r\n"
+				   "cn:a\r\n"
+				   "empty:\r\n");
+	ARENA *arena = arena_alloc();
+	LDIF_RECORD record;
+	LDIF_CURSOR c;
+
+	assert(ldif_reader_next(r, &record));
+	ldif_cursor_init(&c, &record);
+	assert_line(&c, arena, "DN", "cn=a,dc=example", 15);
+	assert_line(&c, arena, "description", "folded over two lines", 21);
+	assert_line(&c, arena, "userpassword", "secret", 6);
+	assert_line(&c, arena, "cn", "a", 1);
+	assert_line(&c, arena, "empty", "", 0);
+
+	LDIF_LINE line;
+	assert(!ldif_cursor_next(&c, arena, &line));
+	assert(c.error == NULL);
+
+	arena_free(arena);
+	ldif_reader_close(r);
+}
+
+void test_zero_copy()
+{
+	LDIF_READER *r = open_text("dn: dc=example\n");
+	ARENA *arena = arena_alloc();
+	LDIF_RECORD record;
+	LDIF_CURSOR c;
+	LDIF_LINE line;
+	size_t arena_before = arena_size(arena);
+
+	assert(ldif_reader_next(r, &record));
+	ldif_cursor_init(&c, &record);
+	assert(ldif_cursor_next(&c, arena, &line));
+	assert(line.value == record.text + 4);
+	assert(arena_size(arena) == arena_before);
+
+	arena_free(arena);
+	ldif_reader_close(r);
+}
+
+void assert_error(const char *text)
+{
+	LDIF_READER *r = open_text(text);
+	ARENA *arena = arena_alloc();
+	LDIF_RECORD record;
+	LDIF_CURSOR c;
+	LDIF_LINE line;
+
+	assert(ldif_reader_next(r, &record));
+	ldif_cursor_init(&c, &record);
+	assert(ldif_cursor_next(&c, arena, &line));
+	assert(!ldif_cursor_next(&c, arena, &line));
+	assert(c.error != NULL);
+
+	arena_free(arena);
+	ldif_reader_close(r);
+}
+
+void test_errors()
+{
+	assert_error("dn: dc=example\njpegPhoto:< file:///tmp/photo.jpg\n");
+	assert_error("dn: dc=example\ncn:: not*base64\n");
+	assert_error("dn: dc=example\nno colon here\n");
+}
+
+void test_empty_file()
+{
+	LDIF_READER *r = open_text("");
+	LDIF_RECORD record;
+
+	assert(!ldif_reader_next(r, &record));
+	ldif_reader_close(r);
+}
+
+void test_missing_file()
+{
+	assert(ldif_reader_open("/nonexistent/file.ldif") == NULL);
+}
+
+int main()
+{
+	test_records();
+	test_version_in_first_record();
+	test_lines();
+	test_zero_copy();
+	test_errors();
+	test_empty_file();
+	test_missing_file();
+	return 0;
+}
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "outstream.h"
+
+// more than a few blocks, so the writer thread has to keep up
+#define DATA_SIZE ((7 << 20) / 2)
+
+char *make_data()
+{
+	char *data = malloc(DATA_SIZE);
+	for (unsigned i = 0; i < DATA_SIZE; i++)
+		data[i] = "dn: cn=test\nsn: x\n\n"[i % 19] + (i % 1000 == 0);
+	return data;
+}
+
+void write_in_pieces(OUTSTREAM * out, const char *data)
+{
+	for (size_t off = 0, n = 1; off < DATA_SIZE; off += n, n = n * 3 % 65521)
+	{
+		if (n > DATA_SIZE - off)
+			n = DATA_SIZE - off;
+		outstream_write(out, data + off, n);
+	}
+}
+
+void test_plain()
+{
+	char *data = make_data();
+	char filename[] = "/tmp/outstreamtest.ldif";
+
+	OUTSTREAM *out = outstream_open(filename);
+	assert(out);
+	write_in_pieces(out, data);
+	assert(outstream_close(out));
+
+	FILE *in = fopen(filename, "r");
+	char *read = malloc(DATA_SIZE + 1);
+	assert(fread(read, 1, DATA_SIZE + 1, in) == DATA_SIZE);
+	assert(memcmp(read, data, DATA_SIZE) == 0);
+	fclose(in);
+
+	unlink(filename);
+	free(read);
+	free(data);
+}
+
+void test_gzip()
+{
+	char *data = make_data();
+	char filename[] = "/tmp/outstreamtest.ldif.gz";
+
+	OUTSTREAM *out = outstream_open(filename);
+	assert(out);
+	write_in_pieces(out, data);
+	assert(outstream_close(out));
+
+	gzFile in = gzopen(filename, "r");
+	char *read = malloc(DATA_SIZE + 1);
+	assert(gzread(in, read, DATA_SIZE + 1) == DATA_SIZE);
+	assert(memcmp(read, data, DATA_SIZE) == 0);
+	gzclose(in);
+
+	unlink(filename);
+	free(read);
+	free(data);
+}
+
+void test_empty()
+{
+	char filename[] = "/tmp/outstreamtest.gz";
+
+	OUTSTREAM *out = outstream_open(filename);
+	assert(out);
+	assert(outstream_close(out));
+
+	char buffer[16];
+	gzFile in = gzopen(filename, "r");
+	assert(gzread(in, buffer, sizeof(buffer)) == 0);
+	gzclose(in);
+	unlink(filename);
+}
+
+void test_open_failure()
+{
+	assert(outstream_open("/nonexistent/dir/file.ldif") == NULL);
+}
+
+int main()
+{
+	test_plain();
+	test_gzip();
+	test_empty();
+	test_open_failure();
+	return 0;
+}
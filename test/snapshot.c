@@ -0,0 +1,135 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "snapshot.h"
+
+#define URI "ldap://localhost"
+#define PATH "/tmp/snapshotTest.snapshot"
+
+TREENODE *test_tree()
+{
+	TREENODE *root = tree_node_alloc();
+	root->value = strdup("dc=example,dc=com");
+
+	TREENODE *people = tree_node_alloc_child(root, "ou=people");
+	people->num_subordinates = 2;
+	tree_node_alloc_child(people, "cn=alice")->is_leaf = true;
+	tree_node_alloc_child(people, "cn=b\\+ob")->is_leaf = true;
+	TREENODE *groups = tree_node_alloc_child(root, "ou=groups");
+	groups->vlv_offset = 11;
+	groups->vlv_count = 20000;
+	tree_node_alloc_child(groups, "cn=admins");
+	tree_node_set_collapsed(groups, true);
+	return root;
+}
+
+ENTRY_CACHE *test_cache()
+{
+	ENTRY_CACHE *c = entry_cache_init(1 << 20, 0);
+	ENTRY *e = entry_alloc("cn=alice,ou=people,dc=example,dc=com");
+	entry_add_attribute(e, "cn");
+	entry_add_value(e, "alice", 5);
+	entry_add_attribute(e, "jpegPhoto");
+	entry_add_value(e, "\xff\0\x01", 3);
+	entry_cache_put(c, "cn=alice,ou=people,dc=example,dc=com", e);
+	entry_cache_put(c, "ou=people,dc=example,dc=com", entry_alloc("ou=People,dc=example,dc=com"));
+	return c;
+}
+
+void test_round_trip()
+{
+	TREENODE *root = test_tree();
+	ENTRY_CACHE *cache = test_cache();
+	assert(snapshot_save(PATH, URI, "", root, cache));
+
+	TREENODE *loaded = tree_node_alloc();
+	ENTRY_CACHE *loaded_cache = entry_cache_init(1 << 20, 0);
+	assert(snapshot_load(PATH, URI, "", loaded, loaded_cache));
+
+	assert(strcmp(loaded->value, "dc=example,dc=com") == 0);
+	assert(loaded->subtree_size == root->subtree_size);
+	for (TREENODE * a = root, *b = loaded; a || b;
+	     a = tree_node_next(root, a), b = tree_node_next(loaded, b))
+	{
+		assert(a && b);
+		assert(strcmp(tree_node_dn(a), tree_node_dn(b)) == 0);
+		assert(a->is_leaf == b->is_leaf);
+		assert(a->num_subordinates == b->num_subordinates);
+		assert(a->vlv_offset == b->vlv_offset && a->vlv_count == b->vlv_count);
+		assert(a->collapsed == b->collapsed && a->num_children == b->num_children);
+	}
+	assert(loaded->children[1]->collapsed && loaded->children[1]->num_children == 1);
+
+	// entries come back stale, in the same recency order
+	bool stale;
+	assert(entry_cache_get(loaded_cache, "cn=alice,ou=people,dc=example,dc=com") == NULL);
+	ENTRY *e = entry_cache_lookup(loaded_cache, "cn=alice,ou=people,dc=example,dc=com", &stale);
+	assert(e && stale);
+	assert(e->num_attributes == 2 && e->attributes[1].values[0].len == 3);
+	assert(memcmp(e->attributes[1].values[0].data, "\xff\0\x01", 3) == 0);
+	e = entry_cache_lookup(loaded_cache, "ou=people,dc=example,dc=com", &stale);
+	assert(e && stale && strcmp(e->dn, "ou=People,dc=example,dc=com") == 0);
+	assert(loaded_cache->lru_head->entry == e);
+
+	tree_node_free(loaded);
+	entry_cache_free(loaded_cache);
+	tree_node_free(root);
+	entry_cache_free(cache);
+	unlink(PATH);
+}
+
+void test_key_mismatch()
+{
+	TREENODE *root = test_tree();
+	ENTRY_CACHE *cache = test_cache();
+	assert(snapshot_save(PATH, URI, "", root, cache));
+
+	TREENODE *loaded = tree_node_alloc();
+	assert(!snapshot_load(PATH, URI, "dc=example,dc=com", loaded, cache));
+	assert(!snapshot_load(PATH, "ldap://other", "", loaded, cache));
+	assert(!snapshot_load("/tmp/snapshotTest.missing", URI, "", loaded, cache));
+	assert(loaded->value == NULL && loaded->num_children == 0);
+
+	tree_node_free(loaded);
+	tree_node_free(root);
+	entry_cache_free(cache);
+	unlink(PATH);
+}
+
+void test_truncated()
+{
+	TREENODE *root = test_tree();
+	ENTRY_CACHE *cache = test_cache();
+	assert(snapshot_save(PATH, URI, "", root, cache));
+
+	FILE *f = fopen(PATH, "rb");
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fclose(f);
+
+	// every cut must be rejected without touching the tree or the cache
+	ENTRY_CACHE *loaded_cache = entry_cache_init(1 << 20, 0);
+	for (long len = size - 1; len >= 0; len--)
+	{
+		assert(truncate(PATH, len) == 0);
+		TREENODE *loaded = tree_node_alloc();
+		assert(!snapshot_load(PATH, URI, "", loaded, loaded_cache));
+		assert(loaded->num_children == 0 && loaded_cache->count == 0);
+		tree_node_free(loaded);
+	}
+
+	entry_cache_free(loaded_cache);
+	tree_node_free(root);
+	entry_cache_free(cache);
+	unlink(PATH);
+}
+
+int main()
+{
+	test_round_trip();
+	test_key_mismatch();
+	test_truncated();
+	return 0;
+}
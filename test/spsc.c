@@ -0,0 +1,68 @@
+#include <assert.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include "spsc.h"
+
+#define COUNT 200000
+
+void test_fifo()
+{
+	SPSC_QUEUE q;
+	spsc_init(&q);
+
+	int values[3];
+	assert(spsc_pop(&q) == NULL);
+	for (unsigned i = 0; i < 3; i++)
+		spsc_push(&q, &values[i]);
+	assert(spsc_pop(&q) == &values[0]);
+	spsc_push(&q, &values[0]);
+	assert(spsc_pop(&q) == &values[1]);
+	assert(spsc_pop(&q) == &values[2]);
+	assert(spsc_pop(&q) == &values[0]);
+	assert(spsc_pop(&q) == NULL);
+
+	spsc_destroy(&q);
+}
+
+void *produce(void *arg)
+{
+	SPSC_QUEUE *q = arg;
+	for (uintptr_t i = 1; i <= COUNT; i++)
+		spsc_push(q, (void *)i);
+	return NULL;
+}
+
+void test_threads()
+{
+	SPSC_QUEUE q;
+	spsc_init(&q);
+
+	pthread_t producer;
+	pthread_create(&producer, NULL, produce, &q);
+
+	// every element arrives exactly once and in order
+	uintptr_t expected = 1;
+	while (expected <= COUNT)
+	{
+		void *value = spsc_pop(&q);
+		if (!value)
+		{
+			sched_yield();
+			continue;
+		}
+		assert((uintptr_t) value == expected);
+		expected++;
+	}
+
+	pthread_join(producer, NULL);
+	assert(spsc_pop(&q) == NULL);
+	spsc_destroy(&q);
+}
+
+int main()
+{
+	test_fifo();
+	test_threads();
+	return 0;
+}
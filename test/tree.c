@@ -1,5 +1,7 @@
 #include <stdlib.h>
 #include <assert.h>
+#include <stdio.h>
+#include <string.h>
 #include "tree.h"
 
 void test_add()
@@ -31,18 +33,342 @@ void test_get_parent()
 	tree_node_append_child(root, child1);
 	tree_node_append_child(child1, child11);
 
-	/*assert(tree_node_get_parent(root, root) == NULL);
-	   assert(tree_node_get_parent(root, child1) == root);
-	 */
+	assert(tree_node_get_parent(root, root) == NULL);
+	assert(tree_node_get_parent(root, child1) == root);
 	assert(tree_node_get_parent(root, child11) == child1);
 
 	tree_node_free(root);
 }
 
+void test_append_many()
+{
+	TREENODE *root = tree_node_alloc(), *bulk[3];
+
+	for (unsigned i = 0; i < 1000; i++)
+		tree_node_append_child(root, tree_node_alloc());
+	assert(tree_node_children_count(root) == 1000);
+	assert(root->children_capacity >= 1000);
+
+	for (unsigned i = 0; i < 3; i++)
+		bulk[i] = tree_node_alloc();
+	tree_node_reserve_children(root, 2000);
+	tree_node_append_children(root, bulk, 3);
+	assert(tree_node_children_count(root) == 1003);
+	assert(root->children_capacity == 2000);
+	assert(root->children[1002] == bulk[2]);
+	assert(bulk[2]->parent == root);
+
+	tree_node_remove_childs(root);
+	assert(tree_node_children_count(root) == 0);
+	tree_node_free(root);
+}
+
+void test_alloc_child()
+{
+	TREENODE *root = tree_node_alloc();
+
+	TREENODE *child = tree_node_alloc_child(root, "cn=child");
+	TREENODE *grandchild = tree_node_alloc_child(child, "cn=grandchild");
+	tree_node_append_child(child, tree_node_alloc());
+
+	assert(child->parent == root);
+	assert(grandchild->parent == child);
+	assert(strcmp(grandchild->value, "cn=grandchild") == 0);
+
+	tree_node_remove_childs(root);
+	assert(tree_node_children_count(root) == 0);
+
+	// the arena is reused after a reset
+	child = tree_node_alloc_child(root, "cn=again");
+	assert(strcmp(child->value, "cn=again") == 0);
+
+	tree_node_free(root);
+}
+
+void collect_preorder(TREENODE * node, TREENODE ** rows, unsigned *count)
+{
+	rows[(*count)++] = node;
+	for (unsigned i = 0; i < node->num_children && !node->collapsed; i++)
+		collect_preorder(node->children[i], rows, count);
+}
+
+void assert_rows_consistent(TREENODE * root)
+{
+	TREENODE *rows[512];
+	unsigned count = 0;
+	collect_preorder(root, rows, &count);
+
+	assert(root->subtree_size == count);
+	for (unsigned i = 0; i < count; i++)
+	{
+		unsigned row;
+		assert(tree_node_at_row(root, i) == rows[i]);
+		assert(tree_node_row(root, rows[i], &row));
+		assert(row == i);
+	}
+	assert(tree_node_at_row(root, count) == NULL);
+
+	TREENODE *node = root;
+	for (unsigned i = 1; i < count; i++)
+	{
+		node = tree_node_next(root, node);
+		assert(node == rows[i]);
+		assert(tree_node_depth(root, node) == tree_node_depth(root, node->parent) + 1);
+	}
+	assert(tree_node_next(root, node) == NULL);
+}
+
+void test_rows()
+{
+	TREENODE *root = tree_node_alloc();
+	assert_rows_consistent(root);
+
+	for (unsigned i = 0; i < 13; i++)
+	{
+		TREENODE *child = tree_node_alloc_child(root, "child");
+		for (unsigned j = 0; j < i % 4; j++)
+			tree_node_alloc_child(child, "grandchild");
+	}
+	assert_rows_consistent(root);
+
+	// grow a subtree in the middle after its siblings exist
+	TREENODE *middle = root->children[6];
+	for (unsigned j = 0; j < 20; j++)
+		tree_node_alloc_child(middle->children[0], "greatgrandchild");
+	assert_rows_consistent(root);
+
+	tree_node_remove_childs(middle);
+	assert_rows_consistent(root);
+
+	// append a prebuilt subtree
+	TREENODE *subtree = tree_node_alloc();
+	tree_node_append_child(subtree, tree_node_alloc());
+	tree_node_append_child(root->children[2], subtree);
+	assert_rows_consistent(root);
+
+	TREENODE *other = tree_node_alloc();
+	unsigned row;
+	assert(!tree_node_row(root, other, &row));
+	tree_node_free(other);
+
+	tree_node_free(root);
+}
+
+void test_dn()
+{
+	TREENODE *root = tree_node_alloc();
+	root->value = strdup("dc=example,dc=com");
+
+	TREENODE *ou = tree_node_alloc_child(root, "ou=people");
+	TREENODE *cn = tree_node_alloc_child(ou, "cn=John\\+Doe");
+
+	assert(strcmp(tree_node_dn(root), "dc=example,dc=com") == 0);
+	assert(strcmp(tree_node_dn(ou), "ou=people,dc=example,dc=com") == 0);
+	assert(strcmp(tree_node_dn(cn), "cn=John\\+Doe,ou=people,dc=example,dc=com") == 0);
+	assert(tree_node_dn(cn) == tree_node_dn(cn));
+
+	tree_node_free(root);
+}
+
+void test_appended_dn()
+{
+	TREENODE *root = tree_node_alloc(), *ou = tree_node_alloc(), *cn = tree_node_alloc();
+	root->value = strdup("dc=example,dc=com");
+	ou->value = strdup("ou=people");
+	cn->value = strdup("cn=a");
+
+	// built before its parent is in the tree
+	tree_node_append_child(ou, cn);
+	TREENODE *arena_child = tree_node_alloc_child(ou, "cn=b");
+	assert(strcmp(tree_node_dn(cn), "cn=a,ou=people") == 0);
+
+	tree_node_append_child(root, ou);
+	assert(strcmp(tree_node_dn(ou), "ou=people,dc=example,dc=com") == 0);
+	assert(strcmp(tree_node_dn(cn), "cn=a,ou=people,dc=example,dc=com") == 0);
+	assert(strcmp(tree_node_dn(arena_child), "cn=b,ou=people,dc=example,dc=com") == 0);
+	assert(tree_node_find(root, "cn=a,ou=people,dc=example,dc=com") == cn);
+
+	tree_node_free(root);
+}
+
+void test_remove_child()
+{
+	TREENODE *root = tree_node_alloc();
+	root->value = strdup("dc=example");
+	for (unsigned i = 0; i < 9; i++)
+	{
+		TREENODE *child = tree_node_alloc_child(root, "ou=child");
+		for (unsigned j = 0; j < i; j++)
+			tree_node_alloc_child(child, "cn=grandchild");
+	}
+	tree_node_append_child(root->children[4], tree_node_alloc());
+	assert_rows_consistent(root);
+
+	TREENODE *after = root->children[5];
+	tree_node_remove_child(root, 4);
+	assert(root->num_children == 8 && root->children[4] == after);
+	assert(after->index_in_parent == 4);
+	assert_rows_consistent(root);
+
+	tree_node_remove_child(root->children[7], 0);
+	tree_node_remove_child(root, 7);
+	tree_node_remove_child(root, 0);
+	assert_rows_consistent(root);
+
+	while (root->num_children)
+		tree_node_remove_child(root, root->num_children / 2);
+	assert(root->subtree_size == 1);
+	assert_rows_consistent(root);
+
+	tree_node_free(root);
+}
+
+void test_collapse()
+{
+	TREENODE *root = tree_node_alloc();
+	root->value = strdup("dc=example");
+	for (unsigned i = 0; i < 5; i++)
+	{
+		TREENODE *child = tree_node_alloc_child(root, "ou=child");
+		for (unsigned j = 0; j < 3; j++)
+			tree_node_alloc_child(tree_node_alloc_child(child, "ou=sub"), "cn=leaf");
+	}
+	assert(root->subtree_size == 1 + 5 * 7);
+
+	TREENODE *child = root->children[2];
+	TREENODE *hidden = child->children[1];
+	tree_node_set_collapsed(child, true);
+	assert(child->subtree_size == 1);
+	assert(root->subtree_size == 1 + 4 * 7 + 1);
+	assert_rows_consistent(root);
+
+	unsigned row;
+	assert(!tree_node_row(root, hidden, &row));
+	assert(tree_node_next(root, child) == root->children[3]);
+
+	// changes below a collapsed node only show once it is expanded
+	tree_node_alloc_child(hidden, "cn=new");
+	tree_node_remove_child(child, 0);
+	tree_node_set_collapsed(hidden, true);
+	assert(root->subtree_size == 1 + 4 * 7 + 1);
+	assert_rows_consistent(root);
+
+	tree_node_set_collapsed(child, false);
+	assert(child->subtree_size == 1 + 2 + 1);
+	assert_rows_consistent(root);
+
+	tree_node_set_collapsed(hidden, false);
+	assert(child->subtree_size == 1 + 2 + 3);
+	assert_rows_consistent(root);
+
+	tree_node_set_collapsed(root, true);
+	assert(root->subtree_size == 1 && tree_node_at_row(root, 1) == NULL);
+	tree_node_set_collapsed(root, false);
+	assert_rows_consistent(root);
+
+	tree_node_free(root);
+}
+
+void test_find()
+{
+	TREENODE *root = tree_node_alloc();
+	root->value = strdup("dc=example,dc=com");
+
+	TREENODE *people = tree_node_alloc_child(root, "ou=people");
+	TREENODE *people2 = tree_node_alloc_child(root, "ou=people2");
+	TREENODE *cn = tree_node_alloc_child(people2, "cn=john");
+
+	assert(tree_node_find(root, "dc=example,dc=com") == root);
+	assert(tree_node_find(root, "ou=people,dc=example,dc=com") == people);
+	assert(tree_node_find(root, "OU=People2,DC=example,DC=com") == people2);
+	assert(tree_node_find(root, "cn=john,ou=people2,dc=example,dc=com") == cn);
+	assert(tree_node_find(root, "cn=john,ou=people,dc=example,dc=com") == NULL);
+	assert(tree_node_find(root, "xou=people,dc=example,dc=com") == NULL);
+	assert(tree_node_find(root, "dc=other,dc=com") == NULL);
+
+	// wide enough to be indexed, with escaped commas in values
+	for (unsigned i = 0; i < 100; i++)
+	{
+		char value[32];
+		snprintf(value, sizeof(value), "cn=Doe\\, %u", i);
+		tree_node_alloc_child(people, value);
+	}
+	assert(tree_node_find(root, "cn=doe\\, 42,ou=people,dc=example,dc=com") == people->children[42]);
+	assert(tree_node_find(root, "cn=doe\\, 100,ou=people,dc=example,dc=com") == NULL);
+	assert(tree_node_child(people, "CN=Doe\\, 99") == people->children[99]);
+	TREENODE *late = tree_node_alloc_child(people, "cn=late");
+	assert(tree_node_find(root, "cn=late,ou=people,dc=example,dc=com") == late);
+
+	tree_node_free(root);
+
+	// below the empty DN values are whole DNs
+	root = tree_node_alloc();
+	root->value = strdup("");
+	TREENODE *base = tree_node_alloc_child(root, "dc=example,dc=com");
+	TREENODE *other = tree_node_alloc_child(root, "dc=com");
+	cn = tree_node_alloc_child(base, "cn=john");
+	assert(tree_node_find(root, "") == root);
+	assert(tree_node_find(root, "cn=john,dc=example,dc=com") == cn);
+	assert(tree_node_find(root, "dc=com") == other);
+	assert(tree_node_find(root, "dc=example,dc=org") == NULL);
+	tree_node_free(root);
+}
+
+void test_remove_marked()
+{
+	TREENODE *root = tree_node_alloc();
+	root->value = strdup("dc=example");
+	for (unsigned i = 0; i < 20; i++)
+	{
+		char value[32];
+		snprintf(value, sizeof(value), "ou=child%u", i);
+		TREENODE *child = tree_node_alloc_child(root, value);
+		for (unsigned j = 0; j < i % 3; j++)
+			tree_node_alloc_child(child, "cn=grandchild");
+	}
+	assert(tree_node_find(root, "ou=child5,dc=example") == root->children[5]);
+	assert(tree_node_remove_marked(root) == 0);
+
+	TREENODE *kept = root->children[7];
+	for (unsigned i = 0; i < 20; i += 2)
+		tree_node_mark_removed(root->children[i]);
+	tree_node_mark_removed(root->children[7]->children[0]);
+	assert(tree_node_find(root, "ou=child4,dc=example") == NULL);
+	assert(tree_node_child(root, "ou=child4") == NULL);
+	assert(tree_node_find(root, "ou=child5,dc=example") == root->children[5]);
+	// the rows stay until removed
+	assert(root->num_children == 20);
+	assert_rows_consistent(root);
+
+	assert(tree_node_remove_marked(root) == 10);
+	assert(root->num_children == 10 && root->children[3] == kept);
+	assert(kept->index_in_parent == 3);
+	assert(tree_node_find(root, "ou=child7,dc=example") == kept);
+	assert_rows_consistent(root);
+
+	assert(tree_node_remove_marked(root->children[3]) == 1);
+	assert_rows_consistent(root);
+
+	// a child appended again under the same value is found
+	TREENODE *again = tree_node_alloc_child(root, "ou=child4");
+	assert(tree_node_find(root, "ou=child4,dc=example") == again);
+
+	tree_node_free(root);
+}
+
 int main()
 {
 	test_add();
 	test_remove_childs();
 	test_get_parent();
+	test_append_many();
+	test_alloc_child();
+	test_rows();
+	test_dn();
+	test_appended_dn();
+	test_remove_child();
+	test_collapse();
+	test_find();
+	test_remove_marked();
 	return 0;
 }
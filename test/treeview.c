@@ -29,12 +29,96 @@ void test_create_add_free()
 	tree_node_free(root);
 }
 
+void test_move()
+{
+	TREENODE *root = tree_node_alloc(), *child1 = tree_node_alloc(), *child2 = tree_node_alloc();
+
+	root->value = strdup("root");
+	child1->value = strdup("child1");
+	child2->value = strdup("child2");
+
+	tree_node_append_child(root, child1);
+	tree_node_append_child(root, child2);
+
+	TREEVIEW *tv = treeview_init(10, 20);
+	treeview_set_tree(tv, root);
+
+	treeview_move(tv, 1);
+	assert(treeview_current_node(tv) == child1);
+	treeview_move(tv, 5);
+	assert(treeview_current_node(tv) == child2);
+	treeview_move(tv, -10);
+	assert(treeview_current_node(tv) == root);
+
+	treeview_free(tv);
+	tree_node_free(root);
+}
+
+void test_markers()
+{
+	TREENODE *root = tree_node_alloc(), *leaf = tree_node_alloc(), *container = tree_node_alloc();
+
+	root->value = strdup("root");
+	leaf->value = strdup("leaf");
+	leaf->is_leaf = true;
+	container->value = strdup("container");
+
+	tree_node_append_child(root, leaf);
+	tree_node_append_child(root, container);
+
+	TREEVIEW *tv = treeview_init(10, 20);
+	treeview_set_tree(tv, root);
+	treeview_driver(tv, 0);
+	assert((mvwinch(tv->win, 0, 0) & A_CHARTEXT) == '-');
+	assert((mvwinch(tv->win, 1, 2) & A_CHARTEXT) == ' ');
+	assert((mvwinch(tv->win, 1, 4) & A_CHARTEXT) == 'l');
+	assert((mvwinch(tv->win, 2, 2) & A_CHARTEXT) == '+');
+
+	treeview_free(tv);
+	tree_node_free(root);
+}
+
+void test_rows_inserted()
+{
+	TREENODE *root = tree_node_alloc();
+	root->value = strdup("root");
+	for (unsigned i = 0; i < 30; i++)
+		tree_node_alloc_child(root, "child");
+
+	TREEVIEW *tv = treeview_init(10, 20);
+	treeview_set_tree(tv, root);
+	treeview_move(tv, 25);
+	TREENODE *current = treeview_current_node(tv);
+	unsigned toprow = tv->toprow;
+	assert(toprow > 3);
+
+	// children listed for a container above the page
+	TREENODE *container = root->children[2];
+	for (unsigned i = 0; i < 4; i++)
+		tree_node_alloc_child(container, "grandchild");
+	treeview_rows_inserted(tv, 3, 4);
+	assert(treeview_current_node(tv) == current);
+	assert(tv->toprow == toprow + 4);
+
+	// and below the selection
+	tree_node_alloc_child(root->children[28], "grandchild");
+	treeview_rows_inserted(tv, 33, 1);
+	assert(treeview_current_node(tv) == current);
+	assert(tv->toprow == toprow + 4);
+
+	treeview_free(tv);
+	tree_node_free(root);
+}
+
 int main()
 {
 	initscr();		// needed because stdscr must be set with curses 5.9
 
 	test_create_set_tree_free();
 	test_create_add_free();
+	test_move();
+	test_markers();
+	test_rows_inserted();
 
 	endwin();
 	return 0;